@@ -0,0 +1,155 @@
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+/* Macros */
+#define ALIGN(n)   (((n) + 15) & ~(size_t) 15)
+#define HEADERSIZE ALIGN(sizeof(ArenaBlock))
+#define DATA(b)    ((unsigned char *) (b) + HEADERSIZE)
+
+/* Types */
+struct ArenaBlock {
+    ArenaBlock *prev;
+    size_t size, used;
+};
+
+/* Function prototypes */
+static ArenaBlock *newblock(ArenaBlock *prev, size_t size);
+#ifdef ALLOCCOUNT
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *p, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *p, size_t size);
+#endif /* ALLOCCOUNT */
+
+/* Variables */
+static unsigned long allocs;
+
+/* Function implementations */
+
+ArenaBlock *
+newblock(ArenaBlock *prev, size_t size)
+{
+    ArenaBlock *b;
+
+    if (!(b = (ArenaBlock *) malloc(HEADERSIZE + size)))
+	return NULL;
+    b->prev = prev;
+    b->size = size;
+    b->used = 0;
+
+    return b;
+}
+
+int
+arenainit(Arena *arena, size_t size)
+{
+    arena->top = newblock(NULL, ALIGN(size ? size : 1));
+    arena->total = arena->top ? arena->top->size : 0;
+
+    return arena->top != NULL;
+}
+
+void *
+arenaalloc(Arena *arena, size_t size)
+{
+    ArenaBlock *b = arena->top;
+    size_t at;
+
+    size = ALIGN(size ? size : 1);
+    if (!b || b->size - b->used < size) {
+	/* At least double, so a growing arena chains few blocks */
+	if (!(b = newblock(b, size > arena->total ? size : arena->total)))
+	    return NULL;
+	arena->top = b;
+	arena->total += b->size;
+    }
+    at = b->used;
+    b->used += size;
+
+    return DATA(b) + at;
+}
+
+ArenaMark
+arenamark(const Arena *arena)
+{
+    ArenaMark mark;
+
+    mark.block = arena->top;
+    mark.used = arena->top ? arena->top->used : 0;
+
+    return mark;
+}
+
+void
+arenarelease(Arena *arena, ArenaMark mark)
+{
+    ArenaBlock *b;
+
+    while (arena->top != mark.block) {
+	b = arena->top;
+	arena->top = b->prev;
+	arena->total -= b->size;
+	free(b);
+    }
+    if (arena->top)
+	arena->top->used = mark.used;
+}
+
+int
+arenareset(Arena *arena)
+{
+    size_t total = arena->total;
+
+    if (arena->top && !arena->top->prev) {
+	arena->top->used = 0;
+	return 1;
+    }
+
+    arenaterm(arena);
+
+    return arenainit(arena, total);
+}
+
+void
+arenaterm(Arena *arena)
+{
+    ArenaMark none = { NULL, 0 };
+
+    arenarelease(arena, none);
+}
+
+unsigned long
+heapallocs(void)
+{
+    return __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+}
+
+#ifdef ALLOCCOUNT
+void *
+__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+
+    return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t count, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+
+    return __real_calloc(count, size);
+}
+
+void *
+__wrap_realloc(void *p, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+
+    return __real_realloc(p, size);
+}
+#endif /* ALLOCCOUNT */
@@ -0,0 +1,33 @@
+/* Arena allocators.
+ *
+ * An arena hands out memory by bumping an offset, 16 byte aligned, and
+ * frees it all at once. arenainit() reserves a first block and
+ * arenaalloc() chains on another when that is full, returning NULL when out
+ * of memory. arenareset() frees everything, and if more than one block was
+ * needed it swaps them for a single block as big as all of them, so an arena
+ * reset every frame stops touching the heap once it has warmed up.
+ * arenamark() and arenarelease() scope allocations: releasing frees
+ * everything allocated since the mark. heapallocs() counts the calls to
+ * malloc(), calloc() and realloc() made by this program when built with
+ * ALLOCCOUNT and linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,
+ * otherwise it is always 0. Requires stddef.h. */
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *top;    /* The block being filled, it links to the rest */
+    size_t total;       /* Bytes in all blocks */
+} Arena;
+
+typedef struct {
+    ArenaBlock *block;
+    size_t used;
+} ArenaMark;
+
+int arenainit(Arena *arena, size_t size);
+void *arenaalloc(Arena *arena, size_t size);
+ArenaMark arenamark(const Arena *arena);
+void arenarelease(Arena *arena, ArenaMark mark);
+int arenareset(Arena *arena);
+void arenaterm(Arena *arena);
+unsigned long heapallocs(void);
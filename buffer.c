@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad.h"
+#include "buffer.h"
+#include "vram.h"
+
+/* Macros */
+#define BUFFERMAX 16
+#define ALIGNMENT 256   /* Bytes a unit, the largest binding alignment */
+#define NODEMAX   16384 /* Ranges, used and free, a buffer */
+#define BINS      240   /* 8 per power of two, sizes below 2^31 units */
+#define NIL       0xffffffffu
+
+/* Types */
+typedef struct {
+    BufferRange range;  /* First, a range is its node */
+    unsigned int offset, size;  /* Units */
+    unsigned int prev, next;    /* Neighbours in the buffer */
+    unsigned int binprev, binnext;
+    unsigned int heap;
+    int used;
+} Node;
+
+typedef struct {
+    GLuint name;
+    unsigned int index; /* In heaps */
+    unsigned int size;  /* Units */
+    Node *nodes;
+    unsigned int *spare, sparecount;    /* Unused nodes */
+    unsigned int first; /* At offset 0 */
+    unsigned int bins[BINS];
+    unsigned int top;   /* Bit per group of 8 bins with a free range */
+    unsigned char low[BINS / 8];        /* Bit per bin in each group */
+} Heap;
+
+/* Function prototypes */
+static unsigned int binof(unsigned int size, int up);
+static unsigned int findbin(const Heap *h, unsigned int bin);
+static void addfree(Heap *h, unsigned int n);
+static void removefree(Heap *h, unsigned int n);
+static unsigned int newnode(Heap *h);
+static Heap *newheap(unsigned int size);
+static Node *take(Heap *h, unsigned int size);
+static void move(GLuint name, size_t from, size_t to, size_t size);
+static size_t compact(Heap *h);
+
+/* Variables */
+static Heap *heaps[BUFFERMAX];
+static unsigned int heapcount;
+static unsigned int heapsize;   /* Units */
+
+/* Function implementations */
+
+unsigned int
+binof(unsigned int size, int up)
+{
+    unsigned int shift, bin;
+
+    /* A float with a 3 bit mantissa, rounded down to file a free range and
+     * up to find one that surely fits */
+    if (size < 8)
+	return size;
+    shift = 31 - __builtin_clz(size) - 3;
+    bin = (shift + 1) << 3 | (size >> shift & 7);
+    if (up && size & ((1u << shift) - 1))
+	bin++;
+
+    return bin;
+}
+
+unsigned int
+findbin(const Heap *h, unsigned int bin)
+{
+    unsigned int group = bin >> 3, mask;
+
+    if (bin >= BINS)
+	return NIL;
+    mask = h->low[group] & (0xffu << (bin & 7));
+    if (!mask) {
+	mask = group + 1 < 32 ? h->top & (~0u << (group + 1)) : 0;
+	if (!mask)
+	    return NIL;
+	group = __builtin_ctz(mask);
+	mask = h->low[group];
+    }
+
+    return group << 3 | __builtin_ctz(mask);
+}
+
+void
+addfree(Heap *h, unsigned int n)
+{
+    Node *node = &h->nodes[n];
+    unsigned int bin = binof(node->size, 0);
+
+    node->used = 0;
+    node->binprev = NIL;
+    node->binnext = h->bins[bin];
+    if (node->binnext != NIL)
+	h->nodes[node->binnext].binprev = n;
+    h->bins[bin] = n;
+    h->low[bin >> 3] |= 1u << (bin & 7);
+    h->top |= 1u << (bin >> 3);
+}
+
+void
+removefree(Heap *h, unsigned int n)
+{
+    Node *node = &h->nodes[n];
+    unsigned int bin = binof(node->size, 0);
+
+    if (node->binprev != NIL)
+	h->nodes[node->binprev].binnext = node->binnext;
+    else
+	h->bins[bin] = node->binnext;
+    if (node->binnext != NIL)
+	h->nodes[node->binnext].binprev = node->binprev;
+    if (h->bins[bin] == NIL) {
+	h->low[bin >> 3] &= ~(1u << (bin & 7));
+	if (!h->low[bin >> 3])
+	    h->top &= ~(1u << (bin >> 3));
+    }
+}
+
+unsigned int
+newnode(Heap *h)
+{
+    return h->sparecount ? h->spare[--h->sparecount] : NIL;
+}
+
+Heap *
+newheap(unsigned int size)
+{
+    Heap *h;
+    unsigned int i;
+
+    if (!(h = (Heap *) calloc(1, sizeof(Heap))))
+	return NULL;
+    h->nodes = (Node *) calloc(NODEMAX, sizeof(Node));
+    h->spare = (unsigned int *) malloc(NODEMAX * sizeof(unsigned int));
+    if (!h->nodes || !h->spare) {
+	free(h->nodes);
+	free(h->spare);
+	free(h);
+	return NULL;
+    }
+    for (i = 0; i < NODEMAX; i++)
+	h->spare[i] = NODEMAX - 1 - i;
+    h->sparecount = NODEMAX;
+    for (i = 0; i < BINS; i++)
+	h->bins[i] = NIL;
+
+    glCreateBuffers(1, &h->name);
+    glNamedBufferStorage(h->name, (GLsizeiptr) size * ALIGNMENT, NULL,
+	    GL_DYNAMIC_STORAGE_BIT);
+    vramtrack(GL_BUFFER, h->name, VRAMPOOL, (size_t) size * ALIGNMENT,
+	    "buffer");
+    h->index = heapcount;
+    h->size = size;
+    h->first = newnode(h);
+    h->nodes[h->first].size = size;
+    h->nodes[h->first].prev = h->nodes[h->first].next = NIL;
+    h->nodes[h->first].heap = h->index;
+    addfree(h, h->first);
+
+    return h;
+}
+
+Node *
+take(Heap *h, unsigned int size)
+{
+    unsigned int bin, n, rest;
+    Node *node, *r;
+
+    if ((bin = findbin(h, binof(size, 1))) == NIL)
+	return NULL;
+    n = h->bins[bin];
+    node = &h->nodes[n];
+
+    /* The split needs a node, without one leave the range whole */
+    if (node->size > size && (rest = newnode(h)) != NIL) {
+	removefree(h, n);
+	r = &h->nodes[rest];
+	r->offset = node->offset + size;
+	r->size = node->size - size;
+	r->prev = n;
+	r->next = node->next;
+	r->heap = h->index;
+	if (r->next != NIL)
+	    h->nodes[r->next].prev = rest;
+	node->next = rest;
+	node->size = size;
+	addfree(h, rest);
+    } else {
+	removefree(h, n);
+    }
+    node->used = 1;
+    node->range.buffer = h->name;
+    node->range.offset = (GLintptr) node->offset * ALIGNMENT;
+
+    return node;
+}
+
+int
+bufinit(size_t size)
+{
+    bufterm();
+    size = (size + ALIGNMENT - 1) / ALIGNMENT;
+    heapsize = size && size < 1u << 31 ? (unsigned int) size : 1u << 30;
+
+    return 1;
+}
+
+const BufferRange *
+bufalloc(size_t size, const void *data)
+{
+    Node *node = NULL;
+    size_t units = (size ? size : 1) + ALIGNMENT - 1;
+    unsigned int i;
+
+    units /= ALIGNMENT;
+    if (units >= 1u << 31)
+	return NULL;
+    for (i = 0; i < heapcount && !node; i++)
+	node = take(heaps[i], (unsigned int) units);
+    if (!node) {
+	if (heapcount == BUFFERMAX || !(heaps[heapcount] = newheap(units >
+			heapsize ? (unsigned int) units : heapsize)))
+	    return NULL;
+	node = take(heaps[heapcount++], (unsigned int) units);
+    }
+    node->range.size = size;
+    if (data)
+	glNamedBufferSubData(node->range.buffer, node->range.offset, size,
+		data);
+
+    return &node->range;
+}
+
+void
+buffree(const BufferRange *range)
+{
+    Node *node = (Node *) range;
+    Heap *h;
+    unsigned int n, m;
+
+    if (!range)
+	return;
+    h = heaps[node->heap];
+    n = (unsigned int) (node - h->nodes);
+
+    /* Merge with free neighbours, the node left over goes back spare */
+    if ((m = node->next) != NIL && !h->nodes[m].used) {
+	removefree(h, m);
+	node->size += h->nodes[m].size;
+	node->next = h->nodes[m].next;
+	if (node->next != NIL)
+	    h->nodes[node->next].prev = n;
+	h->spare[h->sparecount++] = m;
+    }
+    if ((m = node->prev) != NIL && !h->nodes[m].used) {
+	removefree(h, m);
+	h->nodes[m].size += node->size;
+	h->nodes[m].next = node->next;
+	if (node->next != NIL)
+	    h->nodes[node->next].prev = m;
+	h->spare[h->sparecount++] = n;
+	n = m;
+    }
+    addfree(h, n);
+}
+
+void
+move(GLuint name, size_t from, size_t to, size_t size)
+{
+    size_t gap = from - to, done, step;
+
+    /* Copies within a buffer must not overlap, so go a gap at a time */
+    for (done = 0; done < size; done += step) {
+	step = size - done < gap ? size - done : gap;
+	glCopyNamedBufferSubData(name, name, from + done, to + done, step);
+    }
+}
+
+size_t
+compact(Heap *h)
+{
+    unsigned int n, next, last = NIL, offset = 0, t;
+    size_t moved = 0;
+    Node *node;
+
+    for (n = h->first; n != NIL; n = next) {
+	node = &h->nodes[n];
+	next = node->next;
+	if (!node->used) {
+	    removefree(h, n);
+	    h->spare[h->sparecount++] = n;
+	    continue;
+	}
+	if (node->offset != offset) {
+	    move(h->name, (size_t) node->offset * ALIGNMENT,
+		    (size_t) offset * ALIGNMENT,
+		    (size_t) node->size * ALIGNMENT);
+	    moved += (size_t) node->size * ALIGNMENT;
+	    node->offset = offset;
+	    node->range.offset = (GLintptr) offset * ALIGNMENT;
+	}
+	node->prev = last;
+	if (last != NIL)
+	    h->nodes[last].next = n;
+	else
+	    h->first = n;
+	last = n;
+	offset += node->size;
+    }
+
+    /* What is left is one free range at the end, there is a spare node
+     * since at least one free node was given back if anything moved */
+    if (offset < h->size && (t = newnode(h)) != NIL) {
+	node = &h->nodes[t];
+	node->offset = offset;
+	node->size = h->size - offset;
+	node->prev = last;
+	node->next = NIL;
+	node->heap = h->index;
+	if (last != NIL)
+	    h->nodes[last].next = t;
+	else
+	    h->first = t;
+	addfree(h, t);
+    } else if (last != NIL) {
+	h->nodes[last].next = NIL;
+    }
+
+    return moved;
+}
+
+size_t
+bufdefrag(void)
+{
+    size_t moved = 0;
+    unsigned int i;
+
+    for (i = 0; i < heapcount; i++)
+	moved += compact(heaps[i]);
+
+    return moved;
+}
+
+void
+bufstats(BufferStats *stats)
+{
+    const Heap *h;
+    const Node *node;
+    size_t avail = 0, size;
+    unsigned int i, n;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->buffers = heapcount;
+    for (i = 0; i < heapcount; i++) {
+	h = heaps[i];
+	stats->capacity += (size_t) h->size * ALIGNMENT;
+	for (n = h->first; n != NIL; n = node->next) {
+	    node = &h->nodes[n];
+	    size = (size_t) node->size * ALIGNMENT;
+	    if (node->used) {
+		stats->ranges++;
+		stats->used += size;
+		continue;
+	    }
+	    stats->freeranges++;
+	    avail += size;
+	    if (size > stats->largestfree)
+		stats->largestfree = size;
+	}
+    }
+    stats->fragmentation = avail ? 1.0 - (double) stats->largestfree /
+	avail : 0.0;
+}
+
+void
+bufterm(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < heapcount; i++) {
+	vramuntrack(GL_BUFFER, heaps[i]->name);
+	glDeleteBuffers(1, &heaps[i]->name);
+	free(heaps[i]->nodes);
+	free(heaps[i]->spare);
+	free(heaps[i]);
+	heaps[i] = NULL;
+    }
+    heapcount = 0;
+}
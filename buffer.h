@@ -0,0 +1,36 @@
+/* GPU buffer sub-allocation.
+ *
+ * Meshes, index ranges and uniform blocks are carved out of a few large
+ * immutable buffers instead of a buffer object each. Every buffer has a
+ * TLSF style offset allocator: free ranges sit in bins of 8 per power of
+ * two with a bitmap over them, so bufalloc() and buffree() take constant
+ * time and free ranges merge with their neighbours. bufinit() sets the size
+ * of the buffers, which are made as they are needed, a range bigger than
+ * that getting a buffer of its own. Ranges are 256 byte aligned, enough for
+ * any binding. bufalloc() uploads data unless it is NULL and returns NULL
+ * when there is no room or memory. The range stays where it is until
+ * bufdefrag() slides every range down to close the gaps, copying on the
+ * GPU, and returns the bytes moved. Anything that saved an offset or set
+ * one in a VAO has to fetch it again after that. bufstats() sums up usage
+ * and fragmentation. */
+
+typedef struct {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;    /* As asked for, the range may be bigger */
+} BufferRange;
+
+typedef struct {
+    unsigned int buffers, ranges;
+    unsigned int freeranges;
+    size_t capacity, used;  /* Bytes */
+    size_t largestfree;
+    double fragmentation;   /* 1 - largest free range / free bytes */
+} BufferStats;
+
+int bufinit(size_t size);
+const BufferRange *bufalloc(size_t size, const void *data);
+void buffree(const BufferRange *range);
+size_t bufdefrag(void);
+void bufstats(BufferStats *stats);
+void bufterm(void);
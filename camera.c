@@ -0,0 +1,165 @@
+#include <math.h>
+#include <string.h>
+
+#include "camera.h"
+
+/* Function prototypes */
+static void normalise(float v[3]);
+static void cross(float r[3], const float a[3], const float b[3]);
+static float dot(const float a[3], const float b[3]);
+
+/* Function implementations */
+
+void
+normalise(float v[3])
+{
+    float l = sqrtf(dot(v, v));
+
+    if (l > 0.0f) {
+	v[0] /= l;
+	v[1] /= l;
+	v[2] /= l;
+    }
+}
+
+void
+cross(float r[3], const float a[3], const float b[3])
+{
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+float
+dot(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+void
+matmul(float r[16], const float a[16], const float b[16])
+{
+    float t[16];
+    int i, j, k;
+
+    for (j = 0; j < 4; j++) {
+	for (i = 0; i < 4; i++) {
+	    t[j * 4 + i] = 0.0f;
+	    for (k = 0; k < 4; k++)
+		t[j * 4 + i] += a[k * 4 + i] * b[j * 4 + k];
+	}
+    }
+    memcpy(r, t, sizeof(t));
+}
+
+void
+cameramatrix(const Camera *c, float aspect, float m[16])
+{
+    float view[16], proj[16], f[3], s[3], u[3];
+    float n = c->near, fa = c->far, h, w;
+    int i;
+
+    for (i = 0; i < 3; i++)
+	f[i] = c->target[i] - c->eye[i];
+    normalise(f);
+    cross(s, f, c->up);
+    normalise(s);
+    cross(u, s, f);
+
+    memset(view, 0, sizeof(view));
+    for (i = 0; i < 3; i++) {
+	view[i * 4 + 0] = s[i];
+	view[i * 4 + 1] = u[i];
+	view[i * 4 + 2] = -f[i];
+    }
+    view[12] = -dot(s, c->eye);
+    view[13] = -dot(u, c->eye);
+    view[14] = dot(f, c->eye);
+    view[15] = 1.0f;
+
+    memset(proj, 0, sizeof(proj));
+    if (c->fovy > 0.0f) {
+	h = 1.0f / tanf(c->fovy * 0.5f);
+	proj[0] = h / aspect;
+	proj[5] = h;
+	proj[10] = (fa + n) / (n - fa);
+	proj[11] = -1.0f;
+	proj[14] = 2.0f * fa * n / (n - fa);
+    } else {
+	h = c->height;
+	w = h * aspect;
+	proj[0] = 1.0f / w;
+	proj[5] = 1.0f / h;
+	proj[10] = -2.0f / (fa - n);
+	proj[14] = -(fa + n) / (fa - n);
+	proj[15] = 1.0f;
+    }
+
+    matmul(m, proj, view);
+}
+
+void
+cameraplanes(const float m[16], float planes[6][4])
+{
+    float l;
+    int i, j;
+
+    /* Gribb and Hartmann, row 3 plus or minus rows 0, 1 and 2 */
+    for (i = 0; i < 6; i++) {
+	for (j = 0; j < 4; j++)
+	    planes[i][j] = m[j * 4 + 3] +
+		(i & 1 ? -m[j * 4 + i / 2] : m[j * 4 + i / 2]);
+	l = sqrtf(dot(planes[i], planes[i]));
+	for (j = 0; j < 4; j++)
+	    planes[i][j] /= l;
+    }
+}
+
+void
+cameraeye(const Camera *c, float eye[4])
+{
+    int i;
+
+    /* Every view ray is parallel in an orthographic camera */
+    for (i = 0; i < 3; i++)
+	eye[i] = c->fovy > 0.0f ? c->eye[i] : c->target[i] - c->eye[i];
+    if (c->fovy > 0.0f) {
+	eye[3] = 1.0f;
+	return;
+    }
+    normalise(eye);
+    eye[3] = 0.0f;
+}
+
+void
+camerapan(Camera *c, float dx, float dy)
+{
+    float f[3], s[3], u[3], scale;
+    int i;
+
+    for (i = 0; i < 3; i++)
+	f[i] = c->target[i] - c->eye[i];
+    scale = c->fovy > 0.0f ? sqrtf(dot(f, f)) : c->height;
+    normalise(f);
+    cross(s, f, c->up);
+    normalise(s);
+    cross(u, s, f);
+    for (i = 0; i < 3; i++) {
+	c->eye[i] += (s[i] * dx + u[i] * dy) * scale;
+	c->target[i] += (s[i] * dx + u[i] * dy) * scale;
+    }
+}
+
+void
+camerazoom(Camera *c, float factor)
+{
+    int i;
+
+    /* Orthographic shrinks the view, perspective moves the eye in */
+    if (c->fovy <= 0.0f) {
+	c->height /= factor;
+	return;
+    }
+    for (i = 0; i < 3; i++)
+	c->eye[i] = c->target[i] + (c->eye[i] - c->target[i]) / factor;
+}
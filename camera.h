@@ -0,0 +1,20 @@
+/* Look-at camera, perspective or orthographic.
+ *
+ * Matrices are column-major as OpenGL expects. With fovy zero the camera is
+ * orthographic, height being half the height of the view volume.
+ * cameraeye() gives the position, w 1, or for an orthographic camera the
+ * view direction, w 0. */
+
+typedef struct {
+    float eye[3], target[3], up[3];
+    float fovy;         /* Radians, zero for orthographic */
+    float height;       /* Orthographic half height */
+    float near, far;
+} Camera;
+
+void cameramatrix(const Camera *c, float aspect, float m[16]);
+void cameraplanes(const float m[16], float planes[6][4]);
+void cameraeye(const Camera *c, float eye[4]);
+void camerapan(Camera *c, float dx, float dy);
+void camerazoom(Camera *c, float factor);
+void matmul(float r[16], const float a[16], const float b[16]);
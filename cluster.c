@@ -0,0 +1,195 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "glad.h"
+#include "scene.h"
+#include "cluster.h"
+#include "pull.h"
+#include "vram.h"
+
+/* Macros */
+#define GROUPSIZE  64    /* Must match local_size_x in cluster.glsl */
+#define GROUPMAX   65535 /* Least GL_MAX_COMPUTE_WORK_GROUP_COUNT */
+#define RINGFRAMES 3     /* Frames before a visible count is read back */
+
+/* Types */
+typedef struct {
+    GLuint count;
+    GLuint instancecount;
+    GLuint firstindex;
+    GLint basevertex;
+    GLuint baseinstance;
+} DrawElementsCommand;
+
+/* Variables */
+static GLuint meshletbuffer, rangebuffer, commandbuffer, drawbuffer, counter,
+	      readback;
+static const uint32_t *counts;
+static GLsync fences[RINGFRAMES];
+static unsigned int frame, visible, capacity;
+
+/* Function implementations */
+
+int
+clusterinit(const Scene *scene)
+{
+    const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT |
+	GL_MAP_COHERENT_BIT;
+    const Mesh *m;
+    Meshlet *meshlets, *l;
+    uint32_t *ranges;
+    unsigned int i, j, total = 0;
+
+    for (i = 0; i < scene->meshcount; i++)
+	total += scene->meshes[i].meshletcount;
+    meshlets = (Meshlet *) malloc((total ? total : 1) * sizeof(Meshlet));
+    ranges = (uint32_t *) malloc((scene->meshcount ? scene->meshcount : 1) *
+	    2 * sizeof(uint32_t));
+    if (!meshlets || !ranges) {
+	free(meshlets);
+	free(ranges);
+	return 0;
+    }
+
+    /* One array for the scene, first made relative to the shared element
+     * buffer so a command can use it as is */
+    for (i = 0, l = meshlets; i < scene->meshcount; i++) {
+	m = &scene->meshes[i];
+	ranges[i * 2] = (uint32_t) (l - meshlets);
+	ranges[i * 2 + 1] = m->meshletcount;
+	for (j = 0; j < m->meshletcount; j++, l++) {
+	    *l = m->meshlets[j];
+	    l->first += pullfirst(i);
+	}
+    }
+    for (i = 0, capacity = 0; i < scene->objectcount; i++)
+	capacity += scene->meshes[scene->objects[i].mesh].meshletcount;
+
+    glCreateBuffers(1, &meshletbuffer);
+    glNamedBufferStorage(meshletbuffer, (total ? total : 1) *
+	    sizeof(Meshlet), meshlets, 0);
+    vramtrack(GL_BUFFER, meshletbuffer, VRAMSTORAGE, (total ? total : 1) *
+	    sizeof(Meshlet), "cluster");
+    glCreateBuffers(1, &rangebuffer);
+    glNamedBufferStorage(rangebuffer, (scene->meshcount ? scene->meshcount :
+		1) * 2 * sizeof(uint32_t), ranges, 0);
+    vramtrack(GL_BUFFER, rangebuffer, VRAMSTORAGE, (scene->meshcount ?
+		scene->meshcount : 1) * 2 * sizeof(uint32_t), "cluster");
+    free(meshlets);
+    free(ranges);
+
+    glCreateBuffers(1, &commandbuffer);
+    glNamedBufferStorage(commandbuffer, (capacity ? capacity : 1) *
+	    sizeof(DrawElementsCommand), NULL, 0);
+    vramtrack(GL_BUFFER, commandbuffer, VRAMINDIRECT, (capacity ? capacity :
+		1) * sizeof(DrawElementsCommand), "cluster");
+    glCreateBuffers(1, &drawbuffer);
+    glNamedBufferStorage(drawbuffer, (capacity ? capacity : 1) *
+	    sizeof(uint32_t), NULL, 0);
+    vramtrack(GL_BUFFER, drawbuffer, VRAMSTORAGE, (capacity ? capacity : 1) *
+	    sizeof(uint32_t), "cluster");
+    glCreateBuffers(1, &counter);
+    glNamedBufferStorage(counter, sizeof(uint32_t), NULL,
+	    GL_DYNAMIC_STORAGE_BIT);
+    vramtrack(GL_BUFFER, counter, VRAMINDIRECT, sizeof(uint32_t), "cluster");
+    glCreateBuffers(1, &readback);
+    glNamedBufferStorage(readback, RINGFRAMES * sizeof(uint32_t), NULL, flags);
+    vramtrack(GL_BUFFER, readback, VRAMSTAGING, RINGFRAMES * sizeof(uint32_t),
+	    "cluster");
+    counts = (const uint32_t *) glMapNamedBufferRange(readback, 0,
+	    RINGFRAMES * sizeof(uint32_t), flags);
+
+    return counts != NULL;
+}
+
+void
+clusterrun(GLuint program, unsigned int objectcount)
+{
+    static const uint32_t zero = 0;
+    GLuint columns;
+    GLenum status;
+
+    /* Pick up the count from RINGFRAMES ago if it has landed */
+    if (fences[frame]) {
+	status = glClientWaitSync(fences[frame], 0, 0);
+	if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+	    visible = counts[frame];
+	glDeleteSync(fences[frame]);
+	fences[frame] = NULL;
+    }
+
+    glNamedBufferSubData(counter, 0, sizeof(zero), &zero);
+    glUseProgram(program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, drawbuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, commandbuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, counter);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, meshletbuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, rangebuffer);
+    /* A workgroup per object, folded into rows past the dispatch limit */
+    if (objectcount) {
+	columns = objectcount < GROUPMAX ? objectcount : GROUPMAX;
+	glDispatchCompute(columns, (objectcount + columns - 1) / columns, 1);
+    }
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT |
+	    GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glCopyNamedBufferSubData(counter, readback, 0,
+	    frame * sizeof(uint32_t), sizeof(uint32_t));
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame = (frame + 1) % RINGFRAMES;
+}
+
+void
+clusterdraw(void)
+{
+    glEnable(GL_CULL_FACE);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandbuffer);
+    glBindBuffer(GL_PARAMETER_BUFFER, counter);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, drawbuffer);
+    glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT,
+	    (const void *) 0, 0, capacity, 0);
+    glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glDisable(GL_CULL_FACE);
+}
+
+unsigned int
+clustervisible(void)
+{
+    return visible;
+}
+
+unsigned int
+clustercount(void)
+{
+    return capacity;
+}
+
+void
+clusterterm(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < RINGFRAMES; i++) {
+	if (fences[i])
+	    glDeleteSync(fences[i]);
+	fences[i] = NULL;
+    }
+    vramuntrack(GL_BUFFER, meshletbuffer);
+    vramuntrack(GL_BUFFER, rangebuffer);
+    vramuntrack(GL_BUFFER, commandbuffer);
+    vramuntrack(GL_BUFFER, drawbuffer);
+    vramuntrack(GL_BUFFER, counter);
+    vramuntrack(GL_BUFFER, readback);
+    glDeleteBuffers(1, &meshletbuffer);
+    glDeleteBuffers(1, &rangebuffer);
+    glDeleteBuffers(1, &commandbuffer);
+    glDeleteBuffers(1, &drawbuffer);
+    glDeleteBuffers(1, &counter);
+    glDeleteBuffers(1, &readback);
+    meshletbuffer = rangebuffer = commandbuffer = drawbuffer = counter =
+	readback = 0;
+    counts = NULL;
+}
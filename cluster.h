@@ -0,0 +1,17 @@
+/* GPU meshlet culling.
+ *
+ * cluster.glsl runs a workgroup per object. Objects whose sphere is in the
+ * frustum have their meshlets tested one per invocation: against the
+ * frustum, the depth pyramid as in cull.h, and their normal cone, which
+ * rejects a meshlet when every triangle in it faces away from the camera.
+ * The survivors are appended as indirect commands drawing just their run
+ * of indices through vertexpull.glsl, with back faces culled to match.
+ * clustercount() is the number of meshlets in the scene, which bounds the
+ * commands. Requires scene.h. */
+
+int clusterinit(const Scene *scene);
+void clusterrun(GLuint program, unsigned int objectcount);
+void clusterdraw(void);
+unsigned int clustervisible(void);
+unsigned int clustercount(void);
+void clusterterm(void);
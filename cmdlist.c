@@ -0,0 +1,229 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad.h"
+#include "arena.h"
+#include "cmdlist.h"
+#include "job.h"
+
+/* Macros */
+#define LISTMIN 1024    /* Commands a list starts with */
+#define DIGITS  12      /* 8 bit digits, 4 of seq then 8 of key */
+#define FIELD(v, bits) ((unsigned long long) (v) & ((1ULL << (bits)) - 1))
+
+/* Types */
+typedef struct {
+    unsigned long long key;
+    unsigned int seq, index;
+} SortItem;             /* A command to sort, a third of its size */
+
+/* Function prototypes */
+static int reserve(DrawCommand **commands, unsigned int *size,
+	unsigned int count);
+static unsigned int digit(const SortItem *item, unsigned int d);
+static SortItem *sort(SortItem *items, SortItem *spare, unsigned int n);
+
+/* Variables */
+static CommandList *lists;
+static unsigned int listcount;
+static CommandStats last;
+
+/* Function implementations */
+
+int
+reserve(DrawCommand **commands, unsigned int *size, unsigned int count)
+{
+    DrawCommand *grown;
+    unsigned int n;
+
+    if (count <= *size)
+	return 1;
+    for (n = *size ? *size : LISTMIN; n < count; n *= 2)
+	;
+    if (!(grown = (DrawCommand *) realloc(*commands,
+		    n * sizeof(DrawCommand))))
+	return 0;
+    *commands = grown;
+    *size = n;
+
+    return 1;
+}
+
+unsigned int
+digit(const SortItem *item, unsigned int d)
+{
+    return d < 4 ? item->seq >> d * 8 & 0xff :
+	(unsigned int) (item->key >> (d - 4) * 8) & 0xff;
+}
+
+SortItem *
+sort(SortItem *items, SortItem *spare, unsigned int n)
+{
+    static unsigned int counts[DIGITS][256];
+    SortItem *src = items, *dst = spare, *t;
+    unsigned int i, d, sum, c;
+
+    /* One pass counts every digit, digits all items share are skipped,
+     * which leaves about two passes for seq and whatever the key uses */
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < n; i++)
+	for (d = 0; d < DIGITS; d++)
+	    counts[d][digit(&items[i], d)]++;
+
+    /* Least significant first, each pass stable, so seq breaks key ties */
+    for (d = 0; d < DIGITS; d++) {
+	if (counts[d][digit(&items[0], d)] == n)
+	    continue;
+	for (i = 0, sum = 0; i < 256; i++) {
+	    c = counts[d][i];
+	    counts[d][i] = sum;
+	    sum += c;
+	}
+	for (i = 0; i < n; i++)
+	    dst[counts[d][digit(&src[i], d)]++] = src[i];
+	t = src;
+	src = dst;
+	dst = t;
+    }
+
+    return src;
+}
+
+int
+cmdinit(void)
+{
+    cmdterm();
+    listcount = jobthreads();
+    if (!(lists = (CommandList *) calloc(listcount, sizeof(CommandList))))
+	return 0;
+
+    return 1;
+}
+
+unsigned long long
+cmdkey(unsigned int pass, unsigned int program, unsigned int texture,
+	unsigned int vao, float depth)
+{
+    unsigned int bits;
+
+    /* The bits of a positive float sort like the float, keep the top ones */
+    memcpy(&bits, &depth, sizeof(bits));
+    bits = depth > 0.0f ? bits >> (32 - CMDDEPTHBITS) : 0;
+
+    return FIELD(pass, CMDPASSBITS) << (64 - CMDPASSBITS) |
+	FIELD(program, CMDPROGRAMBITS) << (CMDTEXTUREBITS + CMDVAOBITS +
+		CMDDEPTHBITS) |
+	FIELD(texture, CMDTEXTUREBITS) << (CMDVAOBITS + CMDDEPTHBITS) |
+	FIELD(vao, CMDVAOBITS) << CMDDEPTHBITS |
+	FIELD(bits, CMDDEPTHBITS);
+}
+
+CommandList *
+cmdlist(void)
+{
+    int i = jobself();
+
+    /* Threads outside the pool share the main thread's list */
+    return &lists[i > 0 && (unsigned int) i < listcount ? i : 0];
+}
+
+int
+cmdpush(CommandList *list, const DrawCommand *command)
+{
+    if (!reserve(&list->commands, &list->size, list->count + 1))
+	return 0;
+    list->commands[list->count++] = *command;
+
+    return 1;
+}
+
+void
+cmdreset(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < listcount; i++)
+	lists[i].count = 0;
+}
+
+unsigned int
+cmdsubmit(Arena *scratch)
+{
+    const DrawCommand *c, *prev = NULL;
+    DrawCommand *merged;
+    SortItem *items, *spare, *sorted;
+    unsigned int i, n;
+
+    memset(&last, 0, sizeof(last));
+    for (i = 0, n = 0; i < listcount; i++)
+	n += lists[i].count;
+    if (!n || !(merged = (DrawCommand *) arenaalloc(scratch, n *
+		    sizeof(DrawCommand))) ||
+	    !(items = (SortItem *) arenaalloc(scratch, 2 * (size_t) n *
+		    sizeof(SortItem))))
+	return 0;
+    spare = items + n;
+    for (i = 0, n = 0; i < listcount; i++) {
+	memcpy(merged + n, lists[i].commands, lists[i].count *
+		sizeof(DrawCommand));
+	n += lists[i].count;
+    }
+    for (i = 0; i < n; i++) {
+	items[i].key = merged[i].key;
+	items[i].seq = merged[i].seq;
+	items[i].index = i;
+    }
+    sorted = sort(items, spare, n);
+
+    for (i = 0; i < n; i++) {
+	c = &merged[sorted[i].index];
+	if (!prev || c->program != prev->program) {
+	    glUseProgram(c->program);
+	    last.programs++;
+	}
+	if (!prev || c->vao != prev->vao) {
+	    glBindVertexArray(c->vao);
+	    last.vaos++;
+	}
+	if (c->texture && (!prev || c->texture != prev->texture)) {
+	    glBindTextureUnit(0, c->texture);
+	    last.textures++;
+	}
+	if (c->buffer && (!prev || c->buffer != prev->buffer ||
+		    c->offset != prev->offset || c->size != prev->size)) {
+	    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CMDBINDING, c->buffer,
+		    c->offset, c->size);
+	    last.ranges++;
+	}
+	if (c->uniformcount) {
+	    glProgramUniform4uiv(c->program, 0, c->uniformcount, c->uniforms);
+	    last.uniforms++;
+	}
+	glDrawElementsInstancedBaseInstance(GL_TRIANGLES, c->count,
+		GL_UNSIGNED_INT, (const void *) ((size_t) c->first *
+		    sizeof(GLuint)), c->instancecount, c->baseinstance);
+	prev = c;
+    }
+    last.draws = n;
+
+    return n;
+}
+
+void
+cmdstats(CommandStats *stats)
+{
+    *stats = last;
+}
+
+void
+cmdterm(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < listcount; i++)
+	free(lists[i].commands);
+    free(lists);
+    lists = NULL;
+    listcount = 0;
+}
@@ -0,0 +1,59 @@
+/* Command lists.
+ *
+ * Draws are recorded as plain records, one list per thread of job.h, so
+ * jobs can record in parallel without locks. cmdinit() makes the lists and
+ * must follow jobinit(). cmdlist() gives the calling thread's list,
+ * cmdpush() appends to it, growing it as needed, and returns 0 when out of
+ * memory. cmdkey() packs a sort key from the pass, program, texture, vertex
+ * array and view depth, most significant first, so sorted draws switch
+ * programs least often and draw near to far within the same state. Ids too
+ * big for their field only cost state changes, never correctness. On the GL
+ * thread cmdsubmit() merges the lists in scratch memory, radix sorts the
+ * draws by key and then by seq, and replays them in one pass, only binding
+ * what changes. Seq must be unique, so the order never depends on which
+ * thread recorded what. A draw may carry its own data, a buffer range bound
+ * to storage binding CMDBINDING or uvec4 uniforms set from location 0 of
+ * its program. It returns the draws made and cmdstats() counts the state
+ * changes they took. cmdreset() empties the lists for the next frame,
+ * keeping their memory. Requires arena.h. */
+
+#define CMDPASSBITS    4
+#define CMDPROGRAMBITS 10
+#define CMDTEXTUREBITS 12
+#define CMDVAOBITS     14
+#define CMDDEPTHBITS   24
+#define CMDBINDING     1
+
+typedef struct {
+    unsigned long long key; /* Sorted on first */
+    unsigned int seq;       /* Then on this, the submission order */
+    unsigned int program, vao;
+    unsigned int texture;   /* Bound to unit 0, 0 leaves the unit alone */
+    unsigned int count, first; /* Indices */
+    unsigned int instancecount, baseinstance;
+    unsigned int buffer;    /* 0 for no range of its own */
+    unsigned int offset, size; /* Bytes */
+    unsigned int uniformcount; /* uvec4s */
+    const unsigned int *uniforms;
+} DrawCommand;
+
+typedef struct {
+    DrawCommand *commands;
+    unsigned int count, size;
+} CommandList;
+
+typedef struct {
+    unsigned int draws;
+    unsigned int programs, vaos, textures; /* Binds made */
+    unsigned int ranges, uniforms;
+} CommandStats;
+
+int cmdinit(void);
+CommandList *cmdlist(void);
+unsigned long long cmdkey(unsigned int pass, unsigned int program,
+	unsigned int texture, unsigned int vao, float depth);
+int cmdpush(CommandList *list, const DrawCommand *command);
+void cmdreset(void);
+unsigned int cmdsubmit(Arena *scratch);
+void cmdstats(CommandStats *stats);
+void cmdterm(void);
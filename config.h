@@ -6,5 +6,92 @@ static const unsigned int openglmajor = 4;
 static const unsigned int openglminor = 6;
 
 static const char vertexspirv[]   = "shaders/vertex.spv";
+static const char vertexpullspirv[] = "shaders/vertexpull.spv";
 static const char fragmentspirv[] = "shaders/fragment.spv";
+static const char overdrawspirv[]   = "shaders/overdraw.spv";
+static const char fullscreenspirv[] = "shaders/fullscreen.spv";
+static const char heatmapspirv[]    = "shaders/heatmap.spv";
+static const char cullspirv[]       = "shaders/cull.spv";
+static const char clusterspirv[]    = "shaders/cluster.spv";
+static const char hizspirv[]        = "shaders/hiz.spv";
 static const char shaderentry[]   = "main";
+
+/* Chrome trace written at exit, empty to disable */
+static const char tracefile[] = "trace.json";
+
+/* Threads preparing each frame, the main thread included, 0 for one per
+ * CPU */
+static const unsigned int framethreads = 0;
+
+/* Objects per job when recording the attribute path's draws */
+static const unsigned int recordgrain = 1024;
+
+/* First block of the arenas for each frame's scratch and for loading, they
+ * grow as needed. Frames after allocwarmup assert they made no heap
+ * allocations when built with ALLOCCOUNT. */
+static const size_t framearenasize = 1 << 20;
+static const size_t loadarenasize  = 1 << 20;
+static const unsigned int allocwarmup = 60;
+
+/* Bytes in each of the buffers meshes and uniform blocks are carved from */
+static const size_t buffersize = 64 << 20;
+
+/* Bytes of per-draw data a frame for the ring and range paths */
+static const size_t ringsize = 16 << 20;
+
+/* GPU memory budget in bytes, 0 for none. Going over it warns and the
+ * streaming pool shrinks to fit. -s reports the totals at exit. */
+static const size_t vrambudget = 0;
+
+/* Seconds between statistics reports with -s */
+static const double statsinterval = 1.0;
+
+/* First mesh of the scene, made by meshconv, -m overrides and also takes
+ * OBJ and PLY files, imported by this many threads, 0 for one per CPU */
+static const char meshfile[] = "meshes/triangle.mesh";
+static const unsigned int importthreads = 0;
+
+/* Scene, -n overrides the object count */
+static const unsigned int objectcount = 1;
+static const unsigned int meshcount   = 64;
+/* Rings of vertices per polygon, more give larger meshes */
+static const unsigned int polygonrings = 1;
+/* Reorder meshes for the vertex cache, overdraw and fetch at load */
+static const int meshoptimise = 1;
+/* Objects stacked per grid cell, -l overrides, one draws the flat grid */
+static const unsigned int layercount  = 1;
+
+/* Levels of detail on the cull path: the most an object's simplification
+ * may show on screen in pixels, 0 for full detail, and how far below that
+ * it must fall before a coarser level is picked */
+static const float lodthreshold  = 1.0f;
+static const float lodhysteresis = 0.25f;
+
+/* Vertex formats, see vformat.h. The position format is shared with the
+ * vertex pulling buffer. */
+static const VertexFormat vertexformat = {
+    FORMATSNORM16, FORMATPACKED, FORMATUNORM16
+};
+/* Specialise the vertex pulling shaders to that position format when they
+ * are loaded, 0 to switch on each mesh's format as they run */
+static const int specialisepositions = 1;
+
+/* Pool slots for the chunks of a mesh streamed with -S, each up to 8192
+ * vertices and triangles, and the bytes copied into it per frame */
+static const unsigned int streamslots = 256;
+static const size_t streambudget = 4 << 20;
+
+/* Frames per draw path with -b, measured after the warm up */
+static const unsigned int benchwarmup = 60;
+static const unsigned int benchframes = 600;
+
+/* Vertices converted per kernel with -q */
+static const size_t quantvertices = 4000000;
+
+/* Threads drawing the -c image on the CPU, 0 for one per CPU, -b with -c
+ * times every kernel and thread count instead */
+static const unsigned int rasterthreads = 0;
+
+/* Arrow keys pan by a fraction of the view, = and - zoom */
+static const float panstep  = 0.1f;
+static const float zoomstep = 1.25f;
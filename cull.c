@@ -0,0 +1,178 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "glad.h"
+#include "scene.h"
+#include "cull.h"
+#include "pull.h"
+#include "vram.h"
+
+/* Macros */
+#define GROUPSIZE  64 /* Must match local_size_x in cull.glsl */
+#define RINGFRAMES 3  /* Frames before a visible count is read back */
+
+/* Types */
+typedef struct {
+    GLuint count;
+    GLuint instancecount;
+    GLuint firstindex;
+    GLint basevertex;
+    GLuint baseinstance;
+} DrawElementsCommand;
+
+/* Variables */
+static GLuint commandbuffer, drawbuffer, counter, readback, lodbuffer,
+	      levelbuffer;
+static const uint32_t *counts;  /* Visible objects and triangles a frame */
+static GLsync fences[RINGFRAMES];
+static unsigned int frame, visible, triangles;
+
+/* Function implementations */
+
+int
+cullinit(const Scene *scene)
+{
+    const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT |
+	GL_MAP_COHERENT_BIT;
+    const unsigned int objectcount = scene->objectcount;
+    Lod *lods;
+    unsigned int i, j;
+
+    /* LODMAX levels a mesh, the unused ones empty, made relative to the
+     * shared element buffer */
+    if (!(lods = (Lod *) calloc((scene->meshcount ? scene->meshcount : 1) *
+		    LODMAX, sizeof(Lod))))
+	return 0;
+    for (i = 0; i < scene->meshcount; i++) {
+	for (j = 0; j < scene->meshes[i].lodcount; j++) {
+	    lods[i * LODMAX + j] = scene->meshes[i].lods[j];
+	    lods[i * LODMAX + j].first += pullfirst(i);
+	}
+    }
+    glCreateBuffers(1, &lodbuffer);
+    glNamedBufferStorage(lodbuffer, (scene->meshcount ? scene->meshcount :
+		1) * LODMAX * sizeof(Lod), lods, 0);
+    vramtrack(GL_BUFFER, lodbuffer, VRAMSTORAGE, (scene->meshcount ?
+		scene->meshcount : 1) * LODMAX * sizeof(Lod), "cull");
+    free(lods);
+    /* The level each object drew last, all start at full detail */
+    glCreateBuffers(1, &levelbuffer);
+    glNamedBufferStorage(levelbuffer, (objectcount ? objectcount : 1) *
+	    sizeof(uint32_t), NULL, GL_DYNAMIC_STORAGE_BIT);
+    vramtrack(GL_BUFFER, levelbuffer, VRAMSTORAGE, (objectcount ?
+		objectcount : 1) * sizeof(uint32_t), "cull");
+    glClearNamedBufferData(levelbuffer, GL_R32UI, GL_RED_INTEGER,
+	    GL_UNSIGNED_INT, NULL);
+
+    glCreateBuffers(1, &commandbuffer);
+    glNamedBufferStorage(commandbuffer,
+	    objectcount * sizeof(DrawElementsCommand), NULL, 0);
+    vramtrack(GL_BUFFER, commandbuffer, VRAMINDIRECT,
+	    objectcount * sizeof(DrawElementsCommand), "cull");
+    glCreateBuffers(1, &drawbuffer);
+    glNamedBufferStorage(drawbuffer, objectcount * sizeof(uint32_t), NULL, 0);
+    vramtrack(GL_BUFFER, drawbuffer, VRAMSTORAGE,
+	    objectcount * sizeof(uint32_t), "cull");
+    glCreateBuffers(1, &counter);
+    glNamedBufferStorage(counter, 2 * sizeof(uint32_t), NULL,
+	    GL_DYNAMIC_STORAGE_BIT);
+    vramtrack(GL_BUFFER, counter, VRAMINDIRECT, 2 * sizeof(uint32_t),
+	    "cull");
+    glCreateBuffers(1, &readback);
+    glNamedBufferStorage(readback, RINGFRAMES * 2 * sizeof(uint32_t), NULL,
+	    flags);
+    vramtrack(GL_BUFFER, readback, VRAMSTAGING,
+	    RINGFRAMES * 2 * sizeof(uint32_t), "cull");
+    counts = (const uint32_t *) glMapNamedBufferRange(readback, 0,
+	    RINGFRAMES * 2 * sizeof(uint32_t), flags);
+
+    return counts != NULL;
+}
+
+void
+cullrun(GLuint program, unsigned int objectcount)
+{
+    static const uint32_t zero[2];
+    GLenum status;
+
+    /* Pick up the counts from RINGFRAMES ago if they have landed */
+    if (fences[frame]) {
+	status = glClientWaitSync(fences[frame], 0, 0);
+	if (status == GL_ALREADY_SIGNALED ||
+		status == GL_CONDITION_SATISFIED) {
+	    visible = counts[frame * 2];
+	    triangles = counts[frame * 2 + 1];
+	}
+	glDeleteSync(fences[frame]);
+	fences[frame] = NULL;
+    }
+
+    glNamedBufferSubData(counter, 0, sizeof(zero), zero);
+    glUseProgram(program);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, drawbuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, commandbuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, counter);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, lodbuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, levelbuffer);
+    glDispatchCompute((objectcount + GROUPSIZE - 1) / GROUPSIZE, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT |
+	    GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    glCopyNamedBufferSubData(counter, readback, 0,
+	    frame * 2 * sizeof(uint32_t), 2 * sizeof(uint32_t));
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame = (frame + 1) % RINGFRAMES;
+}
+
+void
+culldraw(unsigned int objectcount)
+{
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandbuffer);
+    glBindBuffer(GL_PARAMETER_BUFFER, counter);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, drawbuffer);
+    glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT,
+	    (const void *) 0, 0, objectcount, 0);
+    glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+unsigned int
+cullvisible(void)
+{
+    return visible;
+}
+
+unsigned int
+culltriangles(void)
+{
+    return triangles;
+}
+
+void
+cullterm(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < RINGFRAMES; i++) {
+	if (fences[i])
+	    glDeleteSync(fences[i]);
+	fences[i] = NULL;
+    }
+    vramuntrack(GL_BUFFER, commandbuffer);
+    vramuntrack(GL_BUFFER, drawbuffer);
+    vramuntrack(GL_BUFFER, counter);
+    vramuntrack(GL_BUFFER, readback);
+    vramuntrack(GL_BUFFER, lodbuffer);
+    vramuntrack(GL_BUFFER, levelbuffer);
+    glDeleteBuffers(1, &commandbuffer);
+    glDeleteBuffers(1, &drawbuffer);
+    glDeleteBuffers(1, &counter);
+    glDeleteBuffers(1, &readback);
+    glDeleteBuffers(1, &lodbuffer);
+    glDeleteBuffers(1, &levelbuffer);
+    commandbuffer = drawbuffer = counter = readback = lodbuffer =
+	levelbuffer = 0;
+    counts = NULL;
+}
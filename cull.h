@@ -0,0 +1,19 @@
+/* GPU culling.
+ *
+ * cull.glsl tests every object's bounding sphere against the frustum and,
+ * once a depth pyramid is available, against it. Visible objects are
+ * compacted into an indirect command buffer through an atomic counter,
+ * which glMultiDrawElementsIndirectCount then reads as the draw count. The
+ * CPU cost is the same whatever the number of objects. Each visible object
+ * draws the coarsest level of detail whose error projects to at most the
+ * refine threshold in pixels. It only drops to a coarser level once that
+ * level's error is within the lower coarsen threshold, so an object near
+ * the limit does not flicker between the two. culltriangles() counts what
+ * was drawn. Requires scene.h. */
+
+int cullinit(const Scene *scene);
+void cullrun(GLuint program, unsigned int objectcount);
+void culldraw(unsigned int objectcount);
+unsigned int cullvisible(void);
+unsigned int culltriangles(void);
+void cullterm(void);
@@ -0,0 +1,104 @@
+#include <stdio.h>
+
+#include "glad.h"
+#include "hiz.h"
+#include "vram.h"
+
+/* Macros */
+#define GROUPSIZE 8  /* Must match local_size_x and y in hiz.glsl */
+#define LEVELMAX  16
+
+/* Variables */
+static GLuint pyramid, views[LEVELMAX];
+static int levels, basewidth, baseheight, built;
+
+/* Function implementations */
+
+int
+hizinit(int width, int height)
+{
+    size_t size;
+    int i;
+
+    hizterm();
+    basewidth = width > 1 ? width / 2 : 1;
+    baseheight = height > 1 ? height / 2 : 1;
+    for (levels = 1; levels < LEVELMAX &&
+	    (basewidth >> levels || baseheight >> levels); levels++)
+	;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &pyramid);
+    glTextureStorage2D(pyramid, levels, GL_R32F, basewidth, baseheight);
+    for (i = 0, size = 0; i < levels; i++)
+	size += (size_t) (basewidth >> i ? basewidth >> i : 1) *
+	    (baseheight >> i ? baseheight >> i : 1) * sizeof(float);
+    vramtrack(GL_TEXTURE, pyramid, VRAMTARGET, size, "hiz");
+    glTextureParameteri(pyramid, GL_TEXTURE_MIN_FILTER,
+	    GL_NEAREST_MIPMAP_NEAREST);
+    glTextureParameteri(pyramid, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(pyramid, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(pyramid, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    /* A view per level so a level can be read while the next is written */
+    glGenTextures(levels, views);
+    for (i = 0; i < levels; i++)
+	glTextureView(views[i], GL_TEXTURE_2D, pyramid, GL_R32F, i, 1, 0, 1);
+
+    return pyramid != 0;
+}
+
+void
+hizbuild(GLuint program, GLuint depth)
+{
+    int i, w, h;
+
+    glUseProgram(program);
+    for (i = 0; i < levels; i++) {
+	w = basewidth >> i ? basewidth >> i : 1;
+	h = baseheight >> i ? baseheight >> i : 1;
+	glBindTextureUnit(0, i ? views[i - 1] : depth);
+	glBindImageTexture(0, pyramid, i, GL_FALSE, 0, GL_WRITE_ONLY,
+		GL_R32F);
+	glDispatchCompute((w + GROUPSIZE - 1) / GROUPSIZE,
+		(h + GROUPSIZE - 1) / GROUPSIZE, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    built = 1;
+}
+
+GLuint
+hiztexture(void)
+{
+    return pyramid;
+}
+
+int
+hizlevels(void)
+{
+    return levels;
+}
+
+int
+hizready(void)
+{
+    return built;
+}
+
+void
+hizsize(int *width, int *height)
+{
+    *width = basewidth;
+    *height = baseheight;
+}
+
+void
+hizterm(void)
+{
+    if (pyramid) {
+	glDeleteTextures(levels, views);
+	vramuntrack(GL_TEXTURE, pyramid);
+	glDeleteTextures(1, &pyramid);
+    }
+    pyramid = 0;
+    levels = built = 0;
+}
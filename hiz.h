@@ -0,0 +1,15 @@
+/* Hierarchical depth pyramid.
+ *
+ * Level 0 is half the size of the depth buffer and every level holds the
+ * farthest depth of the 2x2 (3x3 at odd edges) texels below it, so a
+ * sample covers everything under its footprint. hiz.glsl builds one level
+ * per dispatch. The result is an R32F texture usable by occlusion culling,
+ * screen space effects or anything else needing conservative depth. */
+
+int hizinit(int width, int height);
+void hizbuild(GLuint program, GLuint depth);
+GLuint hiztexture(void);
+int hizlevels(void);
+int hizready(void);
+void hizsize(int *width, int *height);
+void hizterm(void);
@@ -0,0 +1,1214 @@
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "scene.h"
+#include "import.h"
+#include "meshopt.h"
+
+/* Macros */
+#define NONE      UINT_MAX
+#define EMPTY     UINT_MAX
+#define THREADMAX 64
+#define CHUNKMIN  (64 * 1024) /* Smaller files are not worth a thread */
+#define PROPMAX   32
+#define DIGITMAX  19          /* Decimal digits that fit in a uint64_t */
+#define BENCHRUNS 3           /* Best of, per thread count */
+
+/* Types */
+enum { TARGETX, TARGETY, TARGETZ, TARGETNX, TARGETNY, TARGETNZ, TARGETU,
+    TARGETV, TARGETCOUNT };
+
+typedef struct {
+    int type;           /* Index into typenames */
+    int target;         /* TARGET*, -1 to skip */
+    unsigned int offset;
+} Property;
+
+typedef struct {
+    /* Shared output, each chunk writes its own range */
+    float *v, *vt, *vn;
+    size_t vcount, vtcount, vncount;
+    unsigned int *corners;  /* OBJ, v, vt and vn per index */
+    unsigned int *indices;  /* PLY */
+    size_t indexcount;
+
+    /* PLY layout */
+    Property props[PROPMAX];
+    unsigned int propcount, vertexsize;
+    int counttype, indextype, hasnormals, hasuvs;
+    size_t vertexcount, facecount;
+} Import;
+
+typedef struct Chunk Chunk;
+struct Chunk {
+    void (*work)(Chunk *c);
+    Import *import;
+    const char *start, *end;    /* Whole lines */
+    size_t lines, v, vt, vn, indices;  /* Counts, then where each starts */
+    int ok;
+};
+
+typedef struct {
+    unsigned int *corners;  /* Unique v, vt and vn triples */
+    unsigned int count, *table, size;
+} Welder;
+
+/* Function prototypes */
+static char *readfile(const char *filename, size_t *size);
+static double seconds(void);
+static const char *skipspace(const char *s, const char *end);
+static const char *nextline(const char *s, const char *end);
+static const char *parsefloat(const char *s, const char *end, float *f);
+static const char *parselong(const char *s, const char *end, long *l);
+static unsigned int resolve(long n, size_t count);
+static unsigned int split(Chunk *chunks, unsigned int threads,
+	const char *start, const char *end, Import *import);
+static void *runchunk(void *arg);
+static int runchunks(Chunk *chunks, unsigned int count,
+	void (*work)(Chunk *c));
+static int objtype(const char *s, const char *end, const char **rest);
+static void countobj(Chunk *c);
+static void parseobj(Chunk *c);
+static uint32_t hashcorner(const unsigned int *c);
+static int rehash(Welder *w);
+static unsigned int addcorner(Welder *w, const unsigned int *c);
+static int weldobj(const Import *im, Mesh *mesh);
+static int importobj(Mesh *mesh, char *buffer, size_t size,
+	unsigned int threads);
+static int findtype(const char *name);
+static double readvalue(const unsigned char *p, int type);
+static int parseheader(Import *im, const char *s, const char *end,
+	const char **body, int *binary);
+static void storevertex(Import *im, size_t i, const double *values);
+static void countply(Chunk *c);
+static void parseplyvertices(Chunk *c);
+static void parseplyfaces(Chunk *c);
+static void convertply(Chunk *c);
+static int readfacesbinary(Import *im, const unsigned char *p,
+	const unsigned char *end);
+static uint32_t hashvertex(const float *v, unsigned int n);
+static int weldply(Mesh *mesh);
+static int importply(Mesh *mesh, char *buffer, size_t size,
+	unsigned int threads);
+static void freeimport(Import *im);
+
+/* Variables */
+static const char *const typenames[][2] = {
+    { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" },
+    { "ushort", "uint16" }, { "int", "int32" }, { "uint", "uint32" },
+    { "float", "float32" }, { "double", "float64" }
+};
+static const unsigned int typesizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+static const char *const targetnames[][3] = {
+    { "x", "x", "x" }, { "y", "y", "y" }, { "z", "z", "z" },
+    { "nx", "nx", "nx" }, { "ny", "ny", "ny" }, { "nz", "nz", "nz" },
+    { "u", "s", "texture_u" }, { "v", "t", "texture_v" }
+};
+static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Function implementations */
+
+char *
+readfile(const char *filename, size_t *size)
+{
+    FILE *fp;
+    char *buffer = NULL;
+    long length;
+
+    if (!(fp = fopen(filename, "rb")))
+	return NULL;
+    if (fseek(fp, 0, SEEK_END) == 0 && (length = ftell(fp)) >= 0 &&
+	    fseek(fp, 0, SEEK_SET) == 0 &&
+	    (buffer = (char *) malloc((size_t) length + 1))) {
+	*size = fread(buffer, 1, (size_t) length, fp);
+	buffer[*size] = '\0';
+    }
+    fclose(fp);
+
+    return buffer;
+}
+
+double
+seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+const char *
+skipspace(const char *s, const char *end)
+{
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\r'))
+	s++;
+
+    return s;
+}
+
+const char *
+nextline(const char *s, const char *end)
+{
+    const char *eol;
+
+    return (eol = (const char *) memchr(s, '\n', (size_t) (end - s))) ?
+	eol + 1 : end;
+}
+
+const char *
+parsefloat(const char *s, const char *end, float *f)
+{
+    union { double d; uint64_t u; } v;
+    const char *p;
+    uint64_t m = 0;
+    int digits = 0, scale = 0, exponent = 0, negative = 0, eneg = 0, any = 0;
+    char *next;
+
+    /* Most numbers have few enough digits to be scaled exactly by a power
+     * of ten in double precision (Clinger's fast path) */
+    p = s = skipspace(s, end);
+    if (p < end && (*p == '-' || *p == '+'))
+	negative = *p++ == '-';
+    for (; p < end && *p >= '0' && *p <= '9'; p++, any = 1) {
+	if (digits < DIGITMAX)
+	    m = m * 10 + (*p - '0');
+	else
+	    scale++;
+	if (m)
+	    digits++;
+    }
+    if (p < end && *p == '.')
+	for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = 1) {
+	    if (digits < DIGITMAX) {
+		m = m * 10 + (*p - '0');
+		scale--;
+	    }
+	    if (m)
+		digits++;
+	}
+    if (!any)
+	return NULL;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+	p++;
+	if (p < end && (*p == '-' || *p == '+'))
+	    eneg = *p++ == '-';
+	if (p >= end || *p < '0' || *p > '9')
+	    return NULL;
+	for (; p < end && *p >= '0' && *p <= '9'; p++)
+	    if (exponent < 10000)
+		exponent = exponent * 10 + (*p - '0');
+    }
+    scale += eneg ? -exponent : exponent;
+
+    if (digits <= DIGITMAX && m < (uint64_t) 1 << 53 && scale >= -22 &&
+	    scale <= 22) {
+	v.d = scale < 0 ? (double) m / powers[-scale] :
+	    (double) m * powers[scale];
+	/* Rounding to double then float differs from rounding once only
+	 * when the double lies halfway between two floats */
+	if ((v.u & 0x1fffffff) != 0x10000000 &&
+		(v.d == 0.0 || v.d >= 1.17549435e-38)) {
+	    *f = (float) (negative ? -v.d : v.d);
+	    return p;
+	}
+    }
+
+    /* The buffer is NUL terminated and the number ends before the line */
+    *f = strtof(s, &next);
+
+    return next == p ? p : NULL;
+}
+
+const char *
+parselong(const char *s, const char *end, long *l)
+{
+    long n = 0;
+    int negative = 0, any = 0;
+
+    s = skipspace(s, end);
+    if (s < end && (*s == '-' || *s == '+'))
+	negative = *s++ == '-';
+    for (; s < end && *s >= '0' && *s <= '9'; s++, any = 1)
+	if (n < LONG_MAX / 10)
+	    n = n * 10 + (*s - '0');
+    *l = negative ? -n : n;
+
+    return any ? s : NULL;
+}
+
+unsigned int
+resolve(long n, size_t count)
+{
+    /* One based, negative counts back from the last one read */
+    if (n > 0 && n <= (long) UINT_MAX - 1)
+	return (unsigned int) (n - 1);
+    if (n < 0 && (size_t) -n <= count)
+	return (unsigned int) (count + n);
+
+    return NONE - 1;
+}
+
+unsigned int
+split(Chunk *chunks, unsigned int threads, const char *start,
+	const char *end, Import *import)
+{
+    size_t size = (size_t) (end - start);
+    unsigned int i, count;
+
+    /* Cut at the first line break after each even share */
+    if (!threads || threads > THREADMAX)
+	threads = THREADMAX;
+    count = size / CHUNKMIN + 1 < threads ? size / CHUNKMIN + 1 : threads;
+    memset(chunks, 0, count * sizeof(Chunk));
+    for (i = 0; i < count; i++) {
+	chunks[i].import = import;
+	chunks[i].start = i ? chunks[i - 1].end : start;
+	chunks[i].end = i + 1 < count ? start + size / count * (i + 1) : end;
+	if (chunks[i].end < chunks[i].start)
+	    chunks[i].end = chunks[i].start;
+	else if (chunks[i].end > chunks[i].start && chunks[i].end < end &&
+		chunks[i].end[-1] != '\n')
+	    chunks[i].end = nextline(chunks[i].end, end);
+    }
+
+    return count;
+}
+
+void *
+runchunk(void *arg)
+{
+    Chunk *c = (Chunk *) arg;
+
+    c->work(c);
+
+    return NULL;
+}
+
+int
+runchunks(Chunk *chunks, unsigned int count, void (*work)(Chunk *c))
+{
+    pthread_t threads[THREADMAX];
+    int started[THREADMAX];
+    unsigned int i;
+    int ok = 1;
+
+    /* The calling thread takes the first chunk */
+    for (i = 0; i < count; i++) {
+	chunks[i].work = work;
+	chunks[i].ok = 1;
+    }
+    for (i = 1; i < count; i++)
+	started[i] = !pthread_create(&threads[i], NULL, runchunk, &chunks[i]);
+    work(&chunks[0]);
+    for (i = 1; i < count; i++) {
+	if (started[i])
+	    pthread_join(threads[i], NULL);
+	else
+	    work(&chunks[i]);
+    }
+    for (i = 0; i < count; i++)
+	ok = ok && chunks[i].ok;
+
+    return ok;
+}
+
+int
+objtype(const char *s, const char *end, const char **rest)
+{
+    /* 'v', 't' or 'n' for the vertex lines, 'f' for faces, 0 otherwise */
+    s = skipspace(s, end);
+    if (end - s < 2)
+	return 0;
+    if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t')) {
+	*rest = s + 2;
+	return 'f';
+    }
+    if (s[0] != 'v')
+	return 0;
+    if (s[1] == ' ' || s[1] == '\t') {
+	*rest = s + 2;
+	return 'v';
+    }
+    if (end - s >= 3 && (s[1] == 't' || s[1] == 'n') &&
+	    (s[2] == ' ' || s[2] == '\t')) {
+	*rest = s + 3;
+	return s[1];
+    }
+
+    return 0;
+}
+
+void
+countobj(Chunk *c)
+{
+    const char *s, *eol, *rest;
+    size_t corners;
+
+    for (s = c->start; s < c->end; s = nextline(s, c->end)) {
+	eol = (const char *) memchr(s, '\n', (size_t) (c->end - s));
+	eol = eol ? eol : c->end;
+	switch (objtype(s, eol, &rest)) {
+	case 'v':
+	    c->v++;
+	    break;
+	case 't':
+	    c->vt++;
+	    break;
+	case 'n':
+	    c->vn++;
+	    break;
+	case 'f':
+	    /* Corners are separated by blanks, the face is a fan */
+	    for (corners = 0, s = skipspace(rest, eol); s < eol; corners++) {
+		while (s < eol && *s != ' ' && *s != '\t' && *s != '\r')
+		    s++;
+		s = skipspace(s, eol);
+	    }
+	    if (corners < 3)
+		c->ok = 0;
+	    else
+		c->indices += (corners - 2) * 3;
+	}
+    }
+}
+
+void
+parseobj(Chunk *c)
+{
+    Import *im = c->import;
+    const char *s, *eol, *rest;
+    unsigned int corner[3], first[3], last[3], *out;
+    size_t v = c->v, vt = c->vt, vn = c->vn, n;
+    long value;
+    float *dst;
+    int k;
+
+    out = im->corners + c->indices * 3;
+    for (s = c->start; c->ok && s < c->end; s = nextline(s, c->end)) {
+	eol = (const char *) memchr(s, '\n', (size_t) (c->end - s));
+	eol = eol ? eol : c->end;
+	switch (objtype(s, eol, &rest)) {
+	case 'v':
+	    dst = im->v + v++ * 3;
+	    c->ok = (rest = parsefloat(rest, eol, dst)) &&
+		(rest = parsefloat(rest, eol, dst + 1)) &&
+		parsefloat(rest, eol, dst + 2);
+	    break;
+	case 't':
+	    dst = im->vt + vt++ * 2;
+	    c->ok = (rest = parsefloat(rest, eol, dst)) &&
+		parsefloat(rest, eol, dst + 1);
+	    break;
+	case 'n':
+	    dst = im->vn + vn++ * 3;
+	    c->ok = (rest = parsefloat(rest, eol, dst)) &&
+		(rest = parsefloat(rest, eol, dst + 1)) &&
+		parsefloat(rest, eol, dst + 2);
+	    break;
+	case 'f':
+	    for (n = 0, s = skipspace(rest, eol); c->ok && s < eol; n++) {
+		/* v, v/vt, v//vn or v/vt/vn */
+		corner[0] = corner[1] = corner[2] = NONE;
+		for (k = 0; k < 3; k++) {
+		    if (k && s < eol && *s == '/') {
+			s++;
+			continue;
+		    }
+		    if (s < eol && (*s == '-' || (*s >= '0' && *s <= '9'))) {
+			s = parselong(s, eol, &value);
+			corner[k] = resolve(value, k == 0 ? v :
+				k == 1 ? vt : vn);
+		    } else if (!k) {
+			c->ok = 0;
+		    }
+		    if (s >= eol || *s != '/')
+			break;
+		    s++;
+		}
+		if (s < eol && *s != ' ' && *s != '\t' && *s != '\r')
+		    c->ok = 0;
+		s = skipspace(s, eol);
+
+		/* Fan around the first corner */
+		if (n >= 2) {
+		    memcpy(out, first, sizeof(first));
+		    memcpy(out + 3, last, sizeof(last));
+		    memcpy(out + 6, corner, sizeof(corner));
+		    out += 9;
+		}
+		if (!n)
+		    memcpy(first, corner, sizeof(first));
+		memcpy(last, corner, sizeof(last));
+	    }
+	}
+    }
+}
+
+uint32_t
+hashcorner(const unsigned int *c)
+{
+    uint32_t h = 2166136261u;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+	h = (h ^ c[i]) * 16777619u;
+	h ^= h >> 15;
+    }
+
+    return h;
+}
+
+int
+rehash(Welder *w)
+{
+    unsigned int *table, *corners, size, mask, h, i;
+
+    size = w->size ? w->size * 2 : 1024;
+    if (!(table = (unsigned int *) malloc(size * sizeof(unsigned int))))
+	return 0;
+    if (!(corners = (unsigned int *) realloc(w->corners, size / 2 * 3 *
+		    sizeof(unsigned int)))) {
+	free(table);
+	return 0;
+    }
+    memset(table, 0xff, size * sizeof(unsigned int));
+    mask = size - 1;
+    for (i = 0; i < w->count; i++) {
+	for (h = hashcorner(corners + i * 3) & mask; table[h] != EMPTY;
+		h = (h + 1) & mask)
+	    ;
+	table[h] = i;
+    }
+    free(w->table);
+    w->table = table;
+    w->corners = corners;
+    w->size = size;
+
+    return 1;
+}
+
+unsigned int
+addcorner(Welder *w, const unsigned int *c)
+{
+    const unsigned int *q;
+    unsigned int mask, h, j;
+
+    /* Keep the table at most half full */
+    if (w->count * 2 >= w->size && !rehash(w))
+	return EMPTY;
+    mask = w->size - 1;
+    for (h = hashcorner(c) & mask; (j = w->table[h]) != EMPTY;
+	    h = (h + 1) & mask) {
+	q = w->corners + j * 3;
+	if (q[0] == c[0] && q[1] == c[1] && q[2] == c[2])
+	    return j;
+    }
+    memcpy(w->corners + w->count * 3, c, 3 * sizeof(unsigned int));
+    w->table[h] = w->count;
+
+    return w->count++;
+}
+
+int
+weldobj(const Import *im, Mesh *mesh)
+{
+    Welder w;
+    const unsigned int *c;
+    unsigned int i, count;
+    int ok = 0;
+
+    /* Each distinct v, vt and vn triple becomes one vertex */
+    memset(&w, 0, sizeof(w));
+    if (!im->indexcount || im->indexcount > UINT_MAX ||
+	    !(mesh->indices = (unsigned int *) malloc(im->indexcount *
+		    sizeof(unsigned int))))
+	return 0;
+    mesh->indexcount = (unsigned int) im->indexcount;
+    for (i = 0; i < mesh->indexcount; i++)
+	if ((mesh->indices[i] = addcorner(&w, im->corners + i * 3)) == EMPTY)
+	    goto done;
+
+    count = mesh->vertexcount = w.count;
+    mesh->positions = (float *) malloc(count * 3 * sizeof(float));
+    if (im->vtcount)
+	mesh->uvs = (float *) calloc(count * 2, sizeof(float));
+    if (im->vncount)
+	mesh->normals = (float *) calloc(count * 3, sizeof(float));
+    if (!mesh->positions || (im->vtcount && !mesh->uvs) ||
+	    (im->vncount && !mesh->normals))
+	goto done;
+
+    /* Corners without a texture coordinate or normal get zeros */
+    for (i = 0, c = w.corners; i < count; i++, c += 3) {
+	if (c[0] >= im->vcount ||
+		(c[1] != NONE && c[1] >= im->vtcount) ||
+		(c[2] != NONE && c[2] >= im->vncount))
+	    goto done;
+	memcpy(mesh->positions + i * 3, im->v + c[0] * 3, 3 * sizeof(float));
+	if (c[1] != NONE)
+	    memcpy(mesh->uvs + i * 2, im->vt + c[1] * 2, 2 * sizeof(float));
+	if (c[2] != NONE)
+	    memcpy(mesh->normals + i * 3, im->vn + c[2] * 3,
+		    3 * sizeof(float));
+    }
+    ok = 1;
+
+done:
+    free(w.corners);
+    free(w.table);
+
+    return ok;
+}
+
+int
+importobj(Mesh *mesh, char *buffer, size_t size, unsigned int threads)
+{
+    Chunk chunks[THREADMAX];
+    Import im;
+    size_t v = 0, vt = 0, vn = 0, indices = 0, n;
+    unsigned int i, count;
+    int ok = 0;
+
+    /* Count, then parse every chunk straight into its place */
+    memset(&im, 0, sizeof(im));
+    count = split(chunks, threads, buffer, buffer + size, &im);
+    if (!runchunks(chunks, count, countobj))
+	return 0;
+    for (i = 0; i < count; i++) {
+	n = chunks[i].v;
+	chunks[i].v = v;
+	v += n;
+	n = chunks[i].vt;
+	chunks[i].vt = vt;
+	vt += n;
+	n = chunks[i].vn;
+	chunks[i].vn = vn;
+	vn += n;
+	n = chunks[i].indices;
+	chunks[i].indices = indices;
+	indices += n;
+    }
+    im.vcount = v;
+    im.vtcount = vt;
+    im.vncount = vn;
+    im.indexcount = indices;
+    if (!(im.v = (float *) malloc((v ? v : 1) * 3 * sizeof(float))) ||
+	    !(im.vt = (float *) malloc((vt ? vt : 1) * 2 * sizeof(float))) ||
+	    !(im.vn = (float *) malloc((vn ? vn : 1) * 3 * sizeof(float))) ||
+	    !(im.corners = (unsigned int *) malloc((indices ? indices : 1) *
+		    3 * sizeof(unsigned int))))
+	goto done;
+    ok = runchunks(chunks, count, parseobj) && weldobj(&im, mesh);
+
+done:
+    freeimport(&im);
+
+    return ok;
+}
+
+int
+findtype(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(typesizes) / sizeof(typesizes[0]); i++)
+	if (!strcmp(name, typenames[i][0]) || !strcmp(name, typenames[i][1]))
+	    return (int) i;
+
+    return -1;
+}
+
+double
+readvalue(const unsigned char *p, int type)
+{
+    int8_t i8;
+    int16_t i16;
+    uint16_t u16;
+    int32_t i32;
+    uint32_t u32;
+    float f;
+    double d;
+
+    /* Little-endian file on a little-endian host */
+    switch (type) {
+    case 0:
+	memcpy(&i8, p, 1);
+	return i8;
+    case 1:
+	return *p;
+    case 2:
+	memcpy(&i16, p, 2);
+	return i16;
+    case 3:
+	memcpy(&u16, p, 2);
+	return u16;
+    case 4:
+	memcpy(&i32, p, 4);
+	return i32;
+    case 5:
+	memcpy(&u32, p, 4);
+	return u32;
+    case 6:
+	memcpy(&f, p, 4);
+	return f;
+    default:
+	memcpy(&d, p, 8);
+	return d;
+    }
+}
+
+int
+parseheader(Import *im, const char *s, const char *end, const char **body,
+	int *binary)
+{
+    char line[256], word[3][32];
+    const char *eol;
+    size_t length;
+    unsigned long count;
+    int element = 0, list = 0, n, i, j; /* 1 vertex, 2 face, 3 other */
+    Property *p;
+
+    if (end - s < 4 || memcmp(s, "ply", 3) || (s[3] != '\n' && s[3] != '\r'))
+	return 0;
+    for (s = nextline(s, end); s < end; s = eol) {
+	eol = nextline(s, end);
+	length = (size_t) (eol - s) < sizeof(line) ? (size_t) (eol - s) :
+	    sizeof(line) - 1;
+	memcpy(line, s, length);
+	line[length] = '\0';
+	n = sscanf(line, "%31s %31s %31s", word[0], word[1], word[2]);
+	if (n < 1 || !strcmp(word[0], "comment") ||
+		!strcmp(word[0], "obj_info"))
+	    continue;
+
+	if (!strcmp(word[0], "end_header")) {
+	    *body = eol;
+	    return im->vertexcount && im->facecount && list &&
+		im->counttype >= 0 && im->indextype >= 0;
+	} else if (!strcmp(word[0], "format") && n >= 2) {
+	    if (!strcmp(word[1], "ascii"))
+		*binary = 0;
+	    else if (!strcmp(word[1], "binary_little_endian"))
+		*binary = 1;
+	    else
+		return 0;
+	} else if (!strcmp(word[0], "element") && n >= 3) {
+	    count = strtoul(word[2], NULL, 10);
+	    /* Vertices, then faces, anything after them is ignored */
+	    if (!strcmp(word[1], "vertex") && !element) {
+		element = 1;
+		im->vertexcount = count;
+	    } else if (!strcmp(word[1], "face") && element == 1) {
+		element = 2;
+		im->facecount = count;
+	    } else if (element == 2) {
+		element = 3;
+	    } else {
+		return 0;
+	    }
+	} else if (!strcmp(word[0], "property") && n >= 3) {
+	    if (element == 1 && strcmp(word[1], "list")) {
+		if (im->propcount == PROPMAX ||
+			(i = findtype(word[1])) < 0)
+		    return 0;
+		p = &im->props[im->propcount++];
+		p->type = i;
+		p->target = -1;
+		p->offset = im->vertexsize;
+		im->vertexsize += typesizes[i];
+		for (i = 0; i < TARGETCOUNT; i++)
+		    for (j = 0; j < 3; j++)
+			if (!strcmp(word[2], targetnames[i][j]))
+			    p->target = i;
+	    } else if (element == 2 && !strcmp(word[1], "list") && !list) {
+		/* The index list must be the only face property */
+		if (sscanf(line, "%*s %*s %31s %31s", word[0], word[1]) != 2)
+		    return 0;
+		im->counttype = findtype(word[0]);
+		im->indextype = findtype(word[1]);
+		list = 1;
+	    } else if (element != 3) {
+		return 0;
+	    }
+	}
+    }
+
+    return 0;
+}
+
+void
+storevertex(Import *im, size_t i, const double *values)
+{
+    int j;
+
+    for (j = 0; j < 3; j++)
+	im->v[i * 3 + j] = (float) values[TARGETX + j];
+    if (im->hasnormals)
+	for (j = 0; j < 3; j++)
+	    im->vn[i * 3 + j] = (float) values[TARGETNX + j];
+    if (im->hasuvs)
+	for (j = 0; j < 2; j++)
+	    im->vt[i * 2 + j] = (float) values[TARGETU + j];
+}
+
+void
+countply(Chunk *c)
+{
+    const char *s;
+
+    for (s = c->start; s < c->end; s = nextline(s, c->end))
+	c->lines++;
+}
+
+void
+parseplyvertices(Chunk *c)
+{
+    Import *im = c->import;
+    const char *s, *eol, *rest;
+    double values[TARGETCOUNT];
+    size_t line;
+    unsigned int i;
+    long n;
+    float f;
+
+    /* Lines holds the first line, the face lines are only counted here */
+    for (s = c->start, line = c->lines; c->ok && s < c->end;
+	    s = nextline(s, c->end), line++) {
+	eol = (const char *) memchr(s, '\n', (size_t) (c->end - s));
+	eol = eol ? eol : c->end;
+	if (line < im->vertexcount) {
+	    memset(values, 0, sizeof(values));
+	    for (i = 0, rest = s; c->ok && i < im->propcount; i++) {
+		c->ok = (rest = parsefloat(rest, eol, &f)) != NULL;
+		if (im->props[i].target >= 0)
+		    values[im->props[i].target] = f;
+	    }
+	    storevertex(im, line, values);
+	} else if (line < im->vertexcount + im->facecount) {
+	    if (!parselong(s, eol, &n) || n < 3)
+		c->ok = 0;
+	    else
+		c->indices += (n - 2) * 3;
+	} else {
+	    break;
+	}
+    }
+}
+
+void
+parseplyfaces(Chunk *c)
+{
+    Import *im = c->import;
+    const char *s, *eol;
+    unsigned int first = 0, last = 0, index, *out;
+    size_t line;
+    long n, i, value;
+
+    out = im->indices + c->indices;
+    for (s = c->start, line = c->lines; c->ok && s < c->end;
+	    s = nextline(s, c->end), line++) {
+	if (line < im->vertexcount)
+	    continue;
+	if (line >= im->vertexcount + im->facecount)
+	    break;
+	eol = (const char *) memchr(s, '\n', (size_t) (c->end - s));
+	eol = eol ? eol : c->end;
+	s = parselong(s, eol, &n);
+	for (i = 0; c->ok && i < n; i++) {
+	    if (!(s = parselong(s, eol, &value)) || value < 0) {
+		c->ok = 0;
+		break;
+	    }
+	    index = value <= (long) UINT_MAX ? (unsigned int) value : NONE;
+	    if (i >= 2) {
+		*out++ = first;
+		*out++ = last;
+		*out++ = index;
+	    }
+	    if (!i)
+		first = index;
+	    last = index;
+	}
+	s = eol;
+    }
+}
+
+void
+convertply(Chunk *c)
+{
+    Import *im = c->import;
+    const unsigned char *p;
+    double values[TARGETCOUNT];
+    size_t v;
+    unsigned int i;
+
+    /* Binary vertices are fixed size, chunks are runs of them */
+    for (v = c->v, p = (const unsigned char *) c->start; p <
+	    (const unsigned char *) c->end; v++, p += im->vertexsize) {
+	memset(values, 0, sizeof(values));
+	for (i = 0; i < im->propcount; i++)
+	    if (im->props[i].target >= 0)
+		values[im->props[i].target] = readvalue(p +
+			im->props[i].offset, im->props[i].type);
+	storevertex(im, v, values);
+    }
+}
+
+int
+readfacesbinary(Import *im, const unsigned char *p, const unsigned char *end)
+{
+    const unsigned char *start = p;
+    unsigned int csize, isize, *out, first = 0, last = 0, index;
+    size_t f, i, count, indices = 0;
+    double n;
+
+    /* Lists vary in length, so they are counted first */
+    csize = typesizes[im->counttype];
+    isize = typesizes[im->indextype];
+    for (f = 0; f < im->facecount; f++) {
+	if ((size_t) (end - p) < csize)
+	    return 0;
+	n = readvalue(p, im->counttype);
+	p += csize;
+	if (n < 3.0 || (double) ((size_t) (end - p) / isize) < n)
+	    return 0;
+	indices += ((size_t) n - 2) * 3;
+	p += (size_t) n * isize;
+    }
+    if (!(out = im->indices = (unsigned int *) malloc((indices ? indices : 1) *
+		    sizeof(unsigned int))))
+	return 0;
+    im->indexcount = indices;
+
+    for (f = 0, p = start; f < im->facecount; f++) {
+	count = (size_t) readvalue(p, im->counttype);
+	p += csize;
+	for (i = 0; i < count; i++, p += isize) {
+	    n = readvalue(p, im->indextype);
+	    index = n >= 0.0 && n < (double) UINT_MAX ? (unsigned int) n : NONE;
+	    if (i >= 2) {
+		*out++ = first;
+		*out++ = last;
+		*out++ = index;
+	    }
+	    if (!i)
+		first = index;
+	    last = index;
+	}
+    }
+
+    return 1;
+}
+
+uint32_t
+hashvertex(const float *v, unsigned int n)
+{
+    union { float f; uint32_t u; } x;
+    uint32_t h = 2166136261u;
+    unsigned int i;
+
+    /* -0 and 0 weld, they compare equal */
+    for (i = 0; i < n; i++) {
+	x.f = v[i] == 0.0f ? 0.0f : v[i];
+	h = (h ^ x.u) * 16777619u;
+	h ^= h >> 15;
+    }
+
+    return h;
+}
+
+int
+weldply(Mesh *mesh)
+{
+    float a[TARGETCOUNT], b[TARGETCOUNT];
+    unsigned int *table, *remap, size, mask, h, i, j, k, n, unique;
+    int ok;
+
+    /* Identical vertices, every attribute equal, become one */
+    for (size = 1; size < mesh->vertexcount * 2; size *= 2)
+	;
+    table = (unsigned int *) malloc(size * sizeof(unsigned int));
+    remap = (unsigned int *) malloc(mesh->vertexcount * sizeof(unsigned int));
+    if (!table || !remap) {
+	free(table);
+	free(remap);
+	return 0;
+    }
+    memset(table, 0xff, size * sizeof(unsigned int));
+    mask = size - 1;
+    for (i = 0, unique = 0; i < mesh->vertexcount; i++) {
+	for (n = 0, k = 0; k < 3; k++)
+	    a[n++] = mesh->positions[i * 3 + k];
+	for (k = 0; mesh->normals && k < 3; k++)
+	    a[n++] = mesh->normals[i * 3 + k];
+	for (k = 0; mesh->uvs && k < 2; k++)
+	    a[n++] = mesh->uvs[i * 2 + k];
+	for (h = hashvertex(a, n) & mask; (j = table[h]) != EMPTY;
+		h = (h + 1) & mask) {
+	    for (n = 0, k = 0; k < 3; k++)
+		b[n++] = mesh->positions[j * 3 + k];
+	    for (k = 0; mesh->normals && k < 3; k++)
+		b[n++] = mesh->normals[j * 3 + k];
+	    for (k = 0; mesh->uvs && k < 2; k++)
+		b[n++] = mesh->uvs[j * 2 + k];
+	    for (k = 0; k < n && a[k] == b[k]; k++)
+		;
+	    if (k == n)
+		break;
+	}
+	if (j == EMPTY) {
+	    table[h] = i;
+	    remap[i] = unique++;
+	} else {
+	    remap[i] = remap[j];
+	}
+    }
+    free(table);
+
+    ok = unique == mesh->vertexcount ||
+	(meshremap(mesh->positions, 3, remap, mesh->vertexcount) &&
+	 (!mesh->normals ||
+	  meshremap(mesh->normals, 3, remap, mesh->vertexcount)) &&
+	 (!mesh->uvs || meshremap(mesh->uvs, 2, remap, mesh->vertexcount)));
+    if (ok && unique != mesh->vertexcount) {
+	for (i = 0; i < mesh->indexcount; i++)
+	    mesh->indices[i] = remap[mesh->indices[i]];
+	mesh->vertexcount = unique;
+    }
+    free(remap);
+
+    return ok;
+}
+
+int
+importply(Mesh *mesh, char *buffer, size_t size, unsigned int threads)
+{
+    Chunk chunks[THREADMAX];
+    Import im;
+    const char *body, *end = buffer + size;
+    int has[TARGETCOUNT], binary = 0, ok = 0;
+    size_t lines = 0, indices = 0, per, n;
+    unsigned int i, count;
+
+    memset(&im, 0, sizeof(im));
+    im.counttype = im.indextype = -1;
+    if (!parseheader(&im, buffer, end, &body, &binary))
+	return 0;
+    memset(has, 0, sizeof(has));
+    for (i = 0; i < im.propcount; i++)
+	if (im.props[i].target >= 0)
+	    has[im.props[i].target] = 1;
+    if (!has[TARGETX] || !has[TARGETY] || !has[TARGETZ] ||
+	    im.vertexcount > UINT_MAX)
+	return 0;
+    im.hasnormals = has[TARGETNX] && has[TARGETNY] && has[TARGETNZ];
+    im.hasuvs = has[TARGETU] && has[TARGETV];
+    if (!(im.v = (float *) malloc(im.vertexcount * 3 * sizeof(float))) ||
+	    (im.hasnormals && !(im.vn = (float *) malloc(im.vertexcount * 3 *
+		    sizeof(float)))) ||
+	    (im.hasuvs && !(im.vt = (float *) malloc(im.vertexcount * 2 *
+		    sizeof(float)))))
+	goto done;
+
+    if (binary) {
+	/* Vertices are split into even runs, faces are read in order */
+	if ((size_t) (end - body) / im.vertexsize < im.vertexcount)
+	    goto done;
+	count = split(chunks, threads, body, body + im.vertexcount *
+		im.vertexsize, &im);
+	per = (im.vertexcount + count - 1) / count;
+	for (i = 0; i < count; i++) {
+	    chunks[i].v = per * i < im.vertexcount ? per * i : im.vertexcount;
+	    n = per * (i + 1) < im.vertexcount ? per * (i + 1) :
+		im.vertexcount;
+	    chunks[i].start = body + chunks[i].v * im.vertexsize;
+	    chunks[i].end = body + n * im.vertexsize;
+	}
+	if (!runchunks(chunks, count, convertply) ||
+		!readfacesbinary(&im, (const unsigned char *) body +
+		    im.vertexcount * im.vertexsize,
+		    (const unsigned char *) end))
+	    goto done;
+    } else {
+	/* Chunks learn their first line, read the vertices and count the
+	 * face indices, then read the faces into place */
+	count = split(chunks, threads, body, end, &im);
+	if (!runchunks(chunks, count, countply))
+	    goto done;
+	for (i = 0; i < count; i++) {
+	    n = chunks[i].lines;
+	    chunks[i].lines = lines;
+	    lines += n;
+	}
+	if (lines < im.vertexcount + im.facecount ||
+		!runchunks(chunks, count, parseplyvertices))
+	    goto done;
+	for (i = 0; i < count; i++) {
+	    n = chunks[i].indices;
+	    chunks[i].indices = indices;
+	    indices += n;
+	}
+	im.indexcount = indices;
+	if (!(im.indices = (unsigned int *) malloc((indices ? indices : 1) *
+			sizeof(unsigned int))) ||
+		!runchunks(chunks, count, parseplyfaces))
+	    goto done;
+    }
+    if (!im.indexcount || im.indexcount > UINT_MAX)
+	goto done;
+    for (n = 0; n < im.indexcount; n++)
+	if (im.indices[n] >= im.vertexcount)
+	    goto done;
+
+    /* The streams are handed over as they are */
+    mesh->positions = im.v;
+    mesh->normals = im.vn;
+    mesh->uvs = im.vt;
+    mesh->indices = im.indices;
+    mesh->vertexcount = (unsigned int) im.vertexcount;
+    mesh->indexcount = (unsigned int) im.indexcount;
+    im.v = im.vn = im.vt = NULL;
+    im.indices = NULL;
+    ok = weldply(mesh);
+
+done:
+    freeimport(&im);
+
+    return ok;
+}
+
+void
+freeimport(Import *im)
+{
+    free(im->v);
+    free(im->vt);
+    free(im->vn);
+    free(im->corners);
+    free(im->indices);
+}
+
+unsigned int
+importcpus(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (unsigned int) n : 1;
+#endif
+}
+
+int
+importmesh(Mesh *mesh, const char *filename, unsigned int threads)
+{
+    const char *extension;
+    char *buffer;
+    size_t size;
+    int ok = 0;
+
+    memset(mesh, 0, sizeof(Mesh));
+    if (!(extension = strrchr(filename, '.')) ||
+	    !(buffer = readfile(filename, &size)))
+	return 0;
+    if (!threads)
+	threads = importcpus();
+    if (!strcmp(extension, ".obj"))
+	ok = importobj(mesh, buffer, size, threads);
+    else if (!strcmp(extension, ".ply"))
+	ok = importply(mesh, buffer, size, threads);
+    free(buffer);
+
+    if (!ok) {
+	free(mesh->positions);
+	free(mesh->normals);
+	free(mesh->uvs);
+	free(mesh->indices);
+	memset(mesh, 0, sizeof(Mesh));
+    }
+
+    return ok;
+}
+
+int
+importbench(FILE *fp, const char *filename, unsigned int threads)
+{
+    Mesh ref, mesh;
+    FILE *in;
+    double start, best, t;
+    long size;
+    unsigned int n;
+    int run, same, ok = 1;
+
+    if (!(in = fopen(filename, "rb")))
+	return 0;
+    size = fseek(in, 0, SEEK_END) == 0 ? ftell(in) : -1;
+    fclose(in);
+    if (size <= 0 || !importmesh(&ref, filename, 1))
+	return 0;
+    fprintf(fp, "%s, %.1f MB, %u vertices, %u triangles\n", filename,
+	    size / 1e6, ref.vertexcount, ref.indexcount / 3);
+
+    /* Doubling up to the thread count, each must match one thread exactly */
+    if (!threads)
+	threads = importcpus();
+    for (n = 1; ok; n = n * 2 < threads ? n * 2 : threads) {
+	for (run = 0, best = 0.0, same = 1; run < BENCHRUNS; run++) {
+	    start = seconds();
+	    if (!importmesh(&mesh, filename, n)) {
+		ok = 0;
+		break;
+	    }
+	    t = seconds() - start;
+	    best = !run || t < best ? t : best;
+	    same = same && mesh.vertexcount == ref.vertexcount &&
+		mesh.indexcount == ref.indexcount &&
+		!memcmp(mesh.indices, ref.indices, ref.indexcount *
+			sizeof(unsigned int)) &&
+		!memcmp(mesh.positions, ref.positions, ref.vertexcount * 3 *
+			sizeof(float)) &&
+		!mesh.normals == !ref.normals && !mesh.uvs == !ref.uvs &&
+		(!ref.normals || !memcmp(mesh.normals, ref.normals,
+			ref.vertexcount * 3 * sizeof(float))) &&
+		(!ref.uvs || !memcmp(mesh.uvs, ref.uvs, ref.vertexcount * 2 *
+			sizeof(float)));
+	    free(mesh.positions);
+	    free(mesh.normals);
+	    free(mesh.uvs);
+	    free(mesh.indices);
+	}
+	if (!ok)
+	    break;
+	fprintf(fp, "%3u threads %9.1f MB/s %8.3f s%s\n", n, size / 1e6 / best,
+		best, same ? "" : " MISMATCH");
+	ok = same;
+	if (n == threads)
+	    break;
+    }
+    free(ref.positions);
+    free(ref.normals);
+    free(ref.uvs);
+    free(ref.indices);
+
+    return ok;
+}
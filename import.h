@@ -0,0 +1,17 @@
+/* Mesh import.
+ *
+ * importmesh() reads a Wavefront OBJ or PLY (ASCII or binary little-endian)
+ * file into an indexed triangle list, picking the format from the file
+ * name's extension. The file is cut into chunks at line boundaries which are
+ * counted, then parsed straight into place by one thread each, threads 0
+ * meaning one per CPU. Polygons are split into fans. OBJ corners with the
+ * same position, texture coordinate and normal become one vertex and PLY
+ * vertices with every attribute equal are welded. Normals and texture
+ * coordinates are left NULL when the file has none, scenemesh() fills them
+ * in. importbench() reports the throughput for each thread count and checks
+ * the result matches a single thread's. Both return 0 on failure. Requires
+ * scene.h and stdio.h. */
+
+int importmesh(Mesh *mesh, const char *filename, unsigned int threads);
+unsigned int importcpus(void);
+int importbench(FILE *fp, const char *filename, unsigned int threads);
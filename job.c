@@ -0,0 +1,335 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "job.h"
+
+/* Macros */
+#define THREADMAX 64
+#define DEQUESIZE 4096  /* Jobs per thread, a power of two */
+#define RANGEMAX  4     /* jobfor() ranges per thread */
+#define IDLESPINS 256   /* Failed steals before a worker sleeps */
+
+/* Types */
+typedef struct {
+    void (*fn)(void *arg);
+    void *arg;
+    JobCounter *counter;
+} Job;
+
+typedef struct {
+    int64_t top;        /* Thieves take from here */
+    char pad0[56];
+    int64_t bottom;     /* The owner pushes and pops here */
+    char pad1[56];
+    Job jobs[DEQUESIZE];
+} Deque;
+
+typedef struct {
+    void (*fn)(void *arg, unsigned int first, unsigned int last);
+    void *arg;
+    unsigned int first, last;
+} Range;
+
+/* Function prototypes */
+static unsigned int cpus(void);
+static int push(Deque *d, const Job *job);
+static int take(Deque *d, Job *job);
+static int steal(Deque *d, Job *job);
+static int findjob(Job *job);
+static void run(const Job *job);
+static void *worker(void *arg);
+static void runrange(void *arg);
+
+/* Variables */
+static Deque *deques;
+static pthread_t workers[THREADMAX];
+static unsigned int threadcount = 1, started;
+static __thread int self = -1;  /* Deque of this thread, -1 outside */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static int queued, sleepers, quit;
+
+/* Function implementations */
+
+unsigned int
+cpus(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (unsigned int) n : 1;
+#endif
+}
+
+int
+push(Deque *d, const Job *job)
+{
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    Job *slot;
+
+    if (b - t >= DEQUESIZE)
+	return 0;
+    slot = &d->jobs[b & (DEQUESIZE - 1)];
+    __atomic_store_n(&slot->fn, job->fn, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->arg, job->arg, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->counter, job->counter, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+
+    return 1;
+}
+
+int
+take(Deque *d, Job *job)
+{
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1, t;
+    Job *slot;
+    int ok = 1;
+
+    /* Claim the bottom first, then race the thieves for the last job */
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	return 0;
+    }
+    slot = &d->jobs[b & (DEQUESIZE - 1)];
+    job->fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+    job->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+    job->counter = __atomic_load_n(&slot->counter, __ATOMIC_RELAXED);
+    if (t == b) {
+	ok = __atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+		__ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return ok;
+}
+
+int
+steal(Deque *d, Job *job)
+{
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE), b;
+    Job *slot;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+	return 0;
+
+    /* The slot can only be reused once top has moved on, failing the CAS */
+    slot = &d->jobs[t & (DEQUESIZE - 1)];
+    job->fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+    job->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+    job->counter = __atomic_load_n(&slot->counter, __ATOMIC_RELAXED);
+
+    return __atomic_compare_exchange_n(&d->top, &t, t + 1, 0,
+	    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+int
+findjob(Job *job)
+{
+    unsigned int i;
+
+    /* Own work first, newest first while it is still in cache */
+    if (take(&deques[self], job))
+	return 1;
+    for (i = 1; i < threadcount; i++)
+	if (steal(&deques[(self + i) % threadcount], job))
+	    return 1;
+
+    return 0;
+}
+
+void
+run(const Job *job)
+{
+    __atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    job->fn(job->arg);
+    __atomic_sub_fetch(&job->counter->pending, 1, __ATOMIC_RELEASE);
+}
+
+void *
+worker(void *arg)
+{
+    Job job;
+    unsigned int idle = 0;
+
+    self = (int) (intptr_t) arg;
+    while (!__atomic_load_n(&quit, __ATOMIC_ACQUIRE)) {
+	if (findjob(&job)) {
+	    run(&job);
+	    idle = 0;
+	    continue;
+	}
+	if (++idle < IDLESPINS) {
+	    sched_yield();
+	    continue;
+	}
+
+	/* jobspawn() bumps queued before it looks for sleepers, and this
+	 * looks at queued after counting itself in, so a wake up is never
+	 * missed */
+	pthread_mutex_lock(&lock);
+	__atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+	while (!__atomic_load_n(&quit, __ATOMIC_ACQUIRE) &&
+		__atomic_load_n(&queued, __ATOMIC_SEQ_CST) <= 0)
+	    pthread_cond_wait(&wake, &lock);
+	__atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&lock);
+	idle = 0;
+    }
+
+    return NULL;
+}
+
+int
+jobinit(unsigned int threads)
+{
+    unsigned int i;
+
+    jobterm();
+    if (!threads)
+	threads = cpus();
+    if (threads > THREADMAX)
+	threads = THREADMAX;
+    if (!(deques = (Deque *) calloc(threads, sizeof(Deque))))
+	return 0;
+
+    /* The caller is thread 0, a worker that fails to start is left out */
+    self = 0;
+    quit = 0;
+    threadcount = 1;
+    for (i = 1; i < threads; i++) {
+	if (pthread_create(&workers[threadcount - 1], NULL, worker,
+		    (void *) (intptr_t) threadcount))
+	    break;
+	threadcount++;
+    }
+    started = threadcount - 1;
+
+    return 1;
+}
+
+unsigned int
+jobthreads(void)
+{
+    return threadcount;
+}
+
+int
+jobself(void)
+{
+    return self;
+}
+
+void
+jobspawn(JobCounter *counter, void (*fn)(void *arg), void *arg)
+{
+    Job job;
+
+    job.fn = fn;
+    job.arg = arg;
+    job.counter = counter;
+    __atomic_add_fetch(&counter->pending, 1, __ATOMIC_RELAXED);
+    if (self < 0 || !deques || !push(&deques[self], &job)) {
+	__atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+	run(&job);
+	return;
+    }
+
+    __atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST) > 0) {
+	pthread_mutex_lock(&lock);
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+    }
+}
+
+void
+jobwait(JobCounter *counter)
+{
+    Job job;
+
+    /* Help rather than block, the jobs waited on may be in any deque */
+    while (__atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) > 0) {
+	if (self >= 0 && deques && findjob(&job))
+	    run(&job);
+	else
+	    sched_yield();
+    }
+}
+
+void
+runrange(void *arg)
+{
+    const Range *r = (const Range *) arg;
+
+    r->fn(r->arg, r->first, r->last);
+}
+
+void
+jobfor(unsigned int count, unsigned int grain,
+	void (*fn)(void *arg, unsigned int first, unsigned int last),
+	void *arg)
+{
+    Range ranges[THREADMAX * RANGEMAX];
+    JobCounter counter = { 0 };
+    unsigned int i, n;
+
+    n = threadcount > 1 ? threadcount * RANGEMAX : 1;
+    if (grain && count / grain < n)
+	n = count / grain;
+    if (n <= 1) {
+	if (count)
+	    fn(arg, 0, count);
+	return;
+    }
+
+    /* The first range runs here, the rest are there to be stolen */
+    for (i = 0; i < n; i++) {
+	ranges[i].fn = fn;
+	ranges[i].arg = arg;
+	ranges[i].first = (unsigned int) ((uint64_t) count * i / n);
+	ranges[i].last = (unsigned int) ((uint64_t) count * (i + 1) / n);
+    }
+    for (i = n - 1; i > 0; i--)
+	jobspawn(&counter, runrange, &ranges[i]);
+    runrange(&ranges[0]);
+    jobwait(&counter);
+}
+
+void
+jobterm(void)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&lock);
+    __atomic_store_n(&quit, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for (i = 0; i < started; i++)
+	pthread_join(workers[i], NULL);
+    started = 0;
+    threadcount = 1;
+    free(deques);
+    deques = NULL;
+    self = -1;
+}
@@ -0,0 +1,28 @@
+/* Job system.
+ *
+ * jobinit() starts a worker per CPU, or threads - 1 of them, the calling
+ * thread making up the rest. Every thread in the pool owns a Chase-Lev
+ * deque: jobspawn() pushes onto the caller's, the owner pops from the
+ * bottom and idle threads steal from the top of the others'. Workers sleep
+ * when there is nothing to steal. A JobCounter, zeroed before use, counts
+ * the jobs spawned against it that have not finished, so jobwait() joins
+ * them. jobwait() runs queued jobs while it waits instead of blocking, so
+ * jobs may spawn and wait on children of their own. Threads outside the pool
+ * run what they spawn straight away. jobfor() splits [0, count) into ranges
+ * of at least grain items, a few per thread, runs them as jobs and waits.
+ * jobself() gives the calling thread's index in the pool, -1 outside it.
+ * jobinit() returns 0 on failure. */
+
+typedef struct {
+    int pending;
+} JobCounter;
+
+int jobinit(unsigned int threads);
+unsigned int jobthreads(void);
+int jobself(void);
+void jobspawn(JobCounter *counter, void (*fn)(void *arg), void *arg);
+void jobwait(JobCounter *counter);
+void jobfor(unsigned int count, unsigned int grain,
+	void (*fn)(void *arg, unsigned int first, unsigned int last),
+	void *arg);
+void jobterm(void);
@@ -0,0 +1,204 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "glad.h"
+#include "job.h"
+#include "scene.h"
+#include "mdi.h"
+#include "pull.h"
+#include "vram.h"
+
+/* Macros */
+#define RINGFRAMES 3    /* Frames the CPU may run ahead of the GPU */
+#define CHUNKSIZE  4096 /* Objects per command building job */
+
+/* Types */
+typedef struct {
+    GLuint count;
+    GLuint instancecount;
+    GLuint firstindex;
+    GLint basevertex;
+    GLuint baseinstance;
+} DrawElementsCommand;
+
+typedef struct {
+    const Scene *scene;
+    DrawElementsCommand *commands;
+    uint32_t *draws;
+} Build;
+
+/* Function prototypes */
+static size_t align(size_t size, size_t alignment);
+static int runstart(const Scene *scene, unsigned int i);
+static void countruns(void *arg, unsigned int first, unsigned int last);
+static void writeruns(void *arg, unsigned int first, unsigned int last);
+
+/* Variables */
+static GLuint commandbuffer, drawbuffer;
+static DrawElementsCommand *commands;
+static uint32_t *draws;
+static GLsync fences[RINGFRAMES];
+static size_t commandstride, drawstride;
+static unsigned int frame, drawcount; /* Region and commands in it */
+static unsigned int *chunkfirst;   /* First command of each chunk */
+
+/* Function implementations */
+
+size_t
+align(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+int
+runstart(const Scene *scene, unsigned int i)
+{
+    return !i || scene->objects[i].mesh != scene->objects[i - 1].mesh;
+}
+
+void
+countruns(void *arg, unsigned int first, unsigned int last)
+{
+    const Build *b = (const Build *) arg;
+    unsigned int k, i, end, n;
+
+    for (k = first; k < last; k++) {
+	end = (k + 1) * CHUNKSIZE < b->scene->objectcount ?
+	    (k + 1) * CHUNKSIZE : b->scene->objectcount;
+	for (i = k * CHUNKSIZE, n = 0; i < end; i++)
+	    n += runstart(b->scene, i);
+	chunkfirst[k] = n;
+    }
+}
+
+void
+writeruns(void *arg, unsigned int first, unsigned int last)
+{
+    const Build *b = (const Build *) arg;
+    const Scene *scene = b->scene;
+    DrawElementsCommand *c;
+    unsigned int k, i, j, end, n;
+
+    /* A run belongs to the chunk it starts in and may run on past it */
+    for (k = first; k < last; k++) {
+	end = (k + 1) * CHUNKSIZE < scene->objectcount ?
+	    (k + 1) * CHUNKSIZE : scene->objectcount;
+	for (i = k * CHUNKSIZE, n = chunkfirst[k]; i < end; i++) {
+	    if (!runstart(scene, i))
+		continue;
+	    for (j = i + 1; j < scene->objectcount && !runstart(scene, j); j++)
+		;
+	    c = &b->commands[n];
+	    c->count = scene->meshes[scene->objects[i].mesh].indexcount;
+	    c->instancecount = j - i;
+	    c->firstindex = pullfirst(scene->objects[i].mesh);
+	    c->basevertex = 0;
+	    c->baseinstance = 0;
+	    b->draws[n++] = i;
+	}
+    }
+}
+
+int
+mdiinit(const Scene *scene)
+{
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+	GL_MAP_COHERENT_BIT;
+    GLint alignment;
+
+    /* One region per frame in flight, each big enough for a draw per
+     * object. Storage buffer ranges must start on an aligned offset. */
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    commandstride = scene->objectcount * sizeof(DrawElementsCommand);
+    drawstride = align(scene->objectcount * sizeof(uint32_t), alignment);
+
+    glCreateBuffers(1, &commandbuffer);
+    glNamedBufferStorage(commandbuffer, commandstride * RINGFRAMES, NULL,
+	    flags);
+    vramtrack(GL_BUFFER, commandbuffer, VRAMINDIRECT,
+	    commandstride * RINGFRAMES, "mdi");
+    glCreateBuffers(1, &drawbuffer);
+    glNamedBufferStorage(drawbuffer, drawstride * RINGFRAMES, NULL, flags);
+    vramtrack(GL_BUFFER, drawbuffer, VRAMSTORAGE, drawstride * RINGFRAMES,
+	    "mdi");
+    commands = (DrawElementsCommand *) glMapNamedBufferRange(commandbuffer, 0,
+	    commandstride * RINGFRAMES, flags);
+    draws = (uint32_t *) glMapNamedBufferRange(drawbuffer, 0,
+	    drawstride * RINGFRAMES, flags);
+    chunkfirst = (unsigned int *) malloc((scene->objectcount / CHUNKSIZE + 1) *
+	    sizeof(unsigned int));
+
+    return commands && draws && chunkfirst;
+}
+
+void
+mdirun(const Scene *scene)
+{
+    Build b;
+    unsigned int chunks, k, n, sum;
+
+    /* Wait for the GPU to finish with the next region */
+    frame = (frame + 1) % RINGFRAMES;
+    if (fences[frame]) {
+	glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT,
+		GL_TIMEOUT_IGNORED);
+	glDeleteSync(fences[frame]);
+	fences[frame] = NULL;
+    }
+
+    /* Commands are counted per chunk of objects on the jobs, placed with a
+     * prefix sum and written, the same whatever the thread count */
+    b.scene = scene;
+    b.commands = (DrawElementsCommand *) ((char *) commands +
+	    commandstride * frame);
+    b.draws = (uint32_t *) ((char *) draws + drawstride * frame);
+    chunks = (scene->objectcount + CHUNKSIZE - 1) / CHUNKSIZE;
+    jobfor(chunks, 1, countruns, &b);
+    for (k = 0, sum = 0; k < chunks; k++) {
+	n = chunkfirst[k];
+	chunkfirst[k] = sum;
+	sum += n;
+    }
+    drawcount = sum;
+    jobfor(chunks, 1, writeruns, &b);
+}
+
+void
+mdidraw(void)
+{
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandbuffer);
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, drawbuffer,
+	    drawstride * frame, drawcount * sizeof(uint32_t));
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+	    (const void *) (commandstride * frame), drawcount, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    /* The region is free once the frame's last pass is done with it */
+    if (fences[frame])
+	glDeleteSync(fences[frame]);
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void
+mditerm(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < RINGFRAMES; i++) {
+	if (fences[i])
+	    glDeleteSync(fences[i]);
+	fences[i] = NULL;
+    }
+    vramuntrack(GL_BUFFER, commandbuffer);
+    vramuntrack(GL_BUFFER, drawbuffer);
+    glDeleteBuffers(1, &commandbuffer);
+    glDeleteBuffers(1, &drawbuffer);
+    commandbuffer = drawbuffer = 0;
+    commands = NULL;
+    draws = NULL;
+    frame = drawcount = 0;
+    free(chunkfirst);
+    chunkfirst = NULL;
+}
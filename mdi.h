@@ -0,0 +1,14 @@
+/* Multi-draw indirect.
+ *
+ * Once a frame mdirun() records every object's draw into a persistently
+ * mapped indirect buffer. Consecutive objects sharing a mesh become one
+ * instanced command. The first object of each command is stored in a
+ * storage buffer indexed by gl_DrawID. mdidraw() submits them with a single
+ * glMultiDrawElementsIndirect, as many times as the frame has passes.
+ * Geometry comes from the vertex pulling buffers. Requires scene.h and
+ * pull.h. */
+
+int mdiinit(const Scene *scene);
+void mdirun(const Scene *scene);
+void mdidraw(void);
+void mditerm(void);
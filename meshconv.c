@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scene.h"
+#include "import.h"
+#include "meshfile.h"
+
+/* Function prototypes */
+static void usage(void);
+static void die(const char *fmt, const char *arg);
+
+/* Function implementations */
+
+void
+usage(void)
+{
+    fputs("usage: meshconv [-bs] [-o out.mesh] [-t threads] in.obj|in.ply\n",
+	    stderr);
+    exit(EXIT_FAILURE);
+}
+
+void
+die(const char *fmt, const char *arg)
+{
+    fprintf(stderr, fmt, arg);
+    exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char *argv[])
+{
+    Scene scene;
+    Mesh mesh;
+    const char *in = NULL, *out = "out.mesh";
+    double acmr[2], atvr[2];
+    unsigned int threads = 0;
+    int i, showstats = 0, bench = 0;
+
+    for (i = 1; i < argc; i++) {
+	if (!strcmp(argv[i], "-s"))
+	    showstats = 1;
+	else if (!strcmp(argv[i], "-b"))
+	    bench = 1;
+	else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+	    out = argv[++i];
+	else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+	    threads = strtoul(argv[++i], NULL, 10);
+	else if (argv[i][0] != '-' && !in)
+	    in = argv[i];
+	else
+	    usage();
+    }
+    if (!in)
+	usage();
+    if (bench)
+	return importbench(stdout, in, threads) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    /* Everything triangle would do at load is done once here */
+    if (!importmesh(&mesh, in, threads))
+	die("Could not import %s.\n", in);
+    if (!scenemesh(&mesh) || !scenecreate(&scene, &mesh, 1, 1, 1, 1) ||
+	    !sceneoptimise(&scene, acmr, atvr) || !scenelods(&scene) ||
+	    !scenemeshlets(&scene))
+	die("Failed to optimise %s.\n", in);
+    if (!meshsave(&scene.meshes[0], out))
+	die("Could not write %s.\n", out);
+    if (showstats)
+	printf("%u vertices, %u triangles, %u meshlets, "
+		"ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		scene.meshes[0].vertexcount, scene.meshes[0].indexcount / 3,
+		scene.meshes[0].meshletcount, acmr[0], acmr[1], atvr[0],
+		atvr[1]);
+    for (i = 1; showstats && i < (int) scene.meshes[0].lodcount; i++)
+	printf("level %d, %u triangles, error %g\n", i,
+		scene.meshes[0].lods[i].count / 3,
+		scene.meshes[0].lods[i].error);
+    scenefree(&scene);
+
+    return EXIT_SUCCESS;
+}
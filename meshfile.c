@@ -0,0 +1,305 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "scene.h"
+#include "meshfile.h"
+#include "meshlet.h"
+
+/* Macros */
+#define MAGIC         "MESH"
+#define VERSION       3
+#define ALIGNMENT     64
+#define VERTEXSTREAMS 3
+#define STREAMCOUNT   5     /* The vertex streams, meshlets and levels */
+#define STREAMFLOAT   0     /* FORMATFLOAT in vformat.h */
+#define STREAMMESHLET 0x100 /* Meshlet from scene.h as is */
+#define STREAMLOD     0x101 /* Lod from scene.h as is */
+#define ALIGN(x)      (((x) + ALIGNMENT - 1) & ~(uint64_t) (ALIGNMENT - 1))
+
+/* Types */
+typedef struct {
+    char magic[4];
+    uint32_t version;   /* Byte swapped on a big-endian host, so refused */
+    uint32_t vertexcount;
+    uint32_t indexcount; /* Every level's */
+    uint32_t streamcount;
+    uint32_t pad0;
+    float min[3], max[3];
+    uint64_t indexoffset;
+    uint32_t pad1[2];
+} Header;
+
+typedef struct {
+    uint32_t attribute; /* Position, normal, uv, meshlets then levels */
+    uint32_t format;
+    uint32_t components;
+    uint32_t stride;    /* Bytes */
+    uint64_t offset;    /* Bytes from the start of the file */
+    uint64_t size;
+} Stream;
+
+/* Function prototypes */
+static void *mapfile(const char *filename, size_t *size);
+static void unmapfile(void *base, size_t size);
+static int writepad(FILE *fp, uint64_t from, uint64_t to);
+static int inside(uint64_t offset, uint64_t length, size_t size);
+
+/* Variables */
+static const uint32_t streamcomponents[STREAMCOUNT] = {
+    3, 3, 2, sizeof(Meshlet) / 4, sizeof(Lod) / 4
+};
+
+/* Function implementations */
+
+#ifdef _WIN32
+void *
+mapfile(const char *filename, size_t *size)
+{
+    HANDLE file, map;
+    LARGE_INTEGER length;
+    void *base = NULL;
+
+    file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+	    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+	return NULL;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0 &&
+	    (map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL))) {
+	base = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	*size = (size_t) length.QuadPart;
+	CloseHandle(map);
+    }
+    CloseHandle(file);
+
+    return base;
+}
+
+void
+unmapfile(void *base, size_t size)
+{
+    (void) size;
+    UnmapViewOfFile(base);
+}
+#else
+void *
+mapfile(const char *filename, size_t *size)
+{
+    struct stat st;
+    void *base = NULL;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) == -1)
+	return NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+	base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base == MAP_FAILED)
+	    base = NULL;
+	*size = (size_t) st.st_size;
+    }
+    close(fd);
+
+    return base;
+}
+
+void
+unmapfile(void *base, size_t size)
+{
+    munmap(base, size);
+}
+#endif
+
+/* Written so a huge offset or length cannot wrap around */
+int
+inside(uint64_t offset, uint64_t length, size_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+int
+meshload(Mesh *mesh, const char *filename)
+{
+    const unsigned char *base;
+    const Header *h;
+    const Stream *s;
+    const Meshlet *meshlets;
+    const Lod *lods;
+    float *streams[VERTEXSTREAMS];
+    uint64_t length;
+    size_t size;
+    unsigned int i;
+
+    memset(mesh, 0, sizeof(Mesh));
+    if (!(base = (const unsigned char *) mapfile(filename, &size)))
+	return 0;
+    h = (const Header *) base;
+    s = (const Stream *) (h + 1);
+
+    /* Check everything the arrays will point at lies inside the file */
+    if (size < sizeof(Header) + STREAMCOUNT * sizeof(Stream) ||
+	    memcmp(h->magic, MAGIC, 4) || h->version != VERSION ||
+	    h->streamcount != STREAMCOUNT || !h->vertexcount ||
+	    !h->indexcount || h->indexcount % 3 ||
+	    h->indexoffset % ALIGNMENT ||
+	    !inside(h->indexoffset, (uint64_t) h->indexcount * 4, size))
+	goto fail;
+    for (i = 0; i < VERTEXSTREAMS; i++, s++) {
+	if (s->attribute != i || s->format != STREAMFLOAT ||
+		s->components != streamcomponents[i] ||
+		s->stride != s->components * sizeof(float) ||
+		s->offset % ALIGNMENT ||
+		h->vertexcount > UINT64_MAX / s->stride)
+	    goto fail;
+	length = (uint64_t) h->vertexcount * s->stride;
+	if (s->size < length || !inside(s->offset, length, size))
+	    goto fail;
+	streams[i] = (float *) (base + s->offset);
+    }
+    if (s->attribute != VERTEXSTREAMS || s->format != STREAMMESHLET ||
+	    s->components != streamcomponents[VERTEXSTREAMS] ||
+	    s->stride != sizeof(Meshlet) || s->offset % ALIGNMENT ||
+	    !s->size || s->size % s->stride ||
+	    !inside(s->offset, s->size, size))
+	goto fail;
+    meshlets = (const Meshlet *) (base + s->offset);
+    mesh->meshletcount = (unsigned int) (s->size / s->stride);
+    s++;
+    if (s->attribute != VERTEXSTREAMS + 1 || s->format != STREAMLOD ||
+	    s->components != streamcomponents[VERTEXSTREAMS + 1] ||
+	    s->stride != sizeof(Lod) || s->offset % ALIGNMENT || !s->size ||
+	    s->size % s->stride || s->size > LODMAX * sizeof(Lod) ||
+	    !inside(s->offset, s->size, size))
+	goto fail;
+    lods = (const Lod *) (base + s->offset);
+    mesh->lodcount = (unsigned int) (s->size / s->stride);
+    mesh->indices = (unsigned int *) (base + h->indexoffset);
+
+    /* An index past the end would have the shaders read out of bounds */
+    for (i = 0; i < h->indexcount; i++)
+	if (mesh->indices[i] >= h->vertexcount)
+	    goto fail;
+    for (i = 0; i < mesh->lodcount; i++)
+	if (lods[i].first % 3 || !lods[i].count || lods[i].count % 3 ||
+		lods[i].count > h->indexcount ||
+		lods[i].first > h->indexcount - lods[i].count)
+	    goto fail;
+    if (lods[0].first)
+	goto fail;
+    for (i = 0; i < mesh->meshletcount; i++)
+	if (meshlets[i].first % 3 || !meshlets[i].count ||
+		meshlets[i].count % 3 ||
+		meshlets[i].count > MESHLETTRIANGLES * 3 ||
+		meshlets[i].count > lods[0].count ||
+		meshlets[i].first > lods[0].count - meshlets[i].count)
+	    goto fail;
+
+    mesh->positions = streams[0];
+    mesh->normals = streams[1];
+    mesh->uvs = streams[2];
+    mesh->meshlets = (Meshlet *) meshlets;
+    memcpy(mesh->lods, lods, mesh->lodcount * sizeof(Lod));
+    mesh->vertexcount = h->vertexcount;
+    mesh->indexcount = lods[0].count;
+    memcpy(mesh->min, h->min, sizeof(mesh->min));
+    memcpy(mesh->max, h->max, sizeof(mesh->max));
+    mesh->mapping = (void *) base;
+    mesh->mappingsize = size;
+
+    return 1;
+
+fail:
+    unmapfile((void *) base, size);
+    memset(mesh, 0, sizeof(Mesh));
+
+    return 0;
+}
+
+int
+writepad(FILE *fp, uint64_t from, uint64_t to)
+{
+    static const unsigned char zero[ALIGNMENT];
+
+    return fwrite(zero, 1, (size_t) (to - from), fp) == to - from;
+}
+
+int
+meshsave(const Mesh *mesh, const char *filename)
+{
+    const void *data[STREAMCOUNT];
+    Header h;
+    Stream s[STREAMCOUNT];
+    uint64_t offset;
+    FILE *fp;
+    unsigned int i;
+    int ok;
+
+    data[0] = mesh->positions;
+    data[1] = mesh->normals;
+    data[2] = mesh->uvs;
+    data[3] = mesh->meshlets;
+    data[4] = mesh->lods;
+    if (!mesh->meshlets || !mesh->meshletcount || !mesh->lodcount)
+	return 0;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, 4);
+    h.version = VERSION;
+    h.vertexcount = mesh->vertexcount;
+    h.indexcount = sceneindexcount(mesh);
+    h.streamcount = STREAMCOUNT;
+    memcpy(h.min, mesh->min, sizeof(h.min));
+    memcpy(h.max, mesh->max, sizeof(h.max));
+    h.indexoffset = ALIGN(sizeof(Header) + sizeof(s));
+
+    memset(s, 0, sizeof(s));
+    offset = ALIGN(h.indexoffset + (uint64_t) h.indexcount * 4);
+    for (i = 0; i < STREAMCOUNT; i++) {
+	s[i].attribute = i;
+	s[i].format = i < VERTEXSTREAMS ? STREAMFLOAT : i == VERTEXSTREAMS ?
+	    STREAMMESHLET : STREAMLOD;
+	s[i].components = streamcomponents[i];
+	s[i].stride = s[i].components * 4;
+	s[i].offset = offset;
+	s[i].size = (uint64_t) (i < VERTEXSTREAMS ? mesh->vertexcount :
+		i == VERTEXSTREAMS ? mesh->meshletcount : mesh->lodcount) *
+	    s[i].stride;
+	offset = ALIGN(offset + s[i].size);
+    }
+
+    if (!(fp = fopen(filename, "wb")))
+	return 0;
+    ok = fwrite(&h, sizeof(h), 1, fp) == 1 &&
+	fwrite(s, sizeof(s), 1, fp) == 1 &&
+	writepad(fp, sizeof(h) + sizeof(s), h.indexoffset) &&
+	fwrite(mesh->indices, 4, h.indexcount, fp) == h.indexcount;
+    offset = h.indexoffset + (uint64_t) h.indexcount * 4;
+    for (i = 0; ok && i < STREAMCOUNT; i++) {
+	ok = writepad(fp, offset, s[i].offset) &&
+	    fwrite(data[i], 1, (size_t) s[i].size, fp) == s[i].size;
+	offset = s[i].offset + s[i].size;
+    }
+    if (fclose(fp) != 0)
+	ok = 0;
+    if (!ok)
+	remove(filename);
+
+    return ok;
+}
+
+void
+meshunload(Mesh *mesh)
+{
+    if (mesh->mapping)
+	unmapfile(mesh->mapping, mesh->mappingsize);
+    memset(mesh, 0, sizeof(Mesh));
+}
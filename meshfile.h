@@ -0,0 +1,14 @@
+/* Binary mesh files.
+ *
+ * A 64-byte header, a 32-byte descriptor per stream, then the index block
+ * holding every level of detail, the vertex streams, the meshlets and the
+ * levels, each starting on a 64-byte boundary. Everything is little-endian.
+ * meshload() maps the file and points the mesh's arrays straight into it,
+ * nothing is parsed or copied, so the mesh is read only until meshunload()
+ * releases it. meshsave() writes float positions, normals and texture
+ * coordinates, the meshlets and the levels, which must have been built. Both
+ * return 0 on failure. Requires scene.h. */
+
+int meshload(Mesh *mesh, const char *filename);
+int meshsave(const Mesh *mesh, const char *filename);
+void meshunload(Mesh *mesh);
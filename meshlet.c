@@ -0,0 +1,137 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scene.h"
+#include "meshlet.h"
+
+/* Function prototypes */
+static void bound(Meshlet *m, const unsigned int *indices,
+	const float *positions);
+
+/* Function implementations */
+
+void
+bound(Meshlet *m, const unsigned int *indices, const float *positions)
+{
+    const float *p[3];
+    float lo[3], hi[3], e1[3], e2[3], n[3], axis[3] = { 0.0f, 0.0f, 0.0f };
+    float d, radius = 0.0f, length, mindot = 1.0f;
+    unsigned int i, j, k;
+
+    /* Sphere around the box centre, as for whole meshes in pull.c */
+    for (j = 0; j < 3; j++)
+	lo[j] = hi[j] = positions[indices[m->first] * 3 + j];
+    for (i = m->first; i < m->first + m->count; i++) {
+	for (j = 0; j < 3; j++) {
+	    d = positions[indices[i] * 3 + j];
+	    if (d < lo[j])
+		lo[j] = d;
+	    if (d > hi[j])
+		hi[j] = d;
+	}
+    }
+    for (j = 0; j < 3; j++)
+	m->sphere[j] = 0.5f * (lo[j] + hi[j]);
+    for (i = m->first; i < m->first + m->count; i++) {
+	for (j = 0, d = 0.0f; j < 3; j++)
+	    d += (positions[indices[i] * 3 + j] - m->sphere[j]) *
+		(positions[indices[i] * 3 + j] - m->sphere[j]);
+	if (d > radius)
+	    radius = d;
+    }
+    m->sphere[3] = sqrtf(radius);
+
+    /* The cone axis is the mean face normal, its spread the widest angle
+     * from the axis to any face */
+    for (k = 0; k < 2; k++) {
+	for (i = m->first; i < m->first + m->count; i += 3) {
+	    for (j = 0; j < 3; j++)
+		p[j] = positions + indices[i + j] * 3;
+	    for (j = 0; j < 3; j++) {
+		e1[j] = p[1][j] - p[0][j];
+		e2[j] = p[2][j] - p[0][j];
+	    }
+	    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	    length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	    if (length <= 0.0f)
+		continue;   /* Degenerate, never drawn */
+	    for (j = 0, d = 0.0f; j < 3; j++) {
+		n[j] /= length;
+		if (k)
+		    d += n[j] * axis[j];
+		else
+		    axis[j] += n[j];
+	    }
+	    if (k && d < mindot)
+		mindot = d;
+	}
+	if (!k) {
+	    length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] +
+		    axis[2] * axis[2]);
+	    if (length <= 0.0f)
+		break;
+	    for (j = 0; j < 3; j++)
+		axis[j] /= length;
+	}
+    }
+    for (j = 0; j < 3; j++)
+	m->cone[j] = axis[j];
+    /* A spread of a right angle or more can always be seen from somewhere */
+    m->cone[3] = k == 2 && mindot > 0.0f ? sqrtf(1.0f - mindot * mindot) :
+	1.0f;
+}
+
+Meshlet *
+meshletbuild(const unsigned int *indices, unsigned int indexcount,
+	const float *positions, unsigned int vertexcount, unsigned int *count)
+{
+    Meshlet *meshlets, *m;
+    unsigned int *seen, i, j, fresh, vertices = 0;
+
+    /* At worst one meshlet a triangle, shrunk once the real count is known */
+    meshlets = (Meshlet *) malloc((indexcount / 3 ? indexcount / 3 : 1) *
+	    sizeof(Meshlet));
+    seen = (unsigned int *) calloc(vertexcount ? vertexcount : 1,
+	    sizeof(unsigned int));
+    if (!meshlets || !seen) {
+	free(meshlets);
+	free(seen);
+	return NULL;
+    }
+
+    /* seen holds the number of the meshlet, plus one, that last used a
+     * vertex, so it never needs clearing */
+    m = meshlets;
+    memset(m, 0, sizeof(Meshlet));
+    for (i = 0; i + 2 < indexcount; i += 3) {
+	for (j = 0, fresh = 0; j < 3; j++)
+	    fresh += seen[indices[i + j]] != (unsigned int) (m - meshlets) + 1;
+	if (m->count && (vertices + fresh > MESHLETVERTICES ||
+		    m->count == MESHLETTRIANGLES * 3)) {
+	    bound(m++, indices, positions);
+	    memset(m, 0, sizeof(Meshlet));
+	    m->first = i;
+	    vertices = 0;
+	}
+	for (j = 0; j < 3; j++) {
+	    if (seen[indices[i + j]] != (unsigned int) (m - meshlets) + 1) {
+		seen[indices[i + j]] = (unsigned int) (m - meshlets) + 1;
+		vertices++;
+	    }
+	}
+	m->count += 3;
+    }
+    if (m->count)
+	bound(m++, indices, positions);
+    free(seen);
+
+    *count = (unsigned int) (m - meshlets);
+    if ((m = (Meshlet *) realloc(meshlets, (*count ? *count : 1) *
+		    sizeof(Meshlet))))
+	meshlets = m;
+
+    return meshlets;
+}
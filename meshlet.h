@@ -0,0 +1,16 @@
+/* Meshlets.
+ *
+ * meshletbuild() cuts an indexed triangle list into runs of consecutive
+ * triangles touching at most MESHLETVERTICES distinct vertices and
+ * MESHLETTRIANGLES triangles, following the order meshopt.h left them in
+ * so each run stays compact. Every meshlet gets a bounding sphere and a
+ * cone holding all its face normals, so a whole run can be rejected when
+ * it is off screen or every triangle faces away from the camera. The
+ * meshlets index the mesh's own indices, there is no per-meshlet vertex
+ * list. Returns NULL when out of memory. Requires scene.h. */
+
+#define MESHLETVERTICES  64
+#define MESHLETTRIANGLES 124
+
+Meshlet *meshletbuild(const unsigned int *indices, unsigned int indexcount,
+	const float *positions, unsigned int vertexcount, unsigned int *count);
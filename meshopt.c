@@ -0,0 +1,460 @@
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshopt.h"
+#include "util.h"
+
+/* Macros */
+#define EMPTY        UINT_MAX
+#define CACHEMAX     32    /* LRU cache modelled by the scoring */
+#define FIFOMAX      64
+#define FIFOSIZE     16    /* Cache used to split clusters for overdraw */
+#define DECAYPOWER   1.5f
+#define LASTTRISCORE 0.75f
+#define VALENCESCALE 2.0f
+#define VALENCEPOWER 0.5f
+
+/* Types */
+typedef struct {
+    unsigned int entries[FIFOMAX];
+    unsigned int size, count, head;
+} Fifo;
+
+typedef struct {
+    float key;
+    unsigned int start, end; /* Triangles */
+} Cluster;
+
+/* Function prototypes */
+static uint32_t hashposition(const float *p);
+static float vertexscore(int cachepos, unsigned int remaining);
+static void fiforeset(Fifo *f, unsigned int size);
+static unsigned int fifotriangle(Fifo *f, const unsigned int *triangle);
+static void splitsoft(const unsigned int *indices, unsigned int start,
+	unsigned int end, float threshold, Cluster *clusters,
+	unsigned int *count);
+static void centroid(const unsigned int *indices, const float *positions,
+	unsigned int start, unsigned int end, float *centre, float *normal);
+static int clustercompare(const void *a, const void *b);
+
+/* Function implementations */
+
+uint32_t
+hashposition(const float *p)
+{
+    union { float f; uint32_t u; } v;
+    uint32_t h = 2166136261u;
+    int i;
+
+    /* -0 and 0 weld, they compare equal */
+    for (i = 0; i < 3; i++) {
+	v.f = p[i] == 0.0f ? 0.0f : p[i];
+	h = (h ^ v.u) * 16777619u;
+	h ^= h >> 15;
+    }
+
+    return h;
+}
+
+unsigned int
+meshweld(const float *positions, unsigned int vertexcount, unsigned int *remap)
+{
+    const float *p, *q;
+    unsigned int *table, size, mask, h, i, j, unique;
+
+    for (size = 1; size < vertexcount * 2; size *= 2)
+	;
+    if (!(table = (unsigned int *) malloc(size * sizeof(unsigned int))))
+	return 0;
+    memset(table, 0xff, size * sizeof(unsigned int));
+    mask = size - 1;
+
+    /* Open addressing, table holds the first vertex at each position */
+    for (i = 0, unique = 0; i < vertexcount; i++) {
+	p = positions + i * 3;
+	for (h = hashposition(p) & mask; (j = table[h]) != EMPTY;
+		h = (h + 1) & mask) {
+	    q = positions + j * 3;
+	    if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2])
+		break;
+	}
+	if (j == EMPTY) {
+	    table[h] = i;
+	    remap[i] = unique++;
+	} else {
+	    remap[i] = remap[j];
+	}
+    }
+    free(table);
+
+    return unique;
+}
+
+float
+vertexscore(int cachepos, unsigned int remaining)
+{
+    float score = 0.0f;
+
+    if (!remaining)
+	return -1.0f;
+
+    /* The last triangle's vertices score the same so it is not favoured
+     * over its neighbours, the rest decay with age. Vertices with few
+     * triangles left are boosted so they do not linger. */
+    if (cachepos >= 0) {
+	if (cachepos < 3)
+	    score = LASTTRISCORE;
+	else
+	    score = powf(1.0f - (float) (cachepos - 3) / (CACHEMAX - 3),
+		    DECAYPOWER);
+    }
+
+    return score + VALENCESCALE * powf((float) remaining, -VALENCEPOWER);
+}
+
+int
+meshcache(unsigned int *indices, unsigned int indexcount,
+	unsigned int vertexcount)
+{
+    unsigned int cache[CACHEMAX + 3], next[CACHEMAX + 3];
+    unsigned int *offsets, *remaining, *adjacency, *out, *list;
+    unsigned int tricount, cachesize, nextsize, cursor, i, j, k, n, t, v;
+    int *cachepos, best;
+    float *vscore, *tscore, bestscore, delta;
+    char *emitted;
+
+    tricount = indexcount / 3;
+    offsets = (unsigned int *) calloc(vertexcount + 1, sizeof(unsigned int));
+    remaining = (unsigned int *) calloc(vertexcount, sizeof(unsigned int));
+    adjacency = (unsigned int *) malloc((indexcount ? indexcount : 1) *
+	    sizeof(unsigned int));
+    out = (unsigned int *) malloc((indexcount ? indexcount : 1) *
+	    sizeof(unsigned int));
+    cachepos = (int *) malloc((vertexcount ? vertexcount : 1) * sizeof(int));
+    vscore = (float *) malloc((vertexcount ? vertexcount : 1) *
+	    sizeof(float));
+    tscore = (float *) calloc(tricount ? tricount : 1, sizeof(float));
+    emitted = (char *) calloc(tricount ? tricount : 1, 1);
+    if (!offsets || !remaining || !adjacency || !out || !cachepos ||
+	    !vscore || !tscore || !emitted) {
+	n = 0;
+	goto done;
+    }
+
+    /* Triangles using each vertex */
+    for (i = 0; i < tricount * 3; i++)
+	offsets[indices[i] + 1]++;
+    for (v = 0; v < vertexcount; v++)
+	offsets[v + 1] += offsets[v];
+    for (i = 0; i < tricount * 3; i++) {
+	v = indices[i];
+	adjacency[offsets[v] + remaining[v]++] = i / 3;
+    }
+
+    for (v = 0; v < vertexcount; v++) {
+	cachepos[v] = -1;
+	vscore[v] = vertexscore(-1, remaining[v]);
+    }
+    best = -1;
+    bestscore = -1.0f;
+    for (t = 0; t < tricount; t++) {
+	for (k = 0; k < 3; k++)
+	    tscore[t] += vscore[indices[t * 3 + k]];
+	if (tscore[t] > bestscore) {
+	    bestscore = tscore[t];
+	    best = t;
+	}
+    }
+
+    for (n = 0, cursor = 0, cachesize = 0; n < tricount; n++) {
+	/* Nothing in the cache has triangles left, take the next one */
+	if (best < 0) {
+	    while (emitted[cursor])
+		cursor++;
+	    best = cursor;
+	}
+	t = best;
+	emitted[t] = 1;
+	for (k = 0; k < 3; k++) {
+	    v = indices[t * 3 + k];
+	    out[n * 3 + k] = v;
+	    list = adjacency + offsets[v];
+	    for (j = 0; j < remaining[v]; j++) {
+		if (list[j] == t) {
+		    list[j] = list[--remaining[v]];
+		    break;
+		}
+	    }
+	}
+
+	/* Emitted vertices move to the front, the oldest fall off the end */
+	for (k = 0, nextsize = 0; k < 3; k++) {
+	    v = indices[t * 3 + k];
+	    for (j = 0; j < nextsize && next[j] != v; j++)
+		;
+	    if (j == nextsize)
+		next[nextsize++] = v;
+	}
+	for (i = 0; i < cachesize; i++) {
+	    v = cache[i];
+	    for (j = 0; j < nextsize && next[j] != v; j++)
+		;
+	    if (j == nextsize && nextsize < COUNT(next))
+		next[nextsize++] = v;
+	}
+
+	for (i = 0; i < nextsize; i++) {
+	    v = next[i];
+	    cachepos[v] = i < CACHEMAX ? (int) i : -1;
+	    delta = vertexscore(cachepos[v], remaining[v]) - vscore[v];
+	    vscore[v] += delta;
+	    list = adjacency + offsets[v];
+	    for (j = 0; j < remaining[v]; j++)
+		tscore[list[j]] += delta;
+	}
+
+	/* Only triangles touching the cache are candidates */
+	best = -1;
+	bestscore = -1.0f;
+	cachesize = nextsize < CACHEMAX ? nextsize : CACHEMAX;
+	for (i = 0; i < cachesize; i++) {
+	    v = next[i];
+	    cache[i] = v;
+	    list = adjacency + offsets[v];
+	    for (j = 0; j < remaining[v]; j++) {
+		if (tscore[list[j]] > bestscore) {
+		    bestscore = tscore[list[j]];
+		    best = list[j];
+		}
+	    }
+	}
+    }
+    memcpy(indices, out, tricount * 3 * sizeof(unsigned int));
+
+done:
+    free(offsets);
+    free(remaining);
+    free(adjacency);
+    free(out);
+    free(cachepos);
+    free(vscore);
+    free(tscore);
+    free(emitted);
+
+    return n == tricount;
+}
+
+void
+fiforeset(Fifo *f, unsigned int size)
+{
+    f->size = size < 1 ? 1 : size < FIFOMAX ? size : FIFOMAX;
+    f->count = f->head = 0;
+}
+
+unsigned int
+fifotriangle(Fifo *f, const unsigned int *triangle)
+{
+    unsigned int i, k, misses = 0;
+
+    for (k = 0; k < 3; k++) {
+	for (i = 0; i < f->count && f->entries[i] != triangle[k]; i++)
+	    ;
+	if (i < f->count)
+	    continue;
+	misses++;
+	if (f->count < f->size) {
+	    f->entries[f->count++] = triangle[k];
+	} else {
+	    f->entries[f->head] = triangle[k];
+	    f->head = (f->head + 1) % f->size;
+	}
+    }
+
+    return misses;
+}
+
+unsigned int
+meshmisses(const unsigned int *indices, unsigned int indexcount,
+	unsigned int cachesize)
+{
+    Fifo f;
+    unsigned int t, misses = 0;
+
+    fiforeset(&f, cachesize);
+    for (t = 0; t < indexcount / 3; t++)
+	misses += fifotriangle(&f, indices + t * 3);
+
+    return misses;
+}
+
+void
+splitsoft(const unsigned int *indices, unsigned int start, unsigned int end,
+	float threshold, Cluster *clusters, unsigned int *count)
+{
+    Fifo f;
+    unsigned int total, misses, first, t;
+
+    /* Close a cluster once its running ACMR is within threshold of the
+     * whole run's, the cache has warmed up by then */
+    total = meshmisses(indices + start * 3, (end - start) * 3, FIFOSIZE);
+    fiforeset(&f, FIFOSIZE);
+    for (t = first = start, misses = 0; t < end; t++) {
+	misses += fifotriangle(&f, indices + t * 3);
+	if (t + 1 == end || (float) misses * (end - start) <=
+		threshold * total * (t + 1 - first)) {
+	    clusters[*count].start = first;
+	    clusters[(*count)++].end = t + 1;
+	    first = t + 1;
+	    misses = 0;
+	    fiforeset(&f, FIFOSIZE);
+	}
+    }
+}
+
+void
+centroid(const unsigned int *indices, const float *positions,
+	unsigned int start, unsigned int end, float *centre, float *normal)
+{
+    const float *p[3];
+    float e1[3], e2[3], n[3], area = 0.0f, a;
+    unsigned int t, j;
+
+    /* Area weighted, the normal is left unnormalised */
+    for (j = 0; j < 3; j++)
+	centre[j] = normal[j] = 0.0f;
+    for (t = start; t < end; t++) {
+	for (j = 0; j < 3; j++)
+	    p[j] = positions + indices[t * 3 + j] * 3;
+	for (j = 0; j < 3; j++) {
+	    e1[j] = p[1][j] - p[0][j];
+	    e2[j] = p[2][j] - p[0][j];
+	}
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	for (j = 0; j < 3; j++) {
+	    centre[j] += (p[0][j] + p[1][j] + p[2][j]) / 3.0f * a;
+	    normal[j] += n[j];
+	}
+	area += a;
+    }
+    for (j = 0; j < 3; j++)
+	centre[j] = area > 0.0f ? centre[j] / area : 0.0f;
+}
+
+int
+clustercompare(const void *a, const void *b)
+{
+    const Cluster *x = (const Cluster *) a, *y = (const Cluster *) b;
+
+    if (x->key != y->key)
+	return x->key < y->key ? 1 : -1;
+
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+int
+meshoverdraw(unsigned int *indices, unsigned int indexcount,
+	const float *positions, float threshold)
+{
+    Cluster *clusters, *c;
+    Fifo f;
+    float centre[3], normal[3], mid[3], length;
+    unsigned int *out, tricount, count, start, t, j;
+
+    tricount = indexcount / 3;
+    clusters = (Cluster *) malloc((tricount ? tricount : 1) *
+	    sizeof(Cluster));
+    out = (unsigned int *) malloc((indexcount ? indexcount : 1) *
+	    sizeof(unsigned int));
+    if (!clusters || !out) {
+	free(clusters);
+	free(out);
+	return 0;
+    }
+
+    /* Hard boundaries where the cache starts over, at a triangle missing
+     * all its vertices, then soft ones within each run */
+    fiforeset(&f, FIFOSIZE);
+    for (t = start = count = 0; t < tricount; t++) {
+	if (fifotriangle(&f, indices + t * 3) == 3 && t > start) {
+	    splitsoft(indices, start, t, threshold, clusters, &count);
+	    start = t;
+	}
+    }
+    if (start < tricount)
+	splitsoft(indices, start, tricount, threshold, clusters, &count);
+
+    /* Clusters facing away from the centre occlude the rest, draw them
+     * first. Flat meshes keep their order. */
+    centroid(indices, positions, 0, tricount, centre, normal);
+    for (c = clusters; c < clusters + count; c++) {
+	centroid(indices, positions, c->start, c->end, mid, normal);
+	length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] +
+		normal[2] * normal[2]);
+	c->key = 0.0f;
+	if (length > 0.0f)
+	    for (j = 0; j < 3; j++)
+		c->key += (mid[j] - centre[j]) * normal[j] / length;
+    }
+    qsort(clusters, count, sizeof(Cluster), clustercompare);
+
+    for (c = clusters, t = 0; c < clusters + count; c++) {
+	memcpy(out + t * 3, indices + c->start * 3,
+		(c->end - c->start) * 3 * sizeof(unsigned int));
+	t += c->end - c->start;
+    }
+    memcpy(indices, out, tricount * 3 * sizeof(unsigned int));
+    free(clusters);
+    free(out);
+
+    return 1;
+}
+
+unsigned int
+meshfetch(unsigned int *indices, unsigned int indexcount,
+	unsigned int vertexcount, unsigned int *remap)
+{
+    unsigned int i, v, next;
+
+    /* First use order, unreferenced vertices are dropped */
+    memset(remap, 0xff, vertexcount * sizeof(unsigned int));
+    for (i = 0, next = 0; i < indexcount; i++) {
+	v = indices[i];
+	if (remap[v] == EMPTY)
+	    remap[v] = next++;
+	indices[i] = remap[v];
+    }
+
+    return next;
+}
+
+int
+meshremap(float *stream, unsigned int components, const unsigned int *remap,
+	unsigned int vertexcount)
+{
+    float *copy;
+    unsigned int v, count;
+
+    if (!(copy = (float *) malloc((vertexcount ? vertexcount : 1) *
+		    components * sizeof(float))))
+	return 0;
+    /* Welding and dropping unused vertices shrink the stream, only the
+     * vertices remapped to are written */
+    for (v = 0, count = 0; v < vertexcount; v++) {
+	if (remap[v] == EMPTY)
+	    continue;
+	memcpy(copy + remap[v] * components, stream + v * components,
+		components * sizeof(float));
+	if (remap[v] >= count)
+	    count = remap[v] + 1;
+    }
+    memcpy(stream, copy, count * components * sizeof(float));
+    free(copy);
+
+    return 1;
+}
@@ -0,0 +1,26 @@
+/* Index and vertex buffer optimisation.
+ *
+ * Run at load time on indexed triangle lists, in this order: meshcache()
+ * reorders triangles for the post-transform vertex cache (Forsyth's linear
+ * speed algorithm), meshoverdraw() then reorders clusters of those
+ * triangles so outward facing ones draw first without losing much cache
+ * locality (after Tipsify), and meshfetch() renumbers vertices in order of
+ * first use. It returns the new vertex count and fills remap, which
+ * meshremap() applies to each vertex stream. meshweld() builds the index
+ * buffer for an unindexed mesh and meshmisses() counts the misses of a FIFO
+ * cache for ACMR (misses per triangle) and ATVR (misses per vertex)
+ * reports. The functions returning int return 0 when out of memory and
+ * leave the mesh as it was. */
+
+unsigned int meshweld(const float *positions, unsigned int vertexcount,
+	unsigned int *remap);
+int meshcache(unsigned int *indices, unsigned int indexcount,
+	unsigned int vertexcount);
+int meshoverdraw(unsigned int *indices, unsigned int indexcount,
+	const float *positions, float threshold);
+unsigned int meshfetch(unsigned int *indices, unsigned int indexcount,
+	unsigned int vertexcount, unsigned int *remap);
+int meshremap(float *stream, unsigned int components,
+	const unsigned int *remap, unsigned int vertexcount);
+unsigned int meshmisses(const unsigned int *indices, unsigned int indexcount,
+	unsigned int cachesize);
@@ -0,0 +1,162 @@
+#include <stdio.h>
+
+#include "glad.h"
+#include "overdraw.h"
+#include "vram.h"
+
+/* Function prototypes */
+static int createtargets(void);
+static void deletetargets(void);
+
+/* Variables */
+static GLuint fbo, texture, pbo, emptyvao;
+static GLsync fence;
+static int fbwidth, fbheight;
+
+/* Function implementations */
+
+int
+createtargets(void)
+{
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture, 1, GL_R32F, fbwidth, fbheight);
+    vramtrack(GL_TEXTURE, texture, VRAMTARGET,
+	    (size_t) fbwidth * fbheight * sizeof(float), "overdraw");
+    glCreateFramebuffers(1, &fbo);
+    glNamedFramebufferTexture(fbo, GL_COLOR_ATTACHMENT0, texture, 0);
+    glCreateBuffers(1, &pbo);
+    glNamedBufferStorage(pbo, (GLsizeiptr) fbwidth * fbheight * sizeof(float),
+	    NULL, GL_MAP_READ_BIT);
+    vramtrack(GL_BUFFER, pbo, VRAMSTAGING,
+	    (size_t) fbwidth * fbheight * sizeof(float), "overdraw");
+
+    return glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER) ==
+	GL_FRAMEBUFFER_COMPLETE;
+}
+
+void
+deletetargets(void)
+{
+    if (fence) {
+	glDeleteSync(fence);
+	fence = NULL;
+    }
+    glDeleteFramebuffers(1, &fbo);
+    vramuntrack(GL_TEXTURE, texture);
+    vramuntrack(GL_BUFFER, pbo);
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &pbo);
+    fbo = texture = pbo = 0;
+}
+
+int
+overdrawinit(int width, int height)
+{
+    fbwidth = width;
+    fbheight = height;
+    glCreateVertexArrays(1, &emptyvao);
+
+    return createtargets();
+}
+
+void
+overdrawresize(int width, int height)
+{
+    /* Minimised */
+    if (!width || !height)
+	return;
+
+    deletetargets();
+    fbwidth = width;
+    fbheight = height;
+    if (!createtargets())
+	fprintf(stderr, "Failed to resize overdraw buffer.\n");
+}
+
+void
+overdrawbegin(void)
+{
+    static const GLfloat zero[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glClearNamedFramebufferfv(fbo, GL_COLOR, 0, zero);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+}
+
+void
+overdrawend(void)
+{
+    glDisable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void
+overdrawshow(GLuint program)
+{
+    /* Fullscreen triangle from gl_VertexID, no attributes */
+    glUseProgram(program);
+    glBindTextureUnit(0, texture);
+    glBindVertexArray(emptyvao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void
+overdrawread(void)
+{
+    if (fence)
+	return;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glGetTextureImage(texture, 0, GL_RED, GL_FLOAT,
+	    fbwidth * fbheight * sizeof(float), (void *) 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+int
+overdrawresult(double *average, double *covered, double *max)
+{
+    const float *counts;
+    GLenum status;
+    double sum, peak;
+    long i, n, hit;
+
+    if (!fence)
+	return 0;
+    if ((status = glClientWaitSync(fence, 0, 0)) == GL_TIMEOUT_EXPIRED)
+	return 0;
+    glDeleteSync(fence);
+    fence = NULL;
+    if (status == GL_WAIT_FAILED)
+	return 0;
+
+    n = (long) fbwidth * fbheight;
+    if (!(counts = (const float *) glMapNamedBufferRange(pbo, 0,
+		    n * sizeof(float), GL_MAP_READ_BIT)))
+	return 0;
+    sum = peak = 0.0;
+    hit = 0;
+    for (i = 0; i < n; i++) {
+	sum += counts[i];
+	if (counts[i] > 0.0f)
+	    hit++;
+	if (counts[i] > peak)
+	    peak = counts[i];
+    }
+    glUnmapNamedBuffer(pbo);
+
+    *average = sum / n;
+    *covered = hit ? sum / hit : 0.0;
+    *max = peak;
+
+    return 1;
+}
+
+void
+overdrawterm(void)
+{
+    deletetargets();
+    glDeleteVertexArrays(1, &emptyvao);
+    emptyvao = 0;
+}
@@ -0,0 +1,15 @@
+/* Overdraw analysis.
+ *
+ * Geometry drawn between overdrawbegin() and overdrawend() with the count
+ * fragment shader is blended additively into a float buffer, so each pixel
+ * ends up holding the number of fragments shaded for it. The buffer can be
+ * read back asynchronously for averages or shown as a heatmap. */
+
+int overdrawinit(int width, int height);
+void overdrawresize(int width, int height);
+void overdrawbegin(void);
+void overdrawend(void);
+void overdrawshow(GLuint program);
+void overdrawread(void);
+int overdrawresult(double *average, double *covered, double *max);
+void overdrawterm(void);
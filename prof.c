@@ -0,0 +1,273 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "glad.h"
+#include "prof.h"
+#include "util.h"
+
+/* Macros */
+#define ZONECOUNT  16384 /* Completed zones kept per thread */
+#define DEPTHMAX   32    /* Open zones per thread */
+#define QUERYCOUNT 1024  /* GPU timestamp pairs in flight */
+
+/* Types */
+typedef struct {
+    const char *name;
+    int64_t start, end;       /* CPU ns since profinit() */
+    int64_t gpustart, gpuend; /* GPU ns moved onto the CPU clock */
+    unsigned int depth;
+    int gpu;                  /* gpustart and gpuend are valid */
+} Zone;
+
+typedef struct {
+    const char *name;
+    int64_t start;
+    int query;                /* Query pair, -1 for none */
+    int group;                /* Debug group was pushed */
+} Open;
+
+typedef struct ProfThread ProfThread;
+struct ProfThread {
+    Zone zones[ZONECOUNT];    /* Ring, count % ZONECOUNT is the head */
+    unsigned long count;
+    Open open[DEPTHMAX];
+    unsigned int depth;
+    unsigned int id;
+    int gpu;
+    ProfThread *next;
+};
+
+typedef struct {
+    ProfThread *thread;
+    unsigned long zone;       /* Sequence number of the owning zone */
+    int ended;
+} Query;
+
+/* Function prototypes */
+static int64_t now(void);
+static ProfThread *getthread(void);
+static void writezone(FILE *fp, const Zone *z, unsigned int tid,
+	int64_t start, int64_t end);
+
+/* Variables */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread ProfThread *self;
+static ProfThread *threads, *gputhread;
+static unsigned int threadcount;
+static int64_t epoch, gpuoffset;
+static GLuint queries[QUERYCOUNT * 2];
+static Query slots[QUERYCOUNT];
+static unsigned long qhead, qtail;
+
+/* Function implementations */
+
+int64_t
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec - epoch;
+}
+
+ProfThread *
+getthread(void)
+{
+    if (self)
+	return self;
+
+    if (!(self = (ProfThread *) calloc(1, sizeof(ProfThread))))
+	return NULL;
+
+    pthread_mutex_lock(&lock);
+    self->id = ++threadcount;
+    self->next = threads;
+    threads = self;
+    pthread_mutex_unlock(&lock);
+
+    return self;
+}
+
+void
+profinit(void)
+{
+    epoch = now();
+}
+
+void
+profgpuinit(void)
+{
+    ProfThread *t;
+    GLint64 gputime;
+
+    if (!(t = getthread()))
+	return;
+
+    glGenQueries(COUNT(queries), queries);
+    glGetInteger64v(GL_TIMESTAMP, &gputime);
+    gpuoffset = now() - gputime;
+    t->gpu = 1;
+    gputhread = t;
+}
+
+void
+profbegin(const char *name)
+{
+    ProfThread *t;
+    Open *o;
+
+    if (!(t = getthread()))
+	return;
+    if (t->depth >= DEPTHMAX) {
+	t->depth++;
+	return;
+    }
+
+    o = &t->open[t->depth++];
+    o->name = name;
+    o->query = -1;
+    o->group = t->gpu;
+    if (t->gpu) {
+	glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+	if (qhead - qtail < QUERYCOUNT) {
+	    o->query = qhead++ % QUERYCOUNT;
+	    slots[o->query].ended = 0;
+	    glQueryCounter(queries[o->query * 2], GL_TIMESTAMP);
+	}
+    }
+    o->start = now();
+}
+
+void
+profend(void)
+{
+    int64_t end;
+    ProfThread *t;
+    Open *o;
+    Zone *z;
+
+    end = now();
+    if (!(t = self) || !t->depth)
+	return;
+    if (t->depth-- > DEPTHMAX)
+	return;
+
+    o = &t->open[t->depth];
+    if (o->query >= 0) {
+	glQueryCounter(queries[o->query * 2 + 1], GL_TIMESTAMP);
+	slots[o->query].thread = t;
+	slots[o->query].zone = t->count;
+	slots[o->query].ended = 1;
+    }
+    if (o->group)
+	glPopDebugGroup();
+
+    z = &t->zones[t->count++ % ZONECOUNT];
+    z->name = o->name;
+    z->start = o->start;
+    z->end = end;
+    z->depth = t->depth;
+    z->gpu = 0;
+}
+
+void
+profcollect(int wait)
+{
+    Query *s;
+    Zone *z;
+    GLint available;
+    GLuint64 start, end;
+    unsigned long i;
+
+    if (!gputhread || self != gputhread)
+	return;
+
+    /* Queries resolve in issue order, stop at the first one not ready */
+    for (; qtail != qhead; qtail++) {
+	i = qtail % QUERYCOUNT;
+	s = &slots[i];
+	if (!s->ended)
+	    break;
+	if (!wait) {
+	    glGetQueryObjectiv(queries[i * 2 + 1], GL_QUERY_RESULT_AVAILABLE,
+		    &available);
+	    if (!available)
+		break;
+	}
+	glGetQueryObjectui64v(queries[i * 2], GL_QUERY_RESULT, &start);
+	glGetQueryObjectui64v(queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+
+	/* The zone may have been overwritten in the meantime */
+	if (s->thread->count - s->zone <= ZONECOUNT) {
+	    z = &s->thread->zones[s->zone % ZONECOUNT];
+	    z->gpustart = (int64_t) start + gpuoffset;
+	    z->gpuend = (int64_t) end + gpuoffset;
+	    z->gpu = 1;
+	}
+	s->ended = 0;
+    }
+}
+
+void
+writezone(FILE *fp, const Zone *z, unsigned int tid, int64_t start,
+	int64_t end)
+{
+    fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+	    "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%u}}", z->name, tid,
+	    start / 1000.0, (end - start) / 1000.0, z->depth);
+}
+
+int
+profwrite(const char *filename)
+{
+    FILE *fp;
+    ProfThread *t;
+    const Zone *z;
+    unsigned long i;
+
+    if ((fp = fopen(filename, "w")) == NULL)
+	return 0;
+
+    /* GPU zones get their own track, tid 0 */
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+	    "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+	    "\"args\":{\"name\":\"GPU\"}}");
+    pthread_mutex_lock(&lock);
+    for (t = threads; t; t = t->next) {
+	fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+		"\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}", t->id,
+		t == gputhread ? "GL thread" : "Thread", t->id);
+	i = t->count > ZONECOUNT ? t->count - ZONECOUNT : 0;
+	for (; i < t->count; i++) {
+	    z = &t->zones[i % ZONECOUNT];
+	    writezone(fp, z, t->id, z->start, z->end);
+	    if (z->gpu)
+		writezone(fp, z, 0, z->gpustart, z->gpuend);
+	}
+    }
+    pthread_mutex_unlock(&lock);
+    fprintf(fp, "\n]}\n");
+
+    return fclose(fp) != EOF;
+}
+
+void
+profterm(void)
+{
+    ProfThread *t;
+
+    if (gputhread)
+	glDeleteQueries(COUNT(queries), queries);
+
+    pthread_mutex_lock(&lock);
+    while ((t = threads)) {
+	threads = t->next;
+	free(t);
+    }
+    gputhread = self = NULL;
+    pthread_mutex_unlock(&lock);
+}
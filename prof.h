@@ -0,0 +1,23 @@
+/* Profiling zones.
+ *
+ * Zones nest and record CPU timestamps into a ring buffer owned by the
+ * calling thread. On the thread that called profgpuinit() they also issue
+ * GPU timestamp queries and debug groups. profwrite() emits everything as a
+ * Chrome trace (chrome://tracing, ui.perfetto.dev). Define NOPROF to compile
+ * the zones out. */
+
+#ifdef NOPROF
+#define PROFBEGIN(name)
+#define PROFEND()
+#else
+#define PROFBEGIN(name) profbegin(name)
+#define PROFEND()       profend()
+#endif /* NOPROF */
+
+void profinit(void);
+void profgpuinit(void);
+void profbegin(const char *name);
+void profend(void);
+void profcollect(int wait);
+int profwrite(const char *filename);
+void profterm(void);
@@ -0,0 +1,184 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad.h"
+#include "quant.h"
+#include "scene.h"
+#include "pull.h"
+#include "vformat.h"
+#include "vram.h"
+
+/* Types */
+typedef struct {
+    float scale[4];     /* Dequantisation, xyz */
+    float offset[4];
+    float sphere[4];    /* Bounds, xyz centre, w radius */
+    uint32_t base;      /* First word in the position buffer */
+    uint32_t layout;
+    uint32_t count;     /* Indices */
+    uint32_t first;     /* First index in the element buffer */
+} MeshRecord;
+
+/* Function prototypes */
+static uint32_t *pack(uint32_t *w, const Mesh *mesh, int layout,
+	MeshRecord *r);
+
+/* Variables */
+static const unsigned int layoutwords[] = { 3, 2, 2 };
+static GLuint positions, elements, meshes, emptyvao;
+static unsigned int *firsts;
+
+/* Function implementations */
+
+uint32_t *
+pack(uint32_t *w, const Mesh *mesh, int layout, MeshRecord *r)
+{
+    const float *p;
+    float centre[3], d, radius;
+    unsigned int i, j;
+
+    vformatbounds(mesh, layout, r->scale, r->offset);
+    for (j = 0; j < 3; j++)
+	centre[j] = 0.5f * (mesh->min[j] + mesh->max[j]);
+    r->layout = layout;
+    r->count = mesh->indexcount;
+
+    /* Sphere around the box centre, tighter than the box's own */
+    for (i = 0, p = mesh->positions, radius = 0.0f; i < mesh->vertexcount;
+	    i++, p += 3) {
+	for (j = 0, d = 0.0f; j < 3; j++)
+	    d += (p[j] - centre[j]) * (p[j] - centre[j]);
+	if (d > radius)
+	    radius = d;
+    }
+    for (j = 0; j < 3; j++)
+	r->sphere[j] = centre[j];
+    r->sphere[3] = sqrtf(radius);
+
+    /* Two words a vertex hold x | y << 16 and z, as the kernels write */
+    switch (layout) {
+    case FORMATHALF:
+	quanthalf((unsigned short *) w, mesh->positions, mesh->vertexcount);
+	break;
+    case FORMATSNORM16:
+	quantsnorm16((short *) w, mesh->positions, mesh->vertexcount,
+		r->scale, r->offset);
+	break;
+    default:
+	memcpy(w, mesh->positions, mesh->vertexcount * 3 * sizeof(float));
+    }
+
+    return w + mesh->vertexcount * layoutwords[layout];
+}
+
+int
+pullinit(const Scene *scene, int layout)
+{
+    uint32_t *words, *w, *indices;
+    MeshRecord *records;
+    const Mesh *m;
+    size_t count, indexcount;
+    unsigned int i;
+
+    for (i = 0, count = indexcount = 0; i < scene->meshcount; i++) {
+	count += (size_t) scene->meshes[i].vertexcount * layoutwords[layout];
+	indexcount += sceneindexcount(&scene->meshes[i]);
+    }
+
+    words = (uint32_t *) malloc((count ? count : 1) * sizeof(uint32_t));
+    indices = (uint32_t *) malloc((indexcount ? indexcount : 1) *
+	    sizeof(uint32_t));
+    records = (MeshRecord *) calloc(scene->meshcount + 1, sizeof(MeshRecord));
+    firsts = (unsigned int *) calloc(scene->meshcount + 1,
+	    sizeof(unsigned int));
+    if (!words || !indices || !records || !firsts) {
+	free(words);
+	free(indices);
+	free(records);
+	free(firsts);
+	firsts = NULL;
+	return 0;
+    }
+
+    /* Indices stay local to their mesh, the shader adds the base word.
+     * Every level of detail follows, sharing the vertices. */
+    for (i = 0, w = words, indexcount = 0; i < scene->meshcount; i++) {
+	m = &scene->meshes[i];
+	records[i].base = w - words;
+	records[i].first = firsts[i] = indexcount;
+	w = pack(w, m, layout, &records[i]);
+	memcpy(indices + indexcount, m->indices,
+		sceneindexcount(m) * sizeof(uint32_t));
+	indexcount += sceneindexcount(m);
+    }
+
+    glCreateBuffers(1, &positions);
+    glNamedBufferStorage(positions, (count ? count : 1) * sizeof(uint32_t),
+	    words, 0);
+    vramtrack(GL_BUFFER, positions, VRAMVERTEX, (count ? count : 1) *
+	    sizeof(uint32_t), "pull");
+    glCreateBuffers(1, &elements);
+    glNamedBufferStorage(elements, (indexcount ? indexcount : 1) *
+	    sizeof(uint32_t), indices, 0);
+    vramtrack(GL_BUFFER, elements, VRAMINDEX, (indexcount ? indexcount : 1) *
+	    sizeof(uint32_t), "pull");
+    glCreateBuffers(1, &meshes);
+    glNamedBufferStorage(meshes, (scene->meshcount + 1) * sizeof(MeshRecord),
+	    records, 0);
+    vramtrack(GL_BUFFER, meshes, VRAMSTORAGE, (scene->meshcount + 1) *
+	    sizeof(MeshRecord), "pull");
+    glCreateVertexArrays(1, &emptyvao);
+    glVertexArrayElementBuffer(emptyvao, elements);
+    free(words);
+    free(indices);
+    free(records);
+
+    return 1;
+}
+
+void
+pullbind(void)
+{
+    glBindVertexArray(emptyvao);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positions);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, meshes);
+}
+
+unsigned int
+pullfirst(unsigned int mesh)
+{
+    return firsts[mesh];
+}
+
+void
+pulldraw(const Scene *scene)
+{
+    const Object *o;
+    unsigned int i;
+
+    /* The object index doubles as the base instance */
+    for (i = 0; i < scene->objectcount; i++) {
+	o = &scene->objects[i];
+	glDrawElementsInstancedBaseInstance(GL_TRIANGLES,
+		scene->meshes[o->mesh].indexcount, GL_UNSIGNED_INT,
+		(const void *) (pullfirst(o->mesh) * sizeof(uint32_t)), 1, i);
+    }
+}
+
+void
+pullterm(void)
+{
+    vramuntrack(GL_BUFFER, positions);
+    vramuntrack(GL_BUFFER, elements);
+    vramuntrack(GL_BUFFER, meshes);
+    glDeleteBuffers(1, &positions);
+    glDeleteBuffers(1, &elements);
+    glDeleteBuffers(1, &meshes);
+    glDeleteVertexArrays(1, &emptyvao);
+    positions = elements = meshes = emptyvao = 0;
+    free(firsts);
+    firsts = NULL;
+}
@@ -0,0 +1,14 @@
+/* Vertex pulling.
+ *
+ * All meshes are packed into one storage buffer in a compressed layout, a
+ * position format from vformat.h, and fetched by vertexpull.glsl from
+ * gl_VertexID, so no vertex attributes are set up and there is no VAO
+ * switch between meshes. Their indices share one element buffer,
+ * pullfirst() gives where a mesh's start. The mesh records also hold the
+ * dequantisation for the attribute path. Requires scene.h. */
+
+int pullinit(const Scene *scene, int layout);
+void pullbind(void);
+unsigned int pullfirst(unsigned int mesh);
+void pulldraw(const Scene *scene);
+void pullterm(void);
@@ -0,0 +1,520 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QUANTX86
+#include <immintrin.h>
+#endif /* __GNUC__ && x86 */
+
+#include "quant.h"
+
+/* Macros */
+#define BENCHRUNS 5 /* Best of, per kernel */
+
+/* Types */
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    void (*half)(unsigned short *dst, const float *src, size_t count);
+    void (*snorm16)(short *dst, const float *src, size_t count,
+	    const float *scale, const float *offset);
+} Kernel;
+
+/* Function prototypes */
+static int hasscalar(void);
+static void halfscalar(unsigned short *dst, const float *src, size_t count);
+static void snorm16scalar(short *dst, const float *src, size_t count,
+	const float *scale, const float *offset);
+#ifdef QUANTX86
+static int hassse2(void);
+static __m128i halfsse2vec(__m128 v);
+static void halfsse2(unsigned short *dst, const float *src, size_t count);
+static __m128i snorm16sse2vec(__m128 v, __m128 scale, __m128 offset);
+static void snorm16sse2(short *dst, const float *src, size_t count,
+	const float *scale, const float *offset);
+static int hasavx2(void);
+static void halfavx2(unsigned short *dst, const float *src, size_t count);
+static void snorm16avx2(short *dst, const float *src, size_t count,
+	const float *scale, const float *offset);
+#endif /* QUANTX86 */
+static const Kernel *getkernel(void);
+static double seconds(void);
+static float randomf(uint32_t *state);
+
+/* Variables */
+static const Kernel kernels[] = {
+#ifdef QUANTX86
+    { "avx2", hasavx2, halfavx2, snorm16avx2 },
+    { "sse2", hassse2, halfsse2, snorm16sse2 },
+#endif /* QUANTX86 */
+    { "scalar", hasscalar, halfscalar, snorm16scalar }
+};
+static const Kernel *active;
+
+/* Function implementations */
+
+unsigned short
+floattohalf(float f)
+{
+    uint32_t u, sign, mant, half, rem, halfway;
+    int exp, shift;
+
+    memcpy(&u, &f, sizeof(u));
+    sign = (u >> 16) & 0x8000;
+    exp = (int) ((u >> 23) & 0xff);
+    mant = u & 0x7fffff;
+
+    /* Inf and NaN, keep NaNs quiet */
+    if (exp == 0xff)
+	return sign | 0x7c00 | (mant ? 0x200 : 0);
+
+    exp = exp - 127 + 15;
+    if (exp >= 0x1f)
+	return sign | 0x7c00;
+
+    /* Subnormal or zero, round to nearest even on the shifted mantissa */
+    if (exp <= 0) {
+	if (exp < -10)
+	    return sign;
+	mant |= 0x800000;
+	shift = 14 - exp;
+	half = mant >> shift;
+	rem = mant & ((1u << shift) - 1);
+	halfway = 1u << (shift - 1);
+	if (rem > halfway || (rem == halfway && (half & 1)))
+	    half++;
+	return sign | half;
+    }
+
+    /* A carry out of the mantissa correctly bumps the exponent */
+    half = ((uint32_t) exp << 10) | (mant >> 13);
+    rem = mant & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1)))
+	half++;
+
+    return sign | half;
+}
+
+short
+floattosnorm16(float f)
+{
+    if (f > 1.0f)
+	f = 1.0f;
+    else if (!(f >= -1.0f)) /* NaN too */
+	f = -1.0f;
+
+    return (short) lrintf(f * 32767.0f);
+}
+
+unsigned short
+floattounorm16(float f)
+{
+    if (f > 1.0f)
+	f = 1.0f;
+    else if (!(f >= 0.0f))
+	f = 0.0f;
+
+    return (unsigned short) lrintf(f * 65535.0f);
+}
+
+unsigned int
+packsnorm10(const float *v)
+{
+    unsigned int w = 0, j;
+    float f;
+
+    /* x, y and z from the low bits up as GL_INT_2_10_10_10_REV, w is 0 */
+    for (j = 0; j < 3; j++) {
+	f = v[j];
+	if (f > 1.0f)
+	    f = 1.0f;
+	else if (!(f >= -1.0f))
+	    f = -1.0f;
+	w |= ((unsigned int) lrintf(f * 511.0f) & 0x3ff) << (j * 10);
+    }
+
+    return w;
+}
+
+float
+halftofloat(unsigned short h)
+{
+    uint32_t sign, exp, mant, u;
+    float f;
+
+    sign = (uint32_t) (h & 0x8000) << 16;
+    exp = (h >> 10) & 0x1f;
+    mant = h & 0x3ff;
+    if (!exp) {
+	f = ldexpf((float) mant, -24);
+	return sign ? -f : f;
+    }
+
+    u = sign | (exp == 0x1f ? 0xff : exp + 112) << 23 | mant << 13;
+    memcpy(&f, &u, sizeof(f));
+
+    return f;
+}
+
+int
+hasscalar(void)
+{
+    return 1;
+}
+
+void
+halfscalar(unsigned short *dst, const float *src, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++, src += 3, dst += 4) {
+	dst[0] = floattohalf(src[0]);
+	dst[1] = floattohalf(src[1]);
+	dst[2] = floattohalf(src[2]);
+	dst[3] = 0;
+    }
+}
+
+void
+snorm16scalar(short *dst, const float *src, size_t count, const float *scale,
+	const float *offset)
+{
+    size_t i;
+    int j;
+
+    for (i = 0; i < count; i++, src += 3, dst += 4) {
+	for (j = 0; j < 3; j++)
+	    dst[j] = floattosnorm16((src[j] - offset[j]) / scale[j]);
+	dst[3] = 0;
+    }
+}
+
+#ifdef QUANTX86
+
+/* Each vector holds a vertex, xyz and the next vertex's x which is masked
+ * off. Loads stop while a whole vector still fits, the rest of the vertices
+ * go through the scalar kernel. The results match it bit for bit. */
+
+__attribute__((target("sse2"))) int
+hassse2(void)
+{
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("sse2");
+}
+
+__attribute__((target("sse2"))) __m128i
+halfsse2vec(__m128 v)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i f16max = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i f32infty = _mm_set1_epi32(255 << 23);
+    const __m128i minnormal = _mm_set1_epi32(113 << 23);
+    const __m128i rebias = _mm_set1_epi32((int) 0xc8000fff); /* 15 - 127 */
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(126 << 23));
+    __m128i x, sign, big, nan, special, sub, denormal, normal, r;
+
+    x = _mm_castps_si128(v);
+    sign = _mm_and_si128(x, _mm_set1_epi32((int) 0x80000000));
+    x = _mm_xor_si128(x, sign);
+
+    /* Overflow goes to infinity, NaNs stay quiet */
+    big = _mm_cmpgt_epi32(x, _mm_sub_epi32(f16max, one));
+    nan = _mm_cmpgt_epi32(x, f32infty);
+    special = _mm_or_si128(_mm_set1_epi32(0x7c00),
+	    _mm_and_si128(nan, _mm_set1_epi32(0x200)));
+
+    /* Adding 0.5 rounds subnormals to the nearest multiple of 2^-24 */
+    denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(
+		    _mm_castsi128_ps(x), magic)), _mm_castps_si128(magic));
+    sub = _mm_cmplt_epi32(x, minnormal);
+
+    /* Rebias and round to nearest even on the dropped mantissa bits */
+    normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, rebias),
+		_mm_and_si128(_mm_srli_epi32(x, 13), one)), 13);
+
+    r = _mm_or_si128(_mm_and_si128(sub, denormal),
+	    _mm_andnot_si128(sub, normal));
+    r = _mm_or_si128(_mm_and_si128(big, special), _mm_andnot_si128(big, r));
+    r = _mm_or_si128(r, _mm_srli_epi32(sign, 16));
+
+    /* Sign extend so the saturating pack keeps the bits */
+    return _mm_srai_epi32(_mm_slli_epi32(r, 16), 16);
+}
+
+__attribute__((target("sse2"))) void
+halfsse2(unsigned short *dst, const float *src, size_t count)
+{
+    const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    __m128i a, b;
+    size_t i;
+
+    for (i = 0; i + 2 < count; i += 2) {
+	a = halfsse2vec(_mm_and_ps(_mm_loadu_ps(src + i * 3), mask));
+	b = halfsse2vec(_mm_and_ps(_mm_loadu_ps(src + i * 3 + 3), mask));
+	_mm_storeu_si128((__m128i *) (dst + i * 4), _mm_packs_epi32(a, b));
+    }
+    halfscalar(dst + i * 4, src + i * 3, count - i);
+}
+
+__attribute__((target("sse2"))) __m128i
+snorm16sse2vec(__m128 v, __m128 scale, __m128 offset)
+{
+    const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+    /* max() returns its second operand for NaN, which goes to -1 like
+     * floattosnorm16() */
+    v = _mm_div_ps(_mm_sub_ps(v, offset), scale);
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+    v = _mm_and_ps(_mm_mul_ps(v, _mm_set1_ps(32767.0f)), mask);
+
+    return _mm_cvtps_epi32(v);
+}
+
+__attribute__((target("sse2"))) void
+snorm16sse2(short *dst, const float *src, size_t count, const float *scale,
+	const float *offset)
+{
+    const __m128 s = _mm_set_ps(1.0f, scale[2], scale[1], scale[0]);
+    const __m128 o = _mm_set_ps(0.0f, offset[2], offset[1], offset[0]);
+    __m128i a, b;
+    size_t i;
+
+    for (i = 0; i + 2 < count; i += 2) {
+	a = snorm16sse2vec(_mm_loadu_ps(src + i * 3), s, o);
+	b = snorm16sse2vec(_mm_loadu_ps(src + i * 3 + 3), s, o);
+	_mm_storeu_si128((__m128i *) (dst + i * 4), _mm_packs_epi32(a, b));
+    }
+    snorm16scalar(dst + i * 4, src + i * 3, count - i, scale, offset);
+}
+
+int
+hasavx2(void)
+{
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c");
+}
+
+__attribute__((target("avx2,f16c"))) void
+halfavx2(unsigned short *dst, const float *src, size_t count)
+{
+    const __m256 mask = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1,
+		0, -1, -1, -1));
+    __m256 v;
+    size_t i;
+
+    for (i = 0; i + 2 < count; i += 2) {
+	v = _mm256_insertf128_ps(_mm256_castps128_ps256(
+		    _mm_loadu_ps(src + i * 3)), _mm_loadu_ps(src + i * 3 + 3),
+		1);
+	_mm_storeu_si128((__m128i *) (dst + i * 4), _mm256_cvtps_ph(
+		    _mm256_and_ps(v, mask), _MM_FROUND_TO_NEAREST_INT));
+    }
+    halfscalar(dst + i * 4, src + i * 3, count - i);
+}
+
+__attribute__((target("avx2,f16c"))) void
+snorm16avx2(short *dst, const float *src, size_t count, const float *scale,
+	const float *offset)
+{
+    const __m256 mask = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1,
+		0, -1, -1, -1));
+    const __m256 s = _mm256_set_ps(1.0f, scale[2], scale[1], scale[0],
+	    1.0f, scale[2], scale[1], scale[0]);
+    const __m256 o = _mm256_set_ps(0.0f, offset[2], offset[1], offset[0],
+	    0.0f, offset[2], offset[1], offset[0]);
+    const __m256 lo = _mm256_set1_ps(-1.0f), hi = _mm256_set1_ps(1.0f);
+    const __m256 k = _mm256_set1_ps(32767.0f);
+    __m256 v[2];
+    __m256i r[2];
+    size_t i;
+    int j;
+
+    /* Four vertices, the pack interleaves the two halves so put the
+     * 64-bit vertices back in order */
+    for (i = 0; i + 4 < count; i += 4) {
+	for (j = 0; j < 2; j++) {
+	    v[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(
+			_mm_loadu_ps(src + (i + j * 2) * 3)),
+		    _mm_loadu_ps(src + (i + j * 2) * 3 + 3), 1);
+	    v[j] = _mm256_div_ps(_mm256_sub_ps(v[j], o), s);
+	    v[j] = _mm256_min_ps(_mm256_max_ps(v[j], lo), hi);
+	    r[j] = _mm256_cvtps_epi32(_mm256_and_ps(_mm256_mul_ps(v[j], k),
+			mask));
+	}
+	_mm256_storeu_si256((__m256i *) (dst + i * 4), _mm256_permute4x64_epi64(
+		    _mm256_packs_epi32(r[0], r[1]), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    snorm16scalar(dst + i * 4, src + i * 3, count - i, scale, offset);
+}
+
+#endif /* QUANTX86 */
+
+const Kernel *
+getkernel(void)
+{
+    const Kernel *k;
+
+    /* Every thread picks the same one, racing here is harmless */
+    if (active)
+	return active;
+    for (k = kernels; !k->supported(); k++)
+	;
+
+    return active = k;
+}
+
+void
+quanthalf(unsigned short *dst, const float *src, size_t count)
+{
+    getkernel()->half(dst, src, count);
+}
+
+void
+quantsnorm16(short *dst, const float *src, size_t count, const float *scale,
+	const float *offset)
+{
+    getkernel()->snorm16(dst, src, count, scale, offset);
+}
+
+const char *
+quantkernel(void)
+{
+    return getkernel()->name;
+}
+
+double
+seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+float
+randomf(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return (*state >> 8) / 16777216.0f;
+}
+
+int
+quantbench(FILE *fp, size_t count)
+{
+    const Kernel *k;
+    uint32_t state = 0x9e3779b9;
+    float *src, scale[3], offset[3], lo[3], hi[3], f, d, halferr, snormerr;
+    unsigned short *ref, *out;
+    size_t i, bad;
+    double start, best[2], t;
+    int j, run, ok = 1;
+
+    src = (float *) malloc((count ? count : 1) * 3 * sizeof(float));
+    ref = (unsigned short *) malloc((count ? count : 1) * 4 *
+	    sizeof(unsigned short));
+    out = (unsigned short *) malloc((count ? count : 1) * 4 *
+	    sizeof(unsigned short));
+    if (!src || !ref || !out) {
+	free(src);
+	free(ref);
+	free(out);
+	return 0;
+    }
+
+    /* Magnitudes from half subnormals to past the largest half */
+    for (j = 0; j < 3; j++) {
+	lo[j] = INFINITY;
+	hi[j] = -INFINITY;
+    }
+    for (i = 0; i < count * 3; i++) {
+	src[i] = (2.0f * randomf(&state) - 1.0f) *
+	    ldexpf(1.0f, (int) (randomf(&state) * 44.0f) - 26);
+	if (src[i] < lo[i % 3])
+	    lo[i % 3] = src[i];
+	if (src[i] > hi[i % 3])
+	    hi[i % 3] = src[i];
+    }
+    for (j = 0; j < 3; j++) {
+	scale[j] = 0.5f * (hi[j] - lo[j]);
+	offset[j] = 0.5f * (hi[j] + lo[j]);
+	if (!(scale[j] > 0.0f))
+	    scale[j] = 1.0f;
+    }
+
+    /* Round trip error of the reference, within half a step */
+    halfscalar(ref, src, count);
+    for (i = 0, halferr = 0.0f; i < count * 3; i++) {
+	f = src[i];
+	if (fabsf(f) >= 65520.0f)
+	    continue;
+	d = fabsf(halftofloat(ref[i / 3 * 4 + i % 3]) - f);
+	d /= fabsf(f) < ldexpf(1.0f, -14) ? ldexpf(1.0f, -24) :
+	    ldexpf(fabsf(f), -10);
+	if (d > halferr)
+	    halferr = d;
+    }
+    snorm16scalar((short *) ref, src, count, scale, offset);
+    for (i = 0, snormerr = 0.0f; i < count * 3; i++) {
+	j = i % 3;
+	d = fabsf((short) ref[i / 3 * 4 + j] / 32767.0f * scale[j] +
+		offset[j] - src[i]) / (scale[j] / 32767.0f);
+	if (d > snormerr)
+	    snormerr = d;
+    }
+    fprintf(fp, "round trip error, steps: half %.3f, snorm16 %.3f\n",
+	    halferr, snormerr);
+    ok = halferr <= 0.5f && snormerr <= 0.51f;
+
+    for (k = kernels; k < kernels + sizeof(kernels) / sizeof(kernels[0]);
+	    k++) {
+	if (!k->supported()) {
+	    fprintf(fp, "%-8s unsupported\n", k->name);
+	    continue;
+	}
+	best[0] = best[1] = 0.0;
+	for (run = 0; run < BENCHRUNS; run++) {
+	    start = seconds();
+	    k->half(out, src, count);
+	    t = seconds() - start;
+	    if (!run || t < best[0])
+		best[0] = t;
+	}
+	halfscalar(ref, src, count);
+	for (i = 0, bad = 0; i < count * 4; i++)
+	    bad += out[i] != ref[i];
+	for (run = 0; run < BENCHRUNS; run++) {
+	    start = seconds();
+	    k->snorm16((short *) out, src, count, scale, offset);
+	    t = seconds() - start;
+	    if (!run || t < best[1])
+		best[1] = t;
+	}
+	snorm16scalar((short *) ref, src, count, scale, offset);
+	for (i = 0; i < count * 4; i++)
+	    bad += out[i] != ref[i];
+
+	/* Bytes read and written */
+	fprintf(fp, "%-8s half %8.1f MB/s, snorm16 %8.1f MB/s, %lu "
+		"mismatches%s\n", k->name,
+		best[0] > 0.0 ? count * 20.0 / best[0] / 1e6 : 0.0,
+		best[1] > 0.0 ? count * 20.0 / best[1] / 1e6 : 0.0,
+		(unsigned long) bad, k == getkernel() ? ", in use" : "");
+	if (bad)
+	    ok = 0;
+    }
+    free(src);
+    free(ref);
+    free(out);
+
+    return ok;
+}
@@ -0,0 +1,21 @@
+/* Conversions for compressed vertex data.
+ *
+ * The scalar functions convert one value. quanthalf() and quantsnorm16()
+ * convert count xyz positions into four 16-bit values a vertex, w zero, the
+ * layout of both the attribute and pulling buffers. snorm16 stores
+ * (p - offset) / scale. They run AVX2 with F16C, SSE2 or scalar kernels,
+ * the best the CPU supports, and every kernel gives the same bits except
+ * NaN payloads. quantbench() times each kernel, checks it against the
+ * scalar one and the round trip error of the result, and returns 0 on any
+ * failure. Requires stdio.h. */
+
+unsigned short floattohalf(float f);
+float halftofloat(unsigned short h);
+short floattosnorm16(float f);
+unsigned short floattounorm16(float f);
+unsigned int packsnorm10(const float *v);
+void quanthalf(unsigned short *dst, const float *src, size_t count);
+void quantsnorm16(short *dst, const float *src, size_t count,
+	const float *scale, const float *offset);
+const char *quantkernel(void);
+int quantbench(FILE *fp, size_t count);
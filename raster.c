@@ -0,0 +1,1176 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RASTERX86
+#include <immintrin.h>
+#endif /* __GNUC__ && x86 */
+
+#include "scene.h"
+#include "raster.h"
+
+/* Macros */
+#define TILESIZE  64    /* Pixels, a multiple of 8 */
+#define SUBPIXEL  16    /* Snapping steps per pixel */
+#define SIZEMAX   8192  /* Keeps the edge functions in a tile within 32 bits */
+#define THREADMAX 64
+#define CLIPMAX   9     /* Vertices of a triangle clipped by six planes */
+#define PLANES    5     /* Depth, 1/w and colour over w */
+#define BENCHRUNS 3     /* Best of, per kernel and thread count */
+#define RANGE(head, tail) ((uint64_t) (tail) << 32 | (head))
+
+/* Types */
+typedef struct {
+    float clip[4];      /* Clip space position */
+    float colour[3];
+} Vertex;
+
+typedef struct {
+    int32_t a[3], b[3]; /* Edge functions a x + b y + c >= 0 inside, */
+    int64_t c[3];       /* in subpixels at pixel centres */
+    int minx, miny, maxx, maxy; /* Pixel centres covered, inclusive */
+    float planes[PLANES][3]; /* p[0] + p[1] x + p[2] y in pixels */
+} Triangle;
+
+typedef struct {
+    int32_t e[3];       /* Edge functions at the first pixel */
+    int32_t dx[3], dy[3]; /* Steps per pixel, 0 for edges outside the rect */
+} Edges;
+
+typedef struct {
+    unsigned int tile, triangle;
+} Ref;
+
+typedef struct {
+    Triangle *triangles;
+    size_t count, size;
+    Ref *refs;          /* Tiles each triangle touches, in order */
+    size_t refcount, refsize;
+    unsigned int *bins; /* Triangles sorted by tile */
+    size_t binsize;
+    unsigned int *offsets; /* Where each tile's bin starts, tiles + 1 */
+} Batch;
+
+typedef struct {
+    uint64_t range;     /* Tiles not yet taken, RANGE(head, tail) */
+    char pad[56];       /* A cache line each */
+} Queue;
+
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    void (*tile)(const Triangle *t, int x0, int y0, int x1, int y1);
+} Kernel;
+
+typedef struct Work Work;
+struct Work {
+    void (*work)(Work *w);
+    const Scene *scene;
+    const float *viewproj;
+    const Kernel *kernel;
+    uint64_t first, last;   /* Triangles of the scene set up */
+    unsigned int index, threads;
+    Vertex *vertices;   /* Transformed vertices of the current object */
+    unsigned int *stamps, stamp, vertexsize;
+    unsigned int tiles, steals;
+    double busy;        /* Seconds spent drawing */
+    int ok;
+};
+
+/* Function prototypes */
+static double seconds(void);
+static unsigned int cpus(void);
+static void *runwork(void *arg);
+static int runthreads(Work *works, unsigned int count, void (*work)(Work *w));
+static void transform(Vertex *v, const Mesh *m, const Object *o,
+	const float *viewproj, unsigned int i);
+static unsigned int outcode(const Vertex *v);
+static int64_t snap(float f);
+static void lerp(Vertex *r, const Vertex *a, const Vertex *b, float t);
+static unsigned int clipplane(Vertex *dst, const Vertex *src,
+	unsigned int count, unsigned int plane);
+static void tilerect(const Triangle *t, unsigned int tile, int *x0, int *y0,
+	int *x1, int *y1);
+static int bin(Batch *b, const Triangle *t, unsigned int index);
+static int emit(Batch *b, const Vertex *v0, const Vertex *v1,
+	const Vertex *v2);
+static int clip(Batch *b, const Vertex *v0, const Vertex *v1,
+	const Vertex *v2);
+static int sortbins(Batch *b);
+static void setup(Work *w);
+static int edges(const Triangle *t, int x0, int y0, int x1, int y1,
+	Edges *e);
+static uint32_t shade(const Triangle *t, float fx, float fy);
+static int hasscalar(void);
+static void tilescalar(const Triangle *t, int x0, int y0, int x1, int y1);
+#ifdef RASTERX86
+static int hasavx2(void);
+static void tileavx2(const Triangle *t, int x0, int y0, int x1, int y1);
+#endif /* RASTERX86 */
+static const Kernel *getkernel(void);
+static void drawtile(const Kernel *kernel, unsigned int tile);
+static int pop(Queue *q, unsigned int *tile);
+static int steal(Work *w);
+static void drawtiles(Work *w);
+static int draw(const Scene *scene, const float *viewproj,
+	unsigned int threads, const Kernel *kernel, unsigned int *triangles);
+static double makespan(const double *times, unsigned int count,
+	unsigned int cores);
+
+/* Variables */
+static const Kernel kernels[] = {
+#ifdef RASTERX86
+    { "avx2", hasavx2, tileavx2 },
+#endif /* RASTERX86 */
+    { "scalar", hasscalar, tilescalar }
+};
+static const Kernel *active;
+static uint32_t *colours;   /* RGBA8, bottom row first like GL */
+static float *depths;
+static unsigned int width, height, pitch, tilecols, tilerows;
+static Batch batches[THREADMAX];
+static unsigned int batchcount;
+static Work works[THREADMAX];
+static Queue queues[THREADMAX];
+static double *tiletimes;   /* Seconds per tile, while benchmarking */
+static RasterStats last;
+
+/* Function implementations */
+
+double
+seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+unsigned int
+cpus(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (unsigned int) n : 1;
+#endif
+}
+
+void *
+runwork(void *arg)
+{
+    Work *w = (Work *) arg;
+
+    w->work(w);
+
+    return NULL;
+}
+
+int
+runthreads(Work *works, unsigned int count, void (*work)(Work *w))
+{
+    pthread_t threads[THREADMAX];
+    int started[THREADMAX];
+    unsigned int i;
+    int ok = 1;
+
+    /* The calling thread takes the first share */
+    for (i = 0; i < count; i++) {
+	works[i].work = work;
+	works[i].ok = 1;
+    }
+    for (i = 1; i < count; i++)
+	started[i] = !pthread_create(&threads[i], NULL, runwork, &works[i]);
+    work(&works[0]);
+    for (i = 1; i < count; i++) {
+	if (started[i])
+	    pthread_join(threads[i], NULL);
+	else
+	    work(&works[i]);
+    }
+    for (i = 0; i < count; i++)
+	ok = ok && works[i].ok;
+
+    return ok;
+}
+
+void
+transform(Vertex *v, const Mesh *m, const Object *o, const float *viewproj,
+	unsigned int i)
+{
+    const float *p = m->positions + i * 3;
+    float pos[3];
+    int j;
+
+    /* vertex.glsl, meshes here are always stored as float */
+    for (j = 0; j < 3; j++)
+	pos[j] = p[j] * o->transform[3] + o->transform[j];
+    for (j = 0; j < 4; j++)
+	v->clip[j] = viewproj[j] * pos[0] + viewproj[4 + j] * pos[1] +
+	    viewproj[8 + j] * pos[2] + viewproj[12 + j];
+    for (j = 0; j < 3; j++)
+	v->colour[j] = o->colour[j];
+}
+
+unsigned int
+outcode(const Vertex *v)
+{
+    unsigned int code = 0, j;
+
+    /* Bit 2 j below -w, bit 2 j + 1 above w */
+    for (j = 0; j < 3; j++) {
+	if (v->clip[j] < -v->clip[3])
+	    code |= 1u << (j * 2);
+	if (v->clip[j] > v->clip[3])
+	    code |= 2u << (j * 2);
+    }
+
+    return code;
+}
+
+int64_t
+snap(float f)
+{
+    int64_t i;
+
+    /* Nearest subpixel, floorf() is a library call without SSE4.1 */
+    f = f * SUBPIXEL + 0.5f;
+    i = (int64_t) f;
+
+    return i > f ? i - 1 : i;
+}
+
+void
+lerp(Vertex *r, const Vertex *a, const Vertex *b, float t)
+{
+    int j;
+
+    for (j = 0; j < 4; j++)
+	r->clip[j] = a->clip[j] + (b->clip[j] - a->clip[j]) * t;
+    for (j = 0; j < 3; j++)
+	r->colour[j] = a->colour[j] + (b->colour[j] - a->colour[j]) * t;
+}
+
+unsigned int
+clipplane(Vertex *dst, const Vertex *src, unsigned int count,
+	unsigned int plane)
+{
+    const Vertex *a, *b;
+    float da, db, s = plane & 1 ? -1.0f : 1.0f;
+    unsigned int i, n = 0, axis = plane / 2;
+
+    /* Sutherland-Hodgman, always from the inside vertex so triangles sharing
+     * a clipped edge agree on where it ends */
+    for (i = 0; i < count; i++) {
+	a = &src[i];
+	b = &src[(i + 1) % count];
+	da = a->clip[3] + s * a->clip[axis];
+	db = b->clip[3] + s * b->clip[axis];
+	if (da >= 0.0f)
+	    dst[n++] = *a;
+	if (da >= 0.0f && db < 0.0f)
+	    lerp(&dst[n++], a, b, da / (da - db));
+	else if (da < 0.0f && db >= 0.0f)
+	    lerp(&dst[n++], b, a, db / (db - da));
+    }
+
+    return n;
+}
+
+void
+tilerect(const Triangle *t, unsigned int tile, int *x0, int *y0, int *x1,
+	int *y1)
+{
+    int tx = (int) (tile % tilecols) * TILESIZE;
+    int ty = (int) (tile / tilecols) * TILESIZE;
+
+    /* The triangle's pixels within the tile, x1 and y1 exclusive */
+    *x0 = tx > t->minx ? tx : t->minx;
+    *y0 = ty > t->miny ? ty : t->miny;
+    *x1 = tx + TILESIZE <= t->maxx ? tx + TILESIZE : t->maxx + 1;
+    *y1 = ty + TILESIZE <= t->maxy ? ty + TILESIZE : t->maxy + 1;
+}
+
+int
+bin(Batch *b, const Triangle *t, unsigned int index)
+{
+    Edges e;
+    Ref *grown;
+    unsigned int r, c, r0, r1, c0, c1, tile;
+    size_t size;
+    int x0, y0, x1, y1;
+
+    r0 = t->miny / TILESIZE;
+    r1 = t->maxy / TILESIZE;
+    c0 = t->minx / TILESIZE;
+    c1 = t->maxx / TILESIZE;
+    for (r = r0; r <= r1; r++) {
+	for (c = c0; c <= c1; c++) {
+	    /* Large triangles skip the tiles of their bounds they miss */
+	    tile = r * tilecols + c;
+	    if (r0 != r1 || c0 != c1) {
+		tilerect(t, tile, &x0, &y0, &x1, &y1);
+		if (!edges(t, x0, y0, x1, y1, &e))
+		    continue;
+	    }
+	    if (b->refcount == b->refsize) {
+		size = b->refsize ? b->refsize * 2 : 4096;
+		if (!(grown = (Ref *) realloc(b->refs, size * sizeof(Ref))))
+		    return 0;
+		b->refs = grown;
+		b->refsize = size;
+	    }
+	    b->refs[b->refcount].tile = tile;
+	    b->refs[b->refcount++].triangle = index;
+	}
+    }
+
+    return 1;
+}
+
+int
+emit(Batch *b, const Vertex *v0, const Vertex *v1, const Vertex *v2)
+{
+    const Vertex *v[3];
+    Triangle *t, *grown;
+    float iw[3], sx[3], sy[3], attrib[PLANES][3], inv, d1, d2;
+    int64_t x[3], y[3], area, minx, miny, maxx, maxy, a, e;
+    size_t size;
+    int order[3], i, j, k, p, q;
+
+    v[0] = v0;
+    v[1] = v1;
+    v[2] = v2;
+    for (i = 0; i < 3; i++) {
+	iw[i] = 1.0f / v[i]->clip[3];
+	x[i] = snap(((v[i]->clip[0] * iw[i]) * 0.5f + 0.5f) * width);
+	y[i] = snap(((v[i]->clip[1] * iw[i]) * 0.5f + 0.5f) * height);
+    }
+
+    /* Counter-clockwise from here on, both faces are drawn like the GL
+     * paths */
+    area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (!area)
+	return 1;
+    i = area < 0 ? 2 : 1;
+    j = 3 - i;
+    if (area < 0)
+	area = -area;
+
+    /* Pixel centres sit at 8 subpixels, tiny triangles often miss them */
+    minx = miny = INT64_MAX;
+    maxx = maxy = INT64_MIN;
+    for (k = 0; k < 3; k++) {
+	minx = x[k] < minx ? x[k] : minx;
+	miny = y[k] < miny ? y[k] : miny;
+	maxx = x[k] > maxx ? x[k] : maxx;
+	maxy = y[k] > maxy ? y[k] : maxy;
+    }
+    minx = minx > SUBPIXEL / 2 ? (minx - SUBPIXEL / 2 + SUBPIXEL - 1) /
+	SUBPIXEL : 0;
+    miny = miny > SUBPIXEL / 2 ? (miny - SUBPIXEL / 2 + SUBPIXEL - 1) /
+	SUBPIXEL : 0;
+    maxx = maxx >= SUBPIXEL / 2 ? (maxx - SUBPIXEL / 2) / SUBPIXEL : -1;
+    maxy = maxy >= SUBPIXEL / 2 ? (maxy - SUBPIXEL / 2) / SUBPIXEL : -1;
+    maxx = maxx < width ? maxx : width - 1;
+    maxy = maxy < height ? maxy : height - 1;
+    if (minx > maxx || miny > maxy)
+	return 1;
+
+    if (b->count == b->size) {
+	size = b->size ? b->size * 2 : 4096;
+	if (!(grown = (Triangle *) realloc(b->triangles,
+			size * sizeof(Triangle))))
+	    return 0;
+	b->triangles = grown;
+	b->size = size;
+    }
+    t = &b->triangles[b->count++];
+    t->minx = (int) minx;
+    t->miny = (int) miny;
+    t->maxx = (int) maxx;
+    t->maxy = (int) maxy;
+
+    /* Vertices 0, i and j in order */
+    for (k = 0; k < 3; k++) {
+	sx[k] = (float) x[k] / SUBPIXEL;
+	sy[k] = (float) y[k] / SUBPIXEL;
+	attrib[0][k] = (v[k]->clip[2] * iw[k]) * 0.5f + 0.5f;
+	attrib[1][k] = iw[k];
+	attrib[2][k] = v[k]->colour[0] * iw[k];
+	attrib[3][k] = v[k]->colour[1] * iw[k];
+	attrib[4][k] = v[k]->colour[2] * iw[k];
+    }
+    order[0] = 0;
+    order[1] = i;
+    order[2] = j;
+    for (k = 0; k < 3; k++) {
+	p = order[k];
+	q = order[(k + 1) % 3];
+	a = y[p] - y[q];
+	e = x[q] - x[p];
+
+	/* Top-left rule with y up, the others move in by a subpixel */
+	t->a[k] = (int32_t) a;
+	t->b[k] = (int32_t) e;
+	t->c[k] = -(a * x[p] + e * y[p]);
+	if (!(a > 0 || (a == 0 && e < 0)))
+	    t->c[k]--;
+    }
+
+    /* Attributes as planes over the snapped positions */
+    inv = (float) (SUBPIXEL * SUBPIXEL) / area;
+    for (k = 0; k < PLANES; k++) {
+	d1 = attrib[k][i] - attrib[k][0];
+	d2 = attrib[k][j] - attrib[k][0];
+	t->planes[k][1] = (d1 * (sy[j] - sy[0]) - d2 * (sy[i] - sy[0])) * inv;
+	t->planes[k][2] = (d2 * (sx[i] - sx[0]) - d1 * (sx[j] - sx[0])) * inv;
+	t->planes[k][0] = attrib[k][0] - t->planes[k][1] * sx[0] -
+	    t->planes[k][2] * sy[0];
+    }
+
+    return bin(b, t, (unsigned int) (b->count - 1));
+}
+
+int
+clip(Batch *b, const Vertex *v0, const Vertex *v1, const Vertex *v2)
+{
+    Vertex polygon[2][CLIPMAX];
+    unsigned int c0 = outcode(v0), c1 = outcode(v1), c2 = outcode(v2), plane,
+		 n = 3, i, cur = 0;
+
+    if (c0 & c1 & c2)
+	return 1;
+    if (!(c0 | c1 | c2))
+	return emit(b, v0, v1, v2);
+
+    polygon[0][0] = *v0;
+    polygon[0][1] = *v1;
+    polygon[0][2] = *v2;
+    for (plane = 0; plane < 6 && n >= 3; plane++) {
+	if (!((c0 | c1 | c2) & (1u << plane)))
+	    continue;
+	n = clipplane(polygon[!cur], polygon[cur], n, plane);
+	cur = !cur;
+    }
+    for (i = 1; i + 1 < n; i++)
+	if (!emit(b, &polygon[cur][0], &polygon[cur][i], &polygon[cur][i + 1]))
+	    return 0;
+
+    return 1;
+}
+
+int
+sortbins(Batch *b)
+{
+    unsigned int i, tiles = tilecols * tilerows, sum, n;
+    size_t j;
+    void *grown;
+
+    /* Counting sort, stable so each bin stays in submission order */
+    if (b->refcount > b->binsize) {
+	if (!(grown = realloc(b->bins, b->refcount * sizeof(unsigned int))))
+	    return 0;
+	b->bins = (unsigned int *) grown;
+	b->binsize = b->refcount;
+    }
+    memset(b->offsets, 0, (tiles + 1) * sizeof(unsigned int));
+    for (j = 0; j < b->refcount; j++)
+	b->offsets[b->refs[j].tile]++;
+    for (i = 0, sum = 0; i <= tiles; i++) {
+	n = b->offsets[i];
+	b->offsets[i] = sum;
+	sum += n;
+    }
+    for (j = 0; j < b->refcount; j++)
+	b->bins[b->offsets[b->refs[j].tile]++] = b->refs[j].triangle;
+    for (i = tiles; i > 0; i--)
+	b->offsets[i] = b->offsets[i - 1];
+    b->offsets[0] = 0;
+
+    return 1;
+}
+
+void
+setup(Work *w)
+{
+    const Scene *scene = w->scene;
+    const Object *o;
+    const Mesh *m;
+    Batch *b = &batches[w->index];
+    const unsigned int *idx;
+    uint64_t start = 0, count, i;
+    unsigned int obj, k, v;
+    void *grown;
+
+    b->count = b->refcount = 0;
+    for (obj = 0; obj < scene->objectcount && start < w->last; obj++) {
+	o = &scene->objects[obj];
+	m = &scene->meshes[o->mesh];
+	count = m->indexcount / 3;
+	if (start + count <= w->first) {
+	    start += count;
+	    continue;
+	}
+
+	/* Each vertex is transformed once per object, on first use */
+	if (m->vertexcount > w->vertexsize) {
+	    if (!(grown = realloc(w->vertices, m->vertexcount *
+			    sizeof(Vertex)))) {
+		w->ok = 0;
+		return;
+	    }
+	    w->vertices = (Vertex *) grown;
+	    if (!(grown = realloc(w->stamps, m->vertexcount *
+			    sizeof(unsigned int)))) {
+		w->ok = 0;
+		return;
+	    }
+	    w->stamps = (unsigned int *) grown;
+	    memset(w->stamps, 0, m->vertexcount * sizeof(unsigned int));
+	    w->vertexsize = m->vertexcount;
+	    w->stamp = 0;
+	}
+	if (!++w->stamp) {
+	    memset(w->stamps, 0, w->vertexsize * sizeof(unsigned int));
+	    w->stamp = 1;
+	}
+
+	i = w->first > start ? w->first - start : 0;
+	for (; i < count && start + i < w->last; i++) {
+	    idx = m->indices + i * 3;
+	    for (k = 0; k < 3; k++) {
+		v = idx[k];
+		if (w->stamps[v] != w->stamp) {
+		    transform(&w->vertices[v], m, o, w->viewproj, v);
+		    w->stamps[v] = w->stamp;
+		}
+	    }
+	    if (!clip(b, &w->vertices[idx[0]], &w->vertices[idx[1]],
+			&w->vertices[idx[2]])) {
+		w->ok = 0;
+		return;
+	    }
+	}
+	start += count;
+    }
+    if (!sortbins(b))
+	w->ok = 0;
+}
+
+int
+edges(const Triangle *t, int x0, int y0, int x1, int y1, Edges *e)
+{
+    int64_t px[2], py[2], v, lo, hi;
+    int k, c;
+
+    /* Corners of the rect in the 64-bit edge functions, edges wholly
+     * outside reject it, those wholly inside are left out */
+    px[0] = (int64_t) x0 * SUBPIXEL + SUBPIXEL / 2;
+    px[1] = (int64_t) (x1 - 1) * SUBPIXEL + SUBPIXEL / 2;
+    py[0] = (int64_t) y0 * SUBPIXEL + SUBPIXEL / 2;
+    py[1] = (int64_t) (y1 - 1) * SUBPIXEL + SUBPIXEL / 2;
+    for (k = 0; k < 3; k++) {
+	lo = INT64_MAX;
+	hi = INT64_MIN;
+	for (c = 0; c < 4; c++) {
+	    v = t->a[k] * px[c & 1] + t->b[k] * py[c >> 1] + t->c[k];
+	    lo = v < lo ? v : lo;
+	    hi = v > hi ? v : hi;
+	}
+	if (hi < 0)
+	    return 0;
+	if (lo >= 0) {
+	    e->e[k] = e->dx[k] = e->dy[k] = 0;
+	} else {
+	    e->e[k] = (int32_t) (t->a[k] * px[0] + t->b[k] * py[0] + t->c[k]);
+	    e->dx[k] = t->a[k] * SUBPIXEL;
+	    e->dy[k] = t->b[k] * SUBPIXEL;
+	}
+    }
+
+    return 1;
+}
+
+uint32_t
+shade(const Triangle *t, float fx, float fy)
+{
+    const float (*p)[3] = t->planes;
+    float w, c;
+    uint32_t rgba = 0xff000000u;
+    int k;
+
+    /* Same operations in the same order as tileavx2() */
+    w = 1.0f / (p[1][0] + p[1][1] * fx + p[1][2] * fy);
+    for (k = 0; k < 3; k++) {
+	c = (p[2 + k][0] + p[2 + k][1] * fx + p[2 + k][2] * fy) * w;
+	c = c > 0.0f ? c : 0.0f;
+	c = c < 1.0f ? c : 1.0f;
+	rgba |= (uint32_t) (c * 255.0f + 0.5f) << (k * 8);
+    }
+
+    return rgba;
+}
+
+int
+hasscalar(void)
+{
+    return 1;
+}
+
+void
+tilescalar(const Triangle *t, int x0, int y0, int x1, int y1)
+{
+    Edges e;
+    int32_t row[3], v[3];
+    float fx, fy, z, *depth;
+    int x, y, k;
+
+    if (!edges(t, x0, y0, x1, y1, &e))
+	return;
+    for (k = 0; k < 3; k++)
+	row[k] = e.e[k];
+    for (y = y0; y < y1; y++) {
+	fy = (float) y + 0.5f;
+	depth = depths + (size_t) y * pitch;
+	for (k = 0; k < 3; k++)
+	    v[k] = row[k];
+	for (x = x0; x < x1; x++) {
+	    if ((v[0] | v[1] | v[2]) >= 0) {
+		fx = (float) x + 0.5f;
+		z = t->planes[0][0] + t->planes[0][1] * fx +
+		    t->planes[0][2] * fy;
+		if (z < depth[x]) {
+		    depth[x] = z;
+		    colours[(size_t) y * pitch + x] = shade(t, fx, fy);
+		}
+	    }
+	    for (k = 0; k < 3; k++)
+		v[k] += e.dx[k];
+	}
+	for (k = 0; k < 3; k++)
+	    row[k] += e.dy[k];
+    }
+}
+
+#ifdef RASTERX86
+
+int
+hasavx2(void)
+{
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("avx2");
+}
+
+/* No FMA, so the results round exactly like tilescalar() */
+__attribute__((target("avx2")))
+void
+tileavx2(const Triangle *t, int x0, int y0, int x1, int y1)
+{
+    const float (*p)[3] = t->planes;
+    Edges e;
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i row[3], v[3], step[3], xs, mask, rgba, c8;
+    __m256 fx, fy, z, old, w, c, zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+    __m256 scale = _mm256_set1_ps(255.0f);
+    int x, y, k, bx0 = x0 & ~7;
+    size_t i;
+
+    if (!edges(t, x0, y0, x1, y1, &e))
+	return;
+    for (k = 0; k < 3; k++) {
+	row[k] = _mm256_add_epi32(_mm256_set1_epi32(e.e[k] -
+		    (x0 - bx0) * e.dx[k]), _mm256_mullo_epi32(lane,
+			_mm256_set1_epi32(e.dx[k])));
+	step[k] = _mm256_set1_epi32(e.dx[k] * 8);
+    }
+    for (y = y0; y < y1; y++) {
+	fy = _mm256_set1_ps((float) y + 0.5f);
+	for (k = 0; k < 3; k++)
+	    v[k] = row[k];
+	for (x = bx0; x < x1; x += 8) {
+	    /* Inside every edge and the rect */
+	    xs = _mm256_add_epi32(_mm256_set1_epi32(x), lane);
+	    mask = _mm256_and_si256(_mm256_cmpgt_epi32(xs,
+			_mm256_set1_epi32(x0 - 1)), _mm256_cmpgt_epi32(
+			_mm256_set1_epi32(x1), xs));
+	    mask = _mm256_andnot_si256(_mm256_srai_epi32(_mm256_or_si256(
+			    _mm256_or_si256(v[0], v[1]), v[2]), 31), mask);
+	    for (k = 0; k < 3; k++)
+		v[k] = _mm256_add_epi32(v[k], step[k]);
+	    if (!_mm256_movemask_epi8(mask))
+		continue;
+
+	    i = (size_t) y * pitch + x;
+	    fx = _mm256_add_ps(_mm256_cvtepi32_ps(xs), half);
+	    z = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(p[0][0]),
+			_mm256_mul_ps(_mm256_set1_ps(p[0][1]), fx)),
+		    _mm256_mul_ps(_mm256_set1_ps(p[0][2]), fy));
+	    old = _mm256_loadu_ps(depths + i);
+	    mask = _mm256_and_si256(mask, _mm256_castps_si256(_mm256_cmp_ps(z,
+			    old, _CMP_LT_OQ)));
+	    if (!_mm256_movemask_epi8(mask))
+		continue;
+
+	    w = _mm256_div_ps(one, _mm256_add_ps(_mm256_add_ps(
+			    _mm256_set1_ps(p[1][0]), _mm256_mul_ps(
+				_mm256_set1_ps(p[1][1]), fx)), _mm256_mul_ps(
+				_mm256_set1_ps(p[1][2]), fy)));
+	    rgba = _mm256_set1_epi32((int) 0xff000000u);
+	    for (k = 0; k < 3; k++) {
+		c = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(
+				_mm256_set1_ps(p[2 + k][0]), _mm256_mul_ps(
+				    _mm256_set1_ps(p[2 + k][1]), fx)),
+			    _mm256_mul_ps(_mm256_set1_ps(p[2 + k][2]), fy)), w);
+		c = _mm256_min_ps(_mm256_max_ps(c, zero), one);
+		c8 = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(c, scale),
+			    half));
+		rgba = _mm256_or_si256(rgba, _mm256_slli_epi32(c8, k * 8));
+	    }
+	    _mm256_maskstore_ps(depths + i, mask, z);
+	    _mm256_maskstore_epi32((int *) (colours + i), mask, rgba);
+	}
+	for (k = 0; k < 3; k++)
+	    row[k] = _mm256_add_epi32(row[k], _mm256_set1_epi32(e.dy[k]));
+    }
+}
+
+#endif /* RASTERX86 */
+
+const Kernel *
+getkernel(void)
+{
+    const Kernel *k;
+
+    if (active)
+	return active;
+    for (k = kernels; !k->supported(); k++)
+	;
+
+    return active = k;
+}
+
+void
+drawtile(const Kernel *kernel, unsigned int tile)
+{
+    const Batch *b;
+    const Triangle *t;
+    unsigned int i, k;
+    int x0, y0, x1, y1;
+
+    /* Batches follow the scene, so this is submission order and the depth
+     * test breaks ties the same whatever the thread count */
+    for (i = 0; i < batchcount; i++) {
+	b = &batches[i];
+	for (k = b->offsets[tile]; k < b->offsets[tile + 1]; k++) {
+	    t = &b->triangles[b->bins[k]];
+	    tilerect(t, tile, &x0, &y0, &x1, &y1);
+	    kernel->tile(t, x0, y0, x1, y1);
+	}
+    }
+}
+
+int
+pop(Queue *q, unsigned int *tile)
+{
+    uint64_t range = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE);
+    uint32_t head, tail;
+
+    /* The owner takes from the head */
+    do {
+	head = (uint32_t) range;
+	tail = (uint32_t) (range >> 32);
+	if (head >= tail)
+	    return 0;
+    } while (!__atomic_compare_exchange_n(&q->range, &range,
+		RANGE(head + 1, tail), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    *tile = head;
+
+    return 1;
+}
+
+int
+steal(Work *w)
+{
+    Queue *q;
+    uint64_t range;
+    uint32_t head, tail, take;
+    unsigned int i;
+
+    /* Thieves take the back half, the owner keeps the tiles it is near */
+    for (i = 1; i < w->threads; i++) {
+	q = &queues[(w->index + i) % w->threads];
+	range = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE);
+	for (;;) {
+	    head = (uint32_t) range;
+	    tail = (uint32_t) (range >> 32);
+	    if (head >= tail)
+		break;
+	    take = (tail - head + 1) / 2;
+	    if (__atomic_compare_exchange_n(&q->range, &range,
+			RANGE(head, tail - take), 0, __ATOMIC_ACQ_REL,
+			__ATOMIC_ACQUIRE)) {
+		/* Nobody touches an empty queue, a plain handover is safe */
+		__atomic_store_n(&queues[w->index].range,
+			RANGE(tail - take, tail), __ATOMIC_RELEASE);
+		w->steals++;
+		return 1;
+	    }
+	}
+    }
+
+    return 0;
+}
+
+void
+drawtiles(Work *w)
+{
+    Queue *q = &queues[w->index];
+    unsigned int tile;
+    double start = seconds(), t;
+
+    w->tiles = w->steals = 0;
+    while (pop(q, &tile) || (steal(w) && pop(q, &tile))) {
+	if (tiletimes) {
+	    t = seconds();
+	    drawtile(w->kernel, tile);
+	    tiletimes[tile] = seconds() - t;
+	} else {
+	    drawtile(w->kernel, tile);
+	}
+	w->tiles++;
+    }
+    w->busy = seconds() - start;
+}
+
+int
+draw(const Scene *scene, const float *viewproj, unsigned int threads,
+	const Kernel *kernel, unsigned int *triangles)
+{
+    uint64_t total = 0;
+    unsigned int i, k, n, tiles = tilecols * tilerows;
+    size_t count;
+    double start;
+
+    if (!threads)
+	threads = cpus();
+    if (threads > THREADMAX)
+	threads = THREADMAX;
+    for (i = 0; i < scene->objectcount; i++)
+	total += scene->meshes[scene->objects[i].mesh].indexcount / 3;
+
+    /* Set up, contiguous ranges of triangles in scene order */
+    for (i = 0; i < threads; i++) {
+	works[i].scene = scene;
+	works[i].viewproj = viewproj;
+	works[i].kernel = kernel;
+	works[i].first = total * i / threads;
+	works[i].last = total * (i + 1) / threads;
+	works[i].index = i;
+	works[i].threads = threads;
+    }
+    batchcount = threads;
+    start = seconds();
+    if (!runthreads(works, threads, setup))
+	return 0;
+    last.setup = seconds() - start;
+
+    /* Then draw, rows of tiles dealt out in blocks, at most a thread each */
+    n = tiles < threads ? tiles : threads;
+    for (i = 0; i < n; i++) {
+	works[i].threads = n;
+	queues[i].range = RANGE(tiles * i / n, tiles * (i + 1) / n);
+    }
+    start = seconds();
+    if (!runthreads(works, n, drawtiles))
+	return 0;
+    last.draw = seconds() - start;
+
+    last.threads = n;
+    last.tiles = tiles;
+    last.binned = last.fullest = last.steals = 0;
+    last.busiest = last.mean = 0.0;
+    for (i = 0; i < n; i++) {
+	last.steals += works[i].steals;
+	last.busiest = works[i].busy > last.busiest ? works[i].busy :
+	    last.busiest;
+	last.mean += works[i].busy / n;
+    }
+    for (k = 0; k < tiles; k++) {
+	for (i = 0, count = 0; i < batchcount; i++)
+	    count += batches[i].offsets[k + 1] - batches[i].offsets[k];
+	last.binned += (unsigned int) count;
+	last.fullest = count > last.fullest ? (unsigned int) count :
+	    last.fullest;
+    }
+    for (i = 0, count = 0; i < batchcount; i++)
+	count += batches[i].count;
+    if (triangles)
+	*triangles = (unsigned int) count;
+
+    return 1;
+}
+
+double
+makespan(const double *times, unsigned int count, unsigned int cores)
+{
+    double avail[RASTERCORES], end = 0.0;
+    unsigned int i, c, first;
+
+    /* Each tile in turn goes to the first core to come free, which is
+     * where stealing ends up */
+    for (c = 0; c < cores; c++)
+	avail[c] = 0.0;
+    for (i = 0; i < count; i++) {
+	for (c = 1, first = 0; c < cores; c++)
+	    first = avail[c] < avail[first] ? c : first;
+	avail[first] += times[i];
+	end = avail[first] > end ? avail[first] : end;
+    }
+
+    return end;
+}
+
+int
+rasterinit(unsigned int w, unsigned int h)
+{
+    size_t size;
+    unsigned int i;
+
+    rasterterm();
+    if (!w || !h || w > SIZEMAX || h > SIZEMAX)
+	return 0;
+
+    /* Padded to whole tiles so the kernels never check the edges */
+    tilecols = (w + TILESIZE - 1) / TILESIZE;
+    tilerows = (h + TILESIZE - 1) / TILESIZE;
+    pitch = tilecols * TILESIZE;
+    size = (size_t) pitch * tilerows * TILESIZE;
+    colours = (uint32_t *) malloc(size * sizeof(uint32_t));
+    depths = (float *) malloc(size * sizeof(float));
+    if (!colours || !depths) {
+	rasterterm();
+	return 0;
+    }
+    for (i = 0; i < THREADMAX; i++) {
+	if (!(batches[i].offsets = (unsigned int *) calloc(tilecols *
+			tilerows + 1, sizeof(unsigned int)))) {
+	    rasterterm();
+	    return 0;
+	}
+    }
+    width = w;
+    height = h;
+
+    return 1;
+}
+
+void
+rasterclear(const float colour[4])
+{
+    size_t i, size = (size_t) pitch * tilerows * TILESIZE;
+    uint32_t rgba = 0;
+    float c;
+    int k;
+
+    for (k = 0; k < 4; k++) {
+	c = colour[k] > 0.0f ? colour[k] : 0.0f;
+	c = c < 1.0f ? c : 1.0f;
+	rgba |= (uint32_t) (c * 255.0f + 0.5f) << (k * 8);
+    }
+    for (i = 0; i < size; i++) {
+	colours[i] = rgba;
+	depths[i] = 1.0f;
+    }
+}
+
+int
+rasterdraw(const Scene *scene, const float viewproj[16], unsigned int threads,
+	unsigned int *triangles)
+{
+    return draw(scene, viewproj, threads, getkernel(), triangles);
+}
+
+void
+rasterstats(RasterStats *stats)
+{
+    *stats = last;
+}
+
+int
+rasterwrite(const char *filename)
+{
+    FILE *fp;
+    unsigned char *line;
+    uint32_t c;
+    unsigned int x, y;
+    int ok;
+
+    if (!(line = (unsigned char *) malloc(width * 3)))
+	return 0;
+    if (!(fp = fopen(filename, "wb"))) {
+	free(line);
+	return 0;
+    }
+
+    /* Top row first */
+    ok = fprintf(fp, "P6\n%u %u\n255\n", width, height) > 0;
+    for (y = height; ok && y-- > 0;) {
+	for (x = 0; x < width; x++) {
+	    c = colours[(size_t) y * pitch + x];
+	    line[x * 3] = c & 0xff;
+	    line[x * 3 + 1] = (c >> 8) & 0xff;
+	    line[x * 3 + 2] = (c >> 16) & 0xff;
+	}
+	ok = fwrite(line, 3, width, fp) == width;
+    }
+    free(line);
+
+    return fclose(fp) == 0 && ok;
+}
+
+const char *
+rasterkernel(void)
+{
+    return getkernel()->name;
+}
+
+int
+rasterbench(FILE *fp, const Scene *scene, const float viewproj[16],
+	unsigned int threads)
+{
+    const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const Kernel *k;
+    uint32_t *refcolours = NULL;
+    float *refdepths = NULL;
+    size_t size = (size_t) pitch * tilerows * TILESIZE;
+    RasterStats stats;
+    uint64_t total = 0;
+    double start, best, t, setuptime, one;
+    unsigned int i, n, tiles = tilecols * tilerows, drawn = 0;
+    int run, same, ok = 1;
+
+    if (!threads)
+	threads = cpus();
+    if (threads > THREADMAX)
+	threads = THREADMAX;
+    for (i = 0; i < scene->objectcount; i++)
+	total += scene->meshes[scene->objects[i].mesh].indexcount / 3;
+    refcolours = (uint32_t *) malloc(size * sizeof(uint32_t));
+    refdepths = (float *) malloc(size * sizeof(float));
+    if (!refcolours || !refdepths) {
+	free(refcolours);
+	free(refdepths);
+	return 0;
+    }
+
+    /* Doubling up to the thread count per kernel, every image must match
+     * the first */
+    for (k = kernels; ok && k < kernels + sizeof(kernels) /
+	    sizeof(kernels[0]); k++) {
+	if (!k->supported()) {
+	    fprintf(fp, "%-8s unsupported\n", k->name);
+	    continue;
+	}
+	for (n = 1; ok; n = n * 2 < threads ? n * 2 : threads) {
+	    for (run = 0, best = 0.0, same = 1; run < BENCHRUNS; run++) {
+		rasterclear(black);
+		start = seconds();
+		if (!draw(scene, viewproj, n, k, &drawn)) {
+		    ok = 0;
+		    break;
+		}
+		t = seconds() - start;
+		if (!run || t < best) {
+		    best = t;
+		    stats = last;
+		}
+		if (k == kernels && n == 1 && !run) {
+		    memcpy(refcolours, colours, size * sizeof(uint32_t));
+		    memcpy(refdepths, depths, size * sizeof(float));
+		    fprintf(fp, "%ux%u, %lu triangles, %u set up\n", width,
+			    height, (unsigned long) total, drawn);
+		}
+		same = same && !memcmp(colours, refcolours, size *
+			sizeof(uint32_t)) && !memcmp(depths, refdepths, size *
+			sizeof(float));
+	    }
+	    if (!ok)
+		break;
+	    fprintf(fp, "%-8s %3u threads %9.1f Mtri/s %8.3f ms, setup %.3f, "
+		    "draw %.3f, imbalance %.2f, %u steals%s\n", k->name, n,
+		    total / best / 1e6, best * 1e3, stats.setup * 1e3,
+		    stats.draw * 1e3, stats.mean > 0.0 ? stats.busiest /
+		    stats.mean : 1.0, stats.steals, same ? "" : " MISMATCH");
+	    ok = same;
+	    if (n == threads)
+		break;
+	}
+    }
+    free(refcolours);
+    free(refdepths);
+
+    /* Cores this machine may not have, projected from one thread's time per
+     * tile with setup split evenly */
+    if (ok && (tiletimes = (double *) malloc(tiles * sizeof(double)))) {
+	rasterclear(black);
+	ok = draw(scene, viewproj, 1, getkernel(), NULL);
+	setuptime = last.setup;
+	fprintf(fp, "%u tiles, %.1f triangles a tile, %u in the fullest\n",
+		tiles, (double) last.binned / tiles, last.fullest);
+	one = setuptime + makespan(tiletimes, tiles, 1);
+	for (n = 1; ok && n <= RASTERCORES; n *= 2) {
+	    t = setuptime / n + makespan(tiletimes, tiles, n);
+	    fprintf(fp, "%3u cores %8.3f ms projected, %5.1fx\n", n, t * 1e3,
+		    one / t);
+	}
+	free(tiletimes);
+	tiletimes = NULL;
+    }
+
+    return ok;
+}
+
+void
+rasterterm(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < THREADMAX; i++) {
+	free(batches[i].triangles);
+	free(batches[i].refs);
+	free(batches[i].bins);
+	free(batches[i].offsets);
+	memset(&batches[i], 0, sizeof(batches[i]));
+	free(works[i].vertices);
+	free(works[i].stamps);
+	works[i].vertices = NULL;
+	works[i].stamps = NULL;
+	works[i].vertexsize = works[i].stamp = 0;
+    }
+    batchcount = 0;
+    free(colours);
+    free(depths);
+    colours = NULL;
+    depths = NULL;
+    width = height = pitch = tilecols = tilerows = 0;
+}
@@ -0,0 +1,42 @@
+/* Software rasteriser.
+ *
+ * Draws a scene on the CPU the way vertex.glsl and fragment.glsl do on the
+ * GPU: the same transform and headlight colour, clipping to the view volume,
+ * a less than depth test and perspective correct colours, two sided. Vertices
+ * snap to 1/16 pixel and pixel centres follow the top-left fill rule, so the
+ * image only depends on the scene, never on the thread count or kernel.
+ * Triangles are set up in parallel over ranges of the scene and each thread
+ * sorts its own into bins per 64 by 64 pixel tile, so binning takes no locks.
+ * The tiles are then dealt out to the threads in blocks and a thread that
+ * runs out steals half of another's remaining tiles. A tile walks the bins
+ * in thread order, which keeps the triangles in submission order. Within a
+ * tile the edge functions are evaluated 8 pixels at a time with AVX2 where
+ * the CPU has it. rasterdraw() gives the triangles set up, threads 0
+ * meaning one per CPU, and rasterstats() how evenly the last draw was
+ * spread. rasterwrite() saves a binary PPM. rasterbench() reports the
+ * throughput of every kernel and thread count, checks each image matches
+ * the first exactly, then projects the scaling up to RASTERCORES cores from
+ * one thread's time per tile. The others return 0 on failure. Requires
+ * scene.h and stdio.h. */
+
+#define RASTERCORES 64
+
+typedef struct {
+    unsigned int threads, tiles;
+    unsigned int binned;    /* Triangles in all bins, shared ones in each */
+    unsigned int fullest;   /* Triangles in the fullest bin */
+    unsigned int steals;
+    double setup, draw;     /* Seconds of each phase */
+    double busiest, mean;   /* Drawing seconds per thread */
+} RasterStats;
+
+int rasterinit(unsigned int width, unsigned int height);
+void rasterclear(const float colour[4]);
+int rasterdraw(const Scene *scene, const float viewproj[16],
+	unsigned int threads, unsigned int *triangles);
+void rasterstats(RasterStats *stats);
+int rasterwrite(const char *filename);
+const char *rasterkernel(void);
+int rasterbench(FILE *fp, const Scene *scene, const float viewproj[16],
+	unsigned int threads);
+void rasterterm(void);
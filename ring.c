@@ -0,0 +1,125 @@
+#include <stddef.h>
+#include <stdio.h>
+
+#include "glad.h"
+#include "ring.h"
+#include "vram.h"
+
+/* Macros */
+#define RINGFRAMES 3    /* Frames the CPU may run ahead of the GPU */
+
+/* Function prototypes */
+static void waitregion(void);
+
+/* Variables */
+static GLuint buffer;
+static unsigned char *map;
+static GLsync fences[RINGFRAMES];
+static size_t regionsize, head, alignment = 256;
+static unsigned int frame;
+static int used;        /* This frame's region has been waited on */
+
+/* Function implementations */
+
+void
+waitregion(void)
+{
+    if (fences[frame]) {
+	glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT,
+		GL_TIMEOUT_IGNORED);
+	glDeleteSync(fences[frame]);
+	fences[frame] = NULL;
+    }
+    used = 1;
+}
+
+int
+ringinit(size_t size)
+{
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+	GL_MAP_COHERENT_BIT;
+    GLint ubo, ssbo;
+
+    ringterm();
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ubo);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &ssbo);
+    alignment = ubo > ssbo ? ubo : ssbo;
+    if (alignment < 16)
+	alignment = 16;
+    regionsize = ringalign(size ? size : 1);
+
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, regionsize * RINGFRAMES, NULL, flags);
+    vramtrack(GL_BUFFER, buffer, VRAMSTAGING, regionsize * RINGFRAMES,
+	    "ring");
+    map = (unsigned char *) glMapNamedBufferRange(buffer, 0,
+	    regionsize * RINGFRAMES, flags);
+
+    return map != NULL;
+}
+
+size_t
+ringalign(size_t size)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+size_t
+ringroom(void)
+{
+    return regionsize - head;
+}
+
+void *
+ringalloc(size_t size, GLintptr *offset)
+{
+    size_t at = head;
+
+    if (!map || size > regionsize - at)
+	return NULL;
+    if (!used)
+	waitregion();
+    head = at + ringalign(size);
+    if (head > regionsize)
+	head = regionsize;
+    *offset = (GLintptr) (regionsize * frame + at);
+
+    return map + regionsize * frame + at;
+}
+
+GLuint
+ringbuffer(void)
+{
+    return buffer;
+}
+
+void
+ringframe(void)
+{
+    if (!used)
+	return;
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame = (frame + 1) % RINGFRAMES;
+    head = 0;
+    used = 0;
+}
+
+void
+ringterm(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < RINGFRAMES; i++) {
+	if (fences[i])
+	    glDeleteSync(fences[i]);
+	fences[i] = NULL;
+    }
+    if (map)
+	glUnmapNamedBuffer(buffer);
+    vramuntrack(GL_BUFFER, buffer);
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    map = NULL;
+    regionsize = head = 0;
+    frame = used = 0;
+}
@@ -0,0 +1,19 @@
+/* Per-frame data ring.
+ *
+ * A persistently mapped buffer split into a region per frame in flight, so
+ * blocks written for one frame never touch memory the GPU may still be
+ * reading for an earlier one. ringinit() sizes each region. ringalloc()
+ * hands out blocks of this frame's region, starting at offsets aligned for
+ * uniform and storage buffer bindings, and returns NULL when the region is
+ * full. The first ringalloc() of a frame waits for the GPU to finish with
+ * the region's previous use. ringalign() rounds a size up to the binding
+ * alignment and ringroom() gives what is left of the region. ringframe()
+ * fences what this frame wrote and moves on to the next region. */
+
+int ringinit(size_t size);
+size_t ringalign(size_t size);
+size_t ringroom(void);
+void *ringalloc(size_t size, GLintptr *offset);
+GLuint ringbuffer(void);
+void ringframe(void);
+void ringterm(void);
@@ -0,0 +1,424 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshopt.h"
+#include "scene.h"
+#include "meshfile.h"
+#include "meshlet.h"
+#include "simplify.h"
+
+/* Macros */
+#define PI                3.14159265358979f
+#define SIDEMAX           32
+#define CACHESIZE         16 /* FIFO cache for the ACMR and ATVR reports */
+#define OVERDRAWTHRESHOLD 1.05f
+#define LODREDUCTION      0.8f /* Levels keeping more of the last stop */
+
+/* Function prototypes */
+static float randomf(uint32_t *state);
+static int createpolygon(Mesh *mesh, unsigned int sides, unsigned int rings,
+	float angle);
+static void computebounds(Mesh *mesh);
+static int computeattributes(Mesh *mesh);
+static void freemesh(Mesh *mesh);
+
+/* Function implementations */
+
+float
+randomf(uint32_t *state)
+{
+    /* xorshift32, the scene must be the same on every platform */
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+
+    return (*state >> 8) / 16777216.0f;
+}
+
+int
+createpolygon(Mesh *mesh, unsigned int sides, unsigned int rings, float angle)
+{
+    float *p, radius;
+    unsigned int *t, i, r, k, a, b;
+
+    /* A single ring is a fan of sides - 2 triangles around the first corner,
+     * more rings are a fan around the centre surrounded by quad strips */
+    if (rings < 2) {
+	mesh->vertexcount = sides;
+	mesh->indexcount = (sides - 2) * 3;
+    } else {
+	mesh->vertexcount = 1 + rings * sides;
+	mesh->indexcount = (sides + (rings - 1) * sides * 2) * 3;
+    }
+    mesh->positions = (float *) malloc(mesh->vertexcount * 3 * sizeof(float));
+    mesh->indices = (unsigned int *) malloc(mesh->indexcount *
+	    sizeof(unsigned int));
+    if (!mesh->positions || !mesh->indices)
+	return 0;
+
+    p = mesh->positions;
+    if (rings >= 2) {
+	*p++ = 0.0f;
+	*p++ = 0.0f;
+	*p++ = 0.0f;
+    }
+    for (r = 1; r <= (rings < 2 ? 1 : rings); r++) {
+	radius = 0.5f * r / (rings < 2 ? 1 : rings);
+	for (k = 0; k < sides; k++) {
+	    *p++ = radius * cosf(angle + 2.0f * PI * k / sides);
+	    *p++ = radius * sinf(angle + 2.0f * PI * k / sides);
+	    *p++ = 0.0f;
+	}
+    }
+
+    t = mesh->indices;
+    if (rings < 2) {
+	for (i = 1; i + 1 < sides; i++) {
+	    *t++ = 0;
+	    *t++ = i;
+	    *t++ = i + 1;
+	}
+	return 1;
+    }
+    for (k = 0; k < sides; k++) {
+	*t++ = 0;
+	*t++ = 1 + k;
+	*t++ = 1 + (k + 1) % sides;
+    }
+    for (r = 1; r < rings; r++) {
+	for (k = 0; k < sides; k++) {
+	    a = 1 + (r - 1) * sides;
+	    b = a + sides;
+	    *t++ = a + k;
+	    *t++ = b + k;
+	    *t++ = b + (k + 1) % sides;
+	    *t++ = a + k;
+	    *t++ = b + (k + 1) % sides;
+	    *t++ = a + (k + 1) % sides;
+	}
+    }
+
+    return 1;
+}
+
+void
+computebounds(Mesh *mesh)
+{
+    const float *p;
+    unsigned int i, j;
+
+    for (j = 0; j < 3; j++)
+	mesh->min[j] = mesh->max[j] = mesh->vertexcount ?
+	    mesh->positions[j] : 0.0f;
+    for (i = 0, p = mesh->positions; i < mesh->vertexcount; i++, p += 3) {
+	for (j = 0; j < 3; j++) {
+	    if (p[j] < mesh->min[j])
+		mesh->min[j] = p[j];
+	    if (p[j] > mesh->max[j])
+		mesh->max[j] = p[j];
+	}
+    }
+}
+
+int
+computeattributes(Mesh *mesh)
+{
+    const float *p[3];
+    float e1[3], e2[3], *n, size[2], length;
+    unsigned int i, j, k, count;
+    int smooth = 0, planar = 0;
+
+    /* Imported meshes may bring their own normals and texture coordinates */
+    count = mesh->vertexcount ? mesh->vertexcount : 1;
+    if (!mesh->normals) {
+	if (!(mesh->normals = (float *) calloc(count * 3, sizeof(float))))
+	    return 0;
+	smooth = 1;
+    }
+    if (!mesh->uvs) {
+	if (!(mesh->uvs = (float *) malloc(count * 2 * sizeof(float))))
+	    return 0;
+	planar = 1;
+    }
+
+    /* Smooth normals, each face weighted by its area */
+    for (i = 0; smooth && i + 2 < mesh->indexcount; i += 3) {
+	for (k = 0; k < 3; k++)
+	    p[k] = mesh->positions + mesh->indices[i + k] * 3;
+	for (j = 0; j < 3; j++) {
+	    e1[j] = p[1][j] - p[0][j];
+	    e2[j] = p[2][j] - p[0][j];
+	}
+	for (k = 0; k < 3; k++) {
+	    n = mesh->normals + mesh->indices[i + k] * 3;
+	    n[0] += e1[1] * e2[2] - e1[2] * e2[1];
+	    n[1] += e1[2] * e2[0] - e1[0] * e2[2];
+	    n[2] += e1[0] * e2[1] - e1[1] * e2[0];
+	}
+    }
+    for (i = 0, n = mesh->normals; smooth && i < mesh->vertexcount;
+	    i++, n += 3) {
+	length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if (length > 0.0f) {
+	    for (j = 0; j < 3; j++)
+		n[j] /= length;
+	} else {
+	    n[2] = 1.0f;
+	}
+    }
+
+    /* Planar projection onto the bounding box's xy face */
+    if (!planar)
+	return 1;
+    for (j = 0; j < 2; j++) {
+	size[j] = mesh->max[j] - mesh->min[j];
+	if (size[j] <= 0.0f)
+	    size[j] = 1.0f;
+    }
+    for (i = 0; i < mesh->vertexcount; i++)
+	for (j = 0; j < 2; j++)
+	    mesh->uvs[i * 2 + j] = (mesh->positions[i * 3 + j] -
+		    mesh->min[j]) / size[j];
+
+    return 1;
+}
+
+void
+freemesh(Mesh *mesh)
+{
+    if (mesh->mapping) {
+	meshunload(mesh);
+	return;
+    }
+    free(mesh->positions);
+    free(mesh->normals);
+    free(mesh->uvs);
+    free(mesh->indices);
+    free(mesh->meshlets);
+    memset(mesh, 0, sizeof(Mesh));
+}
+
+int
+scenemesh(Mesh *mesh)
+{
+    computebounds(mesh);
+
+    return computeattributes(mesh);
+}
+
+int
+scenecreate(Scene *scene, Mesh *mesh, unsigned int meshcount,
+	unsigned int rings, unsigned int objectcount, unsigned int layers)
+{
+    uint32_t state = 0x9e3779b9;
+    Mesh *m;
+    Object *o;
+    unsigned int i, cols, cell, layer;
+    float size, shade;
+
+    memset(scene, 0, sizeof(Scene));
+    if (meshcount > objectcount)
+	meshcount = objectcount;
+    if (!meshcount) {
+	freemesh(mesh);
+	return 1;
+    }
+
+    if (!(scene->meshes = (Mesh *) calloc(meshcount, sizeof(Mesh))) ||
+	    !(scene->objects = (Object *) calloc(objectcount,
+		    sizeof(Object)))) {
+	freemesh(mesh);
+	scenefree(scene);
+	return 0;
+    }
+    scene->meshcount = meshcount;
+    scene->objectcount = objectcount;
+
+    /* The first mesh is the one we were given, the rest are polygons */
+    scene->meshes[0] = *mesh;
+    memset(mesh, 0, sizeof(Mesh));
+    for (i = 1; i < meshcount; i++) {
+	m = &scene->meshes[i];
+	if (!createpolygon(m, 3 + i % (SIDEMAX - 2), rings,
+		    2.0f * PI * randomf(&state))) {
+	    scenefree(scene);
+	    return 0;
+	}
+	computebounds(m);
+	if (!computeattributes(m)) {
+	    scenefree(scene);
+	    return 0;
+	}
+    }
+
+    /* Grid filling the screen, a single object is drawn as is. Each cell
+     * stacks one object per layer, halving in size and receding in depth
+     * so the nearer ones hide the farther. */
+    if (!layers)
+	layers = 1;
+    cols = (unsigned int) ceil(sqrt((double) (objectcount + layers - 1) /
+		layers));
+    size = 2.0f / cols;
+    for (i = 0; i < objectcount; i++) {
+	o = &scene->objects[i];
+	cell = i / layers;
+	layer = i % layers;
+	shade = 1.0f - 0.5f * layer / layers;
+	o->mesh = i % meshcount;
+	o->transform[0] = -1.0f + size * (cell % cols + 0.5f);
+	o->transform[1] = 1.0f - size * (cell / cols + 0.5f);
+	o->transform[2] = -(float) layer / layers;
+	o->transform[3] = ldexpf(1.0f / cols, -(int) layer);
+	if (i) {
+	    o->colour[0] = shade * (0.4f + 0.6f * randomf(&state));
+	    o->colour[1] = shade * (0.4f + 0.6f * randomf(&state));
+	    o->colour[2] = shade * (0.4f + 0.6f * randomf(&state));
+	} else {
+	    o->colour[0] = 1.0f;
+	    o->colour[1] = 0.5f;
+	    o->colour[2] = 0.2f;
+	}
+	o->colour[3] = 1.0f;
+    }
+
+    return 1;
+}
+
+int
+sceneoptimise(Scene *scene, double acmr[2], double atvr[2])
+{
+    Mesh *m;
+    double misses[2] = { 0.0, 0.0 }, vertices[2] = { 0.0, 0.0 };
+    double triangles = 0.0;
+    unsigned int *remap, count;
+    int i, ok;
+
+    for (m = scene->meshes; m < scene->meshes + scene->meshcount; m++) {
+	/* Before meshfetch() drops unused vertices */
+	misses[0] += meshmisses(m->indices, m->indexcount, CACHESIZE);
+	vertices[0] += m->vertexcount;
+	triangles += m->indexcount / 3;
+
+	/* Mapped meshes are read only and were optimised when converted */
+	if (m->mapping) {
+	    misses[1] += meshmisses(m->indices, m->indexcount, CACHESIZE);
+	    vertices[1] += m->vertexcount;
+	    continue;
+	}
+	if (!meshcache(m->indices, m->indexcount, m->vertexcount) ||
+		!meshoverdraw(m->indices, m->indexcount, m->positions,
+		    OVERDRAWTHRESHOLD))
+	    return 0;
+
+	if (!(remap = (unsigned int *) malloc((m->vertexcount ?
+			    m->vertexcount : 1) * sizeof(unsigned int))))
+	    return 0;
+	count = meshfetch(m->indices, m->indexcount, m->vertexcount, remap);
+	ok = meshremap(m->positions, 3, remap, m->vertexcount) &&
+	    meshremap(m->normals, 3, remap, m->vertexcount) &&
+	    meshremap(m->uvs, 2, remap, m->vertexcount);
+	free(remap);
+	if (!ok)
+	    return 0;
+	m->vertexcount = count;
+	free(m->meshlets);  /* Stale with the new order */
+	m->meshlets = NULL;
+	m->meshletcount = 0;
+	m->lodcount = 0;
+	misses[1] += meshmisses(m->indices, m->indexcount, CACHESIZE);
+	vertices[1] += m->vertexcount;
+    }
+
+    for (i = 0; i < 2; i++) {
+	acmr[i] = triangles ? misses[i] / triangles : 0.0;
+	atvr[i] = vertices[i] ? misses[i] / vertices[i] : 0.0;
+    }
+
+    return 1;
+}
+
+int
+scenelods(Scene *scene)
+{
+    Mesh *m;
+    Lod *l;
+    unsigned int *indices, count, total;
+    float error;
+
+    for (m = scene->meshes; m < scene->meshes + scene->meshcount; m++) {
+	if (m->lodcount)
+	    continue;
+	m->lods[0].first = 0;
+	m->lods[0].count = m->indexcount;
+	m->lods[0].error = 0.0f;
+	m->lods[0].pad = 0;
+	m->lodcount = 1;
+
+	/* Each level is simplified from the one before, so its error adds
+	 * to theirs */
+	for (total = m->indexcount; m->lodcount < LODMAX; total += count) {
+	    l = &m->lods[m->lodcount - 1];
+	    if (l->count < 6)
+		break;
+	    if (!(indices = (unsigned int *) realloc(m->indices,
+			    (total + l->count) * sizeof(unsigned int))))
+		return 0;
+	    m->indices = indices;
+	    memcpy(indices + total, indices + l->first,
+		    l->count * sizeof(unsigned int));
+	    count = l->count;
+	    if (!meshsimplify(indices + total, &count, m->positions,
+			m->vertexcount, l->count / 6 * 3, &error) ||
+		    !meshcache(indices + total, count, m->vertexcount))
+		return 0;
+	    if (!count || count > l->count * LODREDUCTION)
+		break;
+	    l[1].first = total;
+	    l[1].count = count;
+	    l[1].error = l->error + error;
+	    l[1].pad = 0;
+	    m->lodcount++;
+	}
+    }
+
+    return 1;
+}
+
+int
+scenemeshlets(Scene *scene)
+{
+    Mesh *m;
+
+    /* Built last, they refer to the final triangle order */
+    for (m = scene->meshes; m < scene->meshes + scene->meshcount; m++)
+	if (!m->meshlets && !(m->meshlets = meshletbuild(m->indices,
+			m->indexcount, m->positions, m->vertexcount,
+			&m->meshletcount)))
+	    return 0;
+
+    return 1;
+}
+
+unsigned int
+sceneindexcount(const Mesh *mesh)
+{
+    const Lod *l = &mesh->lods[mesh->lodcount ? mesh->lodcount - 1 : 0];
+
+    return mesh->lodcount ? l->first + l->count : mesh->indexcount;
+}
+
+void
+scenefree(Scene *scene)
+{
+    unsigned int i;
+
+    if (scene->meshes) {
+	for (i = 0; i < scene->meshcount; i++)
+	    freemesh(&scene->meshes[i]);
+    }
+    free(scene->meshes);
+    free(scene->objects);
+    memset(scene, 0, sizeof(Scene));
+}
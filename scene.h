@@ -0,0 +1,69 @@
+/* Scene of meshes and the objects that instance them.
+ *
+ * Object, Meshlet and Lod are laid out to match the std430 structs in the
+ * shaders, they are uploaded as is. scenecreate() takes ownership of the given
+ * mesh, which becomes mesh 0, and fills in the rest with polygons. scenemesh()
+ * computes the bounds of an imported mesh and any normals and texture
+ * coordinates it lacks. sceneoptimise() reorders every mesh with meshopt.h,
+ * leaving mapped ones alone, and reports the vertex cache ACMR and ATVR before
+ * ([0]) and after ([1]). scenelods() then adds up to LODMAX - 1 simplified
+ * levels of detail to every mesh with simplify.h, each about half the
+ * triangles of the last, and scenemeshlets() cuts every mesh without meshlets
+ * into them with meshlet.h. Mapped meshes bring their own of both. The levels
+ * follow the full detail indices in the same array, sceneindexcount() gives
+ * the length of the lot. */
+
+#define LODMAX 8
+
+typedef struct {
+    float sphere[4];    /* xyz centre, w radius */
+    float cone[4];      /* xyz mean normal, w sine of the spread, 1 if none */
+    unsigned int first; /* First index in the mesh */
+    unsigned int count; /* Indices */
+    unsigned int pad[2];
+} Meshlet;
+
+typedef struct {
+    unsigned int first; /* First index in the mesh */
+    unsigned int count; /* Indices */
+    float error;        /* Furthest from the full detail mesh */
+    unsigned int pad;
+} Lod;
+
+typedef struct {
+    float *positions;   /* xyz per vertex */
+    float *normals;     /* xyz per vertex, unit length */
+    float *uvs;         /* uv per vertex */
+    unsigned int *indices; /* Triangle list, then the coarser levels */
+    unsigned int vertexcount, indexcount; /* indexcount is level 0's */
+    float min[3], max[3];
+    Meshlet *meshlets;  /* Of level 0 */
+    unsigned int meshletcount;
+    Lod lods[LODMAX];   /* lods[0] is the full detail mesh */
+    unsigned int lodcount;
+    void *mapping;      /* Set when the arrays point into a mapped file */
+    size_t mappingsize;
+} Mesh;
+
+typedef struct {
+    float transform[4]; /* xyz offset, w scale */
+    float colour[4];
+    unsigned int mesh;
+    unsigned int pad[3];
+} Object;
+
+typedef struct {
+    Mesh *meshes;
+    unsigned int meshcount;
+    Object *objects;
+    unsigned int objectcount;
+} Scene;
+
+int scenemesh(Mesh *mesh);
+int scenecreate(Scene *scene, Mesh *mesh, unsigned int meshcount,
+	unsigned int rings, unsigned int objectcount, unsigned int layers);
+int sceneoptimise(Scene *scene, double acmr[2], double atvr[2]);
+int scenelods(Scene *scene);
+int scenemeshlets(Scene *scene);
+unsigned int sceneindexcount(const Mesh *mesh);
+void scenefree(Scene *scene);
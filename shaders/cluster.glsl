@@ -0,0 +1,181 @@
+#version 460 core
+#pragma shader_stage(compute)
+
+/* Meshlet frustum, depth pyramid and normal cone culling into indirect
+ * commands, see cluster.h */
+
+layout(local_size_x = 64) in;
+
+struct Object {
+    vec4 transform; /* xyz offset, w scale */
+    vec4 colour;
+    uint mesh;
+};
+
+struct Mesh {
+    vec4 scale;
+    vec4 offset;
+    vec4 sphere;    /* Bounds, xyz centre, w radius */
+    uint base;
+    uint format;
+    uint count;
+    uint first;
+};
+
+struct Meshlet {
+    vec4 sphere;    /* xyz centre, w radius */
+    vec4 cone;      /* xyz mean normal, w sine of the spread */
+    uint first;     /* First index in the element buffer */
+    uint count;
+};
+
+struct Command {
+    uint count;
+    uint instancecount;
+    uint firstindex;
+    int basevertex;
+    uint baseinstance;
+};
+
+layout(std140, binding = 0) uniform Frame {
+    mat4 viewproj;
+    vec4 planes[6];
+    vec4 viewport;  /* Framebuffer and pyramid level 0 size */
+    uint objectcount;
+    uint usehiz;
+    uint hizlevels;
+    vec4 eye;       /* Camera position, w 1, or view direction, w 0 */
+};
+
+layout(std430, binding = 1) readonly buffer Objects {
+    Object objects[];
+};
+
+layout(std430, binding = 2) readonly buffer Meshes {
+    Mesh meshes[];
+};
+
+layout(std430, binding = 3) writeonly buffer Draws {
+    uint draws[];
+};
+
+layout(std430, binding = 4) writeonly buffer Commands {
+    Command commands[];
+};
+
+layout(std430, binding = 5) buffer Counter {
+    uint drawcount;
+};
+
+layout(std430, binding = 6) readonly buffer Meshlets {
+    Meshlet meshlets[];
+};
+
+/* First meshlet and count per mesh */
+layout(std430, binding = 7) readonly buffer Ranges {
+    uvec2 ranges[];
+};
+
+/* Farthest depth of each texel's footprint, see hiz.h */
+layout(binding = 0) uniform sampler2D hiz;
+
+bool occluded(vec3 centre, float radius)
+{
+    vec2 lo = vec2(1.0), hi = vec2(0.0);
+    float nearest = 1.0, farthest, level;
+    vec4 clip;
+    vec3 corner;
+    vec2 size;
+    int i;
+
+    /* Screen rectangle and nearest depth of the sphere's bounding box */
+    for (i = 0; i < 8; i++) {
+        corner = centre + radius * vec3((i & 1) != 0 ? 1.0 : -1.0,
+                (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        clip = viewproj * vec4(corner, 1.0);
+        if (clip.w <= 0.0)
+            return false;
+        clip.xyz /= clip.w;
+        lo = min(lo, clip.xy * 0.5 + 0.5);
+        hi = max(hi, clip.xy * 0.5 + 0.5);
+        nearest = min(nearest, clip.z * 0.5 + 0.5);
+    }
+    lo = clamp(lo, 0.0, 1.0);
+    hi = clamp(hi, 0.0, 1.0);
+
+    /* The level where the rectangle spans at most two texels each way */
+    size = (hi - lo) * viewport.zw;
+    level = ceil(log2(max(max(size.x, size.y), 1.0)));
+    level = min(level, float(hizlevels - 1u));
+    farthest = max(max(textureLod(hiz, lo, level).r,
+                textureLod(hiz, vec2(hi.x, lo.y), level).r),
+            max(textureLod(hiz, vec2(lo.x, hi.y), level).r,
+                textureLod(hiz, hi, level).r));
+
+    return nearest > farthest;
+}
+
+bool outside(vec3 centre, float radius)
+{
+    int p;
+
+    for (p = 0; p < 6; p++)
+        if (dot(planes[p].xyz, centre) + planes[p].w < -radius)
+            return true;
+
+    return false;
+}
+
+/* True when every triangle faces away from every point of the sphere. The
+ * view rays into a sphere seen from a point are bounded by the ray to its
+ * centre grown by the radius. */
+bool backfacing(vec3 centre, float radius, vec4 cone)
+{
+    vec3 ray;
+
+    if (cone.w >= 1.0)
+        return false;
+    if (eye.w == 0.0)
+        return dot(eye.xyz, cone.xyz) > cone.w;
+    ray = centre - eye.xyz;
+
+    return dot(ray, cone.xyz) - radius > cone.w * (length(ray) + radius);
+}
+
+void main()
+{
+    uint object = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint i, slot;
+    Object o;
+    Mesh m;
+    Meshlet l;
+    uvec2 range;
+    vec3 centre;
+    float radius;
+
+    if (object >= objectcount)
+        return;
+
+    /* The whole group agrees on the object before looking at meshlets */
+    o = objects[object];
+    m = meshes[o.mesh];
+    if (outside(m.sphere.xyz * o.transform.w + o.transform.xyz,
+                m.sphere.w * o.transform.w))
+        return;
+
+    /* Uniform scale leaves the normals and their cone as they were */
+    range = ranges[o.mesh];
+    for (i = gl_LocalInvocationID.x; i < range.y; i += gl_WorkGroupSize.x) {
+        l = meshlets[range.x + i];
+        centre = l.sphere.xyz * o.transform.w + o.transform.xyz;
+        radius = l.sphere.w * o.transform.w;
+        if (outside(centre, radius) || backfacing(centre, radius, l.cone))
+            continue;
+        if (usehiz != 0u && occluded(centre, radius))
+            continue;
+
+        slot = atomicAdd(drawcount, 1u);
+        commands[slot] = Command(l.count, 1u, l.first, 0, 0u);
+        draws[slot] = object;
+    }
+}
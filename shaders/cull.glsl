@@ -0,0 +1,183 @@
+#version 460 core
+#pragma shader_stage(compute)
+
+/* Frustum and depth pyramid culling and level of detail selection into
+ * indirect commands, see cull.h */
+
+layout(local_size_x = 64) in;
+
+struct Object {
+    vec4 transform; /* xyz offset, w scale */
+    vec4 colour;
+    uint mesh;
+};
+
+struct Mesh {
+    vec4 scale;
+    vec4 offset;
+    vec4 sphere;    /* Bounds, xyz centre, w radius */
+    uint base;
+    uint format;
+    uint count;     /* Indices */
+    uint first;     /* First index in the element buffer */
+};
+
+struct Lod {
+    uint first;     /* First index in the element buffer */
+    uint count;
+    float error;    /* Mesh units */
+    uint pad;
+};
+
+struct Command {
+    uint count;
+    uint instancecount;
+    uint firstindex;
+    int basevertex;
+    uint baseinstance;
+};
+
+layout(std140, binding = 0) uniform Frame {
+    mat4 viewproj;
+    vec4 planes[6];
+    vec4 viewport;  /* Framebuffer and pyramid level 0 size */
+    uint objectcount;
+    uint usehiz;
+    uint hizlevels;
+    vec4 eye;
+    float lodrefine;    /* Pixels */
+    float lodcoarsen;
+};
+
+const uint lodmax = 8u; /* LODMAX in scene.h */
+
+layout(std430, binding = 1) readonly buffer Objects {
+    Object objects[];
+};
+
+layout(std430, binding = 2) readonly buffer Meshes {
+    Mesh meshes[];
+};
+
+layout(std430, binding = 3) writeonly buffer Draws {
+    uint draws[];
+};
+
+layout(std430, binding = 4) writeonly buffer Commands {
+    Command commands[];
+};
+
+layout(std430, binding = 5) buffer Counter {
+    uint drawcount;
+    uint trianglecount;
+};
+
+/* lodmax a mesh, the unused ones empty */
+layout(std430, binding = 6) readonly buffer Lods {
+    Lod lods[];
+};
+
+/* The level each object drew last */
+layout(std430, binding = 7) buffer Levels {
+    uint levels[];
+};
+
+/* Farthest depth of each texel's footprint, see hiz.h */
+layout(binding = 0) uniform sampler2D hiz;
+
+bool occluded(vec3 centre, float radius)
+{
+    vec2 lo = vec2(1.0), hi = vec2(0.0);
+    float nearest = 1.0, farthest, level;
+    vec4 clip;
+    vec3 corner;
+    vec2 size;
+    int i;
+
+    /* Screen rectangle and nearest depth of the sphere's bounding box */
+    for (i = 0; i < 8; i++) {
+        corner = centre + radius * vec3((i & 1) != 0 ? 1.0 : -1.0,
+                (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        clip = viewproj * vec4(corner, 1.0);
+        if (clip.w <= 0.0)
+            return false;
+        clip.xyz /= clip.w;
+        lo = min(lo, clip.xy * 0.5 + 0.5);
+        hi = max(hi, clip.xy * 0.5 + 0.5);
+        nearest = min(nearest, clip.z * 0.5 + 0.5);
+    }
+    lo = clamp(lo, 0.0, 1.0);
+    hi = clamp(hi, 0.0, 1.0);
+
+    /* The level where the rectangle spans at most two texels each way */
+    size = (hi - lo) * viewport.zw;
+    level = ceil(log2(max(max(size.x, size.y), 1.0)));
+    level = min(level, float(hizlevels - 1u));
+    farthest = max(max(textureLod(hiz, lo, level).r,
+                textureLod(hiz, vec2(hi.x, lo.y), level).r),
+            max(textureLod(hiz, vec2(lo.x, hi.y), level).r,
+                textureLod(hiz, hi, level).r));
+
+    return nearest > farthest;
+}
+
+/* Pixels on screen a unit at the sphere's nearest point covers, negative
+ * when the camera is inside it */
+float pixelsize(vec3 centre, float radius)
+{
+    vec3 row1 = vec3(viewproj[0][1], viewproj[1][1], viewproj[2][1]);
+    vec3 row3 = vec3(viewproj[0][3], viewproj[1][3], viewproj[2][3]);
+    float w = dot(row3, centre) + viewproj[3][3] - radius * length(row3);
+
+    return w > 0.0 ? 0.5 * viewport.y * length(row1) / w : -1.0;
+}
+
+uint selectlod(uint object, uint mesh, vec3 centre, float radius,
+        float scale)
+{
+    uint base = mesh * lodmax, level = levels[object];
+    float size = pixelsize(centre, radius) * scale;
+
+    if (size < 0.0)
+        return 0u;
+    while (level > 0u && lods[base + level].error * size > lodrefine)
+        level--;
+    while (level + 1u < lodmax && lods[base + level + 1u].count != 0u &&
+            lods[base + level + 1u].error * size <= lodcoarsen)
+        level++;
+
+    return level;
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x, slot, level;
+    Object o;
+    Mesh m;
+    Lod l;
+    vec3 centre;
+    float radius;
+    int p;
+
+    if (i >= objectcount)
+        return;
+
+    o = objects[i];
+    m = meshes[o.mesh];
+    centre = m.sphere.xyz * o.transform.w + o.transform.xyz;
+    radius = m.sphere.w * o.transform.w;
+    for (p = 0; p < 6; p++)
+        if (dot(planes[p].xyz, centre) + planes[p].w < -radius)
+            return;
+    if (usehiz != 0u && occluded(centre, radius))
+        return;
+
+    level = selectlod(i, o.mesh, centre, radius, o.transform.w);
+    levels[i] = level;
+    l = lods[o.mesh * lodmax + level];
+
+    slot = atomicAdd(drawcount, 1u);
+    atomicAdd(trianglecount, l.count / 3u);
+    commands[slot] = Command(l.count, 1u, l.first, 0, 0u);
+    draws[slot] = i;
+}
@@ -0,0 +1,11 @@
+#version 460 core
+#pragma shader_stage(vertex)
+
+/* One triangle covering the screen, drawn without attributes */
+void main()
+{
+    vec2 pos = vec2(gl_VertexID == 1 ? 3.0 : -1.0,
+            gl_VertexID == 2 ? 3.0 : -1.0);
+
+    gl_Position = vec4(pos.x, pos.y, 0.0, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 460 core
+#pragma shader_stage(fragment)
+
+layout(binding = 0) uniform sampler2D counts;
+
+layout(location = 0) out vec4 outcolour;
+
+/* Black, blue, green, yellow, red as the count goes from 0 to maxcount */
+const float maxcount = 8.0f;
+const vec3 ramp[5] = vec3[](
+    vec3(0.0f, 0.0f, 0.0f),
+    vec3(0.0f, 0.0f, 1.0f),
+    vec3(0.0f, 1.0f, 0.0f),
+    vec3(1.0f, 1.0f, 0.0f),
+    vec3(1.0f, 0.0f, 0.0f)
+);
+
+void main()
+{
+    float count = texelFetch(counts, ivec2(gl_FragCoord.xy), 0).r;
+    float t = clamp(count / maxcount, 0.0f, 1.0f) * 4.0f;
+    int i = min(int(t), 3);
+
+    outcolour = vec4(mix(ramp[i], ramp[i + 1], t - float(i)), 1.0f);
+}
@@ -0,0 +1,43 @@
+#version 460 core
+#pragma shader_stage(compute)
+
+/* One level of the depth pyramid, see hiz.h */
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+/* The depth buffer for level 0, a view of the level above otherwise */
+layout(binding = 0) uniform sampler2D src;
+
+layout(binding = 0, r32f) uniform writeonly image2D dst;
+
+float fetch(ivec2 p, ivec2 srcsize)
+{
+    return texelFetch(src, min(p, srcsize - 1), 0).r;
+}
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy), size = imageSize(dst);
+    ivec2 srcsize = textureSize(src, 0), s = p * 2;
+    float d;
+
+    if (p.x >= size.x || p.y >= size.y)
+        return;
+
+    d = max(max(fetch(s, srcsize), fetch(s + ivec2(1, 0), srcsize)),
+            max(fetch(s + ivec2(0, 1), srcsize),
+                fetch(s + ivec2(1, 1), srcsize)));
+
+    /* An odd source leaves a column or row for the last texel to take */
+    if ((srcsize.x & 1) != 0 && p.x == size.x - 1)
+        d = max(d, max(fetch(s + ivec2(2, 0), srcsize),
+                    fetch(s + ivec2(2, 1), srcsize)));
+    if ((srcsize.y & 1) != 0 && p.y == size.y - 1)
+        d = max(d, max(fetch(s + ivec2(0, 2), srcsize),
+                    fetch(s + ivec2(1, 2), srcsize)));
+    if ((srcsize.x & 1) != 0 && p.x == size.x - 1 &&
+            (srcsize.y & 1) != 0 && p.y == size.y - 1)
+        d = max(d, fetch(s + ivec2(2, 2), srcsize));
+
+    imageStore(dst, p, vec4(d));
+}
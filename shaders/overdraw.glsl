@@ -0,0 +1,10 @@
+#version 460 core
+#pragma shader_stage(fragment)
+
+/* Blended additively, each fragment adds one */
+layout(location = 0) out float outcount;
+
+void main()
+{
+    outcount = 1.0f;
+}
@@ -1,9 +1,66 @@
 #version 460 core
 #pragma shader_stage(vertex)
 
+/* Where each draw's object is found, set by specialise() in triangle.c */
+const uint objectinstance = 0u; /* objects[gl_BaseInstance + instance] */
+const uint objectuniform  = 2u; /* object, set by glProgramUniform4uiv */
+layout(constant_id = 0) const uint objectsource = objectinstance;
+
+struct Object {
+    vec4 transform; /* xyz offset, w scale */
+    vec4 colour;
+    uint mesh;
+};
+
+/* Only the dequantisation is used, the rest keeps the std430 stride of the
+ * mesh records in pull.c */
+struct Mesh {
+    vec4 scale;     /* Dequantisation, xyz */
+    vec4 offset;
+    vec4 sphere;
+    uint base;
+    uint format;
+    uint count;
+    uint first;
+};
+
+/* Formats set up by vformatsetup() */
 layout(location = 0) in vec3 apos;
+layout(location = 1) in vec3 anormal;
+layout(location = 2) in vec2 auv;
+
+layout(std140, binding = 0) uniform Frame {
+    mat4 viewproj;
+};
+
+layout(std430, binding = 1) readonly buffer Objects {
+    Object objects[];
+};
+
+layout(location = 0) uniform uvec4 object[3];
+
+layout(std430, binding = 2) readonly buffer Meshes {
+    Mesh meshes[];
+};
+
+layout(location = 0) out vec4 colour;
+layout(location = 1) out vec2 uv;
 
 void main()
 {
-    gl_Position = vec4(apos.x, apos.y, apos.z, 1.0);
+    Object o;
+
+    if (objectsource == objectuniform)
+        o = Object(uintBitsToFloat(object[0]), uintBitsToFloat(object[1]),
+                object[2].x);
+    else
+        o = objects[gl_BaseInstance + gl_InstanceID];
+
+    Mesh m = meshes[o.mesh];
+    vec3 pos = apos * m.scale.xyz + m.offset.xyz;
+
+    pos = pos * o.transform.w + o.transform.xyz;
+    gl_Position = viewproj * vec4(pos, 1.0);
+    colour = o.colour;
+    uv = auv;
 }
@@ -0,0 +1,91 @@
+#version 460 core
+#pragma shader_stage(vertex)
+
+/* Position formats, see vformat.h, or any to read each mesh's. Set to the
+ * scene's by specialise() in triangle.c. */
+const uint layoutfloat   = 0u;
+const uint layouthalf    = 1u;
+const uint layoutsnorm16 = 2u;
+const uint layoutany     = 0xffffffffu;
+layout(constant_id = 1) const uint positionlayout = layoutany;
+
+/* Where each draw's object is found, as in vertex.glsl. The multi-draw
+ * indirect paths look up the first object of each command, see mdi.h. */
+const uint objectinstance = 0u;
+const uint objectdraw     = 1u;
+layout(constant_id = 0) const uint objectsource = objectinstance;
+
+struct Object {
+    vec4 transform; /* xyz offset, w scale */
+    vec4 colour;
+    uint mesh;
+};
+
+struct Mesh {
+    vec4 scale;     /* Dequantisation, xyz */
+    vec4 offset;
+    vec4 sphere;    /* Bounds, xyz centre, w radius */
+    uint base;      /* First word in positions */
+    uint format;
+    uint count;     /* Indices */
+    uint first;     /* First index in the element buffer */
+};
+
+layout(std140, binding = 0) uniform Frame {
+    mat4 viewproj;
+};
+
+layout(std430, binding = 0) readonly buffer Positions {
+    uint words[];
+};
+
+layout(std430, binding = 1) readonly buffer Objects {
+    Object objects[];
+};
+
+layout(std430, binding = 2) readonly buffer Meshes {
+    Mesh meshes[];
+};
+
+/* First object of each indirect command */
+layout(std430, binding = 3) readonly buffer Draws {
+    uint draws[];
+};
+
+layout(location = 0) out vec4 colour;
+
+vec3 fetch(Mesh m, uint vertex)
+{
+    uint i;
+
+    switch (positionlayout == layoutany ? m.format : positionlayout) {
+    case layouthalf:
+        i = m.base + vertex * 2u;
+        return vec3(unpackHalf2x16(words[i]), unpackHalf2x16(words[i + 1u]).x);
+    case layoutsnorm16:
+        i = m.base + vertex * 2u;
+        return vec3(unpackSnorm2x16(words[i]),
+                unpackSnorm2x16(words[i + 1u]).x);
+    default:
+        i = m.base + vertex * 3u;
+        return uintBitsToFloat(uvec3(words[i], words[i + 1u], words[i + 2u]));
+    }
+}
+
+void main()
+{
+    Object o;
+
+    if (objectsource == objectdraw)
+        o = objects[draws[gl_DrawID] + uint(gl_InstanceID)];
+    else
+        o = objects[gl_BaseInstance + gl_InstanceID];
+
+    Mesh m = meshes[o.mesh];
+    vec3 pos = fetch(m, uint(gl_VertexID - gl_BaseVertex));
+
+    pos = pos * m.scale.xyz + m.offset.xyz;
+    pos = pos * o.transform.w + o.transform.xyz;
+    gl_Position = viewproj * vec4(pos, 1.0);
+    colour = o.colour;
+}
@@ -0,0 +1,346 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshopt.h"
+#include "simplify.h"
+
+/* Macros */
+#define BORDERWEIGHT 10.0 /* Border planes against face planes */
+
+/* Types */
+typedef struct {
+    double a[10];       /* Upper triangle of the symmetric 4x4 matrix */
+    double weight;      /* Area the planes came from */
+} Quadric;
+
+typedef struct {
+    double cost;
+    unsigned int from, to;
+} Collapse;
+
+typedef struct {
+    unsigned int *offsets; /* Into triangles, per vertex */
+    unsigned int *triangles;
+} Adjacency;
+
+/* Function prototypes */
+static void quadricplane(Quadric *q, const double *n, double d,
+	double weight);
+static void quadricadd(Quadric *q, const Quadric *r);
+static double quadriccost(const Quadric *q, const Quadric *r,
+	const float *p);
+static void normal(double *n, const float *a, const float *b,
+	const float *c);
+static void borderplane(Quadric *quadrics, const double *n,
+	const float *positions, unsigned int a, unsigned int b);
+static void buildadjacency(Adjacency *adj, const unsigned int *indices,
+	unsigned int indexcount, unsigned int vertexcount);
+static int hasedge(const Adjacency *adj, const unsigned int *indices,
+	unsigned int from, unsigned int to);
+static int flips(const Adjacency *adj, const unsigned int *indices,
+	const float *positions, unsigned int from, unsigned int to);
+static int collapsecompare(const void *a, const void *b);
+
+/* Function implementations */
+
+void
+quadricplane(Quadric *q, const double *n, double d, double weight)
+{
+    /* The squared distance to the plane n.p + d = 0, times weight */
+    q->a[0] += weight * n[0] * n[0];
+    q->a[1] += weight * n[0] * n[1];
+    q->a[2] += weight * n[0] * n[2];
+    q->a[3] += weight * n[0] * d;
+    q->a[4] += weight * n[1] * n[1];
+    q->a[5] += weight * n[1] * n[2];
+    q->a[6] += weight * n[1] * d;
+    q->a[7] += weight * n[2] * n[2];
+    q->a[8] += weight * n[2] * d;
+    q->a[9] += weight * d * d;
+    q->weight += weight;
+}
+
+void
+quadricadd(Quadric *q, const Quadric *r)
+{
+    int i;
+
+    for (i = 0; i < 10; i++)
+	q->a[i] += r->a[i];
+    q->weight += r->weight;
+}
+
+double
+quadriccost(const Quadric *q, const Quadric *r, const float *p)
+{
+    double a[10], x = p[0], y = p[1], z = p[2], e, w;
+    int i;
+
+    /* Mean squared distance of p to the planes of both, per unit area */
+    for (i = 0; i < 10; i++)
+	a[i] = q->a[i] + r->a[i];
+    w = q->weight + r->weight;
+    e = a[0] * x * x + a[4] * y * y + a[7] * z * z + a[9] +
+	2.0 * (a[1] * x * y + a[2] * x * z + a[5] * y * z + a[3] * x +
+		a[6] * y + a[8] * z);
+
+    return w > 0.0 && e > 0.0 ? e / w : 0.0;
+}
+
+void
+normal(double *n, const float *a, const float *b, const float *c)
+{
+    double e1[3], e2[3];
+    int j;
+
+    for (j = 0; j < 3; j++) {
+	e1[j] = (double) b[j] - a[j];
+	e2[j] = (double) c[j] - a[j];
+    }
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+void
+borderplane(Quadric *quadrics, const double *n, const float *positions,
+	unsigned int a, unsigned int b)
+{
+    double e[3], m[3], length, d;
+    int j;
+
+    /* The plane through the edge that contains the face normal, weighted
+     * like a face of the edge's length squared */
+    for (j = 0; j < 3; j++)
+	e[j] = (double) positions[b * 3 + j] - positions[a * 3 + j];
+    m[0] = e[1] * n[2] - e[2] * n[1];
+    m[1] = e[2] * n[0] - e[0] * n[2];
+    m[2] = e[0] * n[1] - e[1] * n[0];
+    length = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+    if (length <= 0.0)
+	return;
+    for (j = 0; j < 3; j++)
+	m[j] /= length;
+    d = -(m[0] * positions[a * 3] + m[1] * positions[a * 3 + 1] +
+	    m[2] * positions[a * 3 + 2]);
+    quadricplane(&quadrics[a], m, d, BORDERWEIGHT * length * length);
+    quadricplane(&quadrics[b], m, d, BORDERWEIGHT * length * length);
+}
+
+void
+buildadjacency(Adjacency *adj, const unsigned int *indices,
+	unsigned int indexcount, unsigned int vertexcount)
+{
+    unsigned int i, v;
+
+    /* Counting sort of the triangles by each of their corners */
+    memset(adj->offsets, 0, (vertexcount + 1) * sizeof(unsigned int));
+    for (i = 0; i < indexcount; i++)
+	adj->offsets[indices[i] + 1]++;
+    for (v = 0; v < vertexcount; v++)
+	adj->offsets[v + 1] += adj->offsets[v];
+    for (i = 0; i < indexcount; i++)
+	adj->triangles[adj->offsets[indices[i]]++] = i / 3;
+    for (v = vertexcount; v > 0; v--)
+	adj->offsets[v] = adj->offsets[v - 1];
+    adj->offsets[0] = 0;
+}
+
+int
+hasedge(const Adjacency *adj, const unsigned int *indices, unsigned int from,
+	unsigned int to)
+{
+    const unsigned int *t;
+    unsigned int i, k;
+
+    /* A triangle around from in which to comes next */
+    for (i = adj->offsets[from]; i < adj->offsets[from + 1]; i++) {
+	t = indices + adj->triangles[i] * 3;
+	for (k = 0; k < 3; k++)
+	    if (t[k] == from && t[(k + 1) % 3] == to)
+		return 1;
+    }
+
+    return 0;
+}
+
+int
+flips(const Adjacency *adj, const unsigned int *indices,
+	const float *positions, unsigned int from, unsigned int to)
+{
+    const unsigned int *t;
+    const float *p[3], *q[3];
+    double before[3], after[3];
+    unsigned int i, k;
+
+    /* Triangles keeping their area must keep their facing */
+    for (i = adj->offsets[from]; i < adj->offsets[from + 1]; i++) {
+	t = indices + adj->triangles[i] * 3;
+	if (t[0] == to || t[1] == to || t[2] == to)
+	    continue;
+	for (k = 0; k < 3; k++) {
+	    p[k] = positions + t[k] * 3;
+	    q[k] = positions + (t[k] == from ? to : t[k]) * 3;
+	}
+	normal(before, p[0], p[1], p[2]);
+	normal(after, q[0], q[1], q[2]);
+	if (before[0] * after[0] + before[1] * after[1] +
+		before[2] * after[2] <= 0.0)
+	    return 1;
+    }
+
+    return 0;
+}
+
+int
+collapsecompare(const void *a, const void *b)
+{
+    const Collapse *x = (const Collapse *) a, *y = (const Collapse *) b;
+
+    if (x->cost != y->cost)
+	return x->cost < y->cost ? -1 : 1;
+
+    return x->from < y->from ? -1 : x->from > y->from;
+}
+
+int
+meshsimplify(unsigned int *indices, unsigned int *indexcount,
+	const float *positions, unsigned int vertexcount, unsigned int target,
+	float *error)
+{
+    Adjacency adj;
+    Quadric *quadrics;
+    Collapse *collapses, *c;
+    double n[3], length, worst = 0.0, cost[2];
+    unsigned int *work, *remap, *stamp, *weld, *seen, count, i, j, k, a, b,
+		 collapsecount, removed, pass;
+    const unsigned int *t;
+    int ok = 0;
+
+    count = *indexcount - *indexcount % 3;
+    *error = 0.0f;
+    if (count <= target)
+	return 1;
+
+    work = (unsigned int *) malloc(count * sizeof(unsigned int));
+    quadrics = (Quadric *) calloc(vertexcount ? vertexcount : 1,
+	    sizeof(Quadric));
+    collapses = (Collapse *) malloc(count * sizeof(Collapse));
+    adj.offsets = (unsigned int *) malloc((vertexcount + 1) *
+	    sizeof(unsigned int));
+    adj.triangles = (unsigned int *) malloc(count * sizeof(unsigned int));
+    remap = (unsigned int *) malloc((vertexcount ? vertexcount : 1) *
+	    sizeof(unsigned int));
+    stamp = (unsigned int *) calloc(vertexcount ? vertexcount : 1,
+	    sizeof(unsigned int));
+    weld = (unsigned int *) malloc((vertexcount ? vertexcount : 1) *
+	    sizeof(unsigned int));
+    seen = (unsigned int *) calloc(vertexcount ? vertexcount : 1,
+	    sizeof(unsigned int));
+    if (!work || !quadrics || !collapses || !adj.offsets ||
+	    !adj.triangles || !remap || !stamp || !weld || !seen)
+	goto done;
+    memcpy(work, indices, count * sizeof(unsigned int));
+
+    /* Vertices on a seam share a position with another and are locked,
+     * moving one would tear the seam open. seen counts each position. */
+    if (!meshweld(positions, vertexcount, weld) && vertexcount)
+	goto done;
+    for (i = 0; i < vertexcount; i++)
+	seen[weld[i]]++;
+
+    /* Every vertex starts with the planes of its faces, area weighted, and
+     * of any border edge it is on, perpendicular to the face */
+    buildadjacency(&adj, work, count, vertexcount);
+    for (i = 0; i < count; i += 3) {
+	t = work + i;
+	normal(n, positions + t[0] * 3, positions + t[1] * 3,
+		positions + t[2] * 3);
+	length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	if (length <= 0.0)
+	    continue;
+	for (j = 0; j < 3; j++)
+	    n[j] /= length;
+	for (k = 0; k < 3; k++)
+	    quadricplane(&quadrics[t[k]], n, -(n[0] * positions[t[0] * 3] +
+			n[1] * positions[t[0] * 3 + 1] +
+			n[2] * positions[t[0] * 3 + 2]), 0.5 * length);
+
+	for (k = 0; k < 3; k++)
+	    if (!hasedge(&adj, work, t[(k + 1) % 3], t[k]))
+		borderplane(quadrics, n, positions, t[k], t[(k + 1) % 3]);
+    }
+
+    /* Passes of independent collapses, cheapest first, each vertex
+     * touched at most once a pass so the flip tests stay valid */
+    for (pass = 1; count > target; pass++) {
+	buildadjacency(&adj, work, count, vertexcount);
+	for (i = 0, collapsecount = 0; i < count; i++) {
+	    a = work[i];
+	    b = work[i - i % 3 + (i + 1) % 3];
+	    cost[0] = seen[weld[a]] > 1 ? HUGE_VAL :
+		quadriccost(&quadrics[a], &quadrics[b], positions + b * 3);
+	    cost[1] = seen[weld[b]] > 1 ? HUGE_VAL :
+		quadriccost(&quadrics[b], &quadrics[a], positions + a * 3);
+	    if (cost[0] == HUGE_VAL && cost[1] == HUGE_VAL)
+		continue;
+	    c = &collapses[collapsecount++];
+	    c->cost = cost[0] <= cost[1] ? cost[0] : cost[1];
+	    c->from = cost[0] <= cost[1] ? a : b;
+	    c->to = cost[0] <= cost[1] ? b : a;
+	}
+	qsort(collapses, collapsecount, sizeof(Collapse), collapsecompare);
+
+	for (i = 0; i < vertexcount; i++)
+	    remap[i] = i;
+	for (c = collapses, removed = 0; c < collapses + collapsecount &&
+		count - removed * 3 > target; c++) {
+	    if (stamp[c->from] == pass || stamp[c->to] == pass ||
+		    flips(&adj, work, positions, c->from, c->to))
+		continue;
+	    remap[c->from] = c->to;
+	    quadricadd(&quadrics[c->to], &quadrics[c->from]);
+	    if (c->cost > worst)
+		worst = c->cost;
+	    for (j = adj.offsets[c->from]; j < adj.offsets[c->from + 1]; j++) {
+		t = work + adj.triangles[j] * 3;
+		for (k = 0; k < 3; k++)
+		    stamp[t[k]] = pass;
+		removed += t[0] == c->to || t[1] == c->to || t[2] == c->to;
+	    }
+	}
+	if (!removed)
+	    break;
+
+	for (i = 0, k = 0; i < count; i += 3) {
+	    a = remap[work[i]];
+	    b = remap[work[i + 1]];
+	    j = remap[work[i + 2]];
+	    if (a == b || b == j || j == a)
+		continue;
+	    work[k++] = a;
+	    work[k++] = b;
+	    work[k++] = j;
+	}
+	count = k;
+    }
+
+    memcpy(indices, work, count * sizeof(unsigned int));
+    *indexcount = count;
+    *error = (float) sqrt(worst);
+    ok = 1;
+
+done:
+    free(work);
+    free(quadrics);
+    free(collapses);
+    free(adj.offsets);
+    free(adj.triangles);
+    free(remap);
+    free(stamp);
+    free(weld);
+    free(seen);
+
+    return ok;
+}
@@ -0,0 +1,16 @@
+/* Mesh simplification.
+ *
+ * meshsimplify() collapses the edges of an indexed triangle list, cheapest
+ * first by quadric error (Garland and Heckbert), until at most target
+ * indices remain or nothing more can go without flipping a triangle. A
+ * vertex only ever moves onto a neighbour, so the result indexes the same
+ * vertices and every level of detail of a mesh can share one vertex
+ * buffer. Open borders are held by planes through their edges, and a
+ * vertex sharing its position with another, on a normal or texture seam,
+ * never moves. error is set to an estimate of the furthest a collapse
+ * moved the surface, in mesh units. Returns 0 when out of memory and leaves the
+ * indices as they were. */
+
+int meshsimplify(unsigned int *indices, unsigned int *indexcount,
+	const float *positions, unsigned int vertexcount, unsigned int target,
+	float *error);
@@ -0,0 +1,195 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "glad.h"
+#include "stats.h"
+
+/* Macros */
+#define PASSMAX  16
+#define FRAMELAG 4 /* Frames of queries in flight */
+
+/* Types */
+enum { VERTICES, PRIMITIVES, VSINVOCATIONS, CLIPIN, CLIPOUT, FSINVOCATIONS,
+    CSINVOCATIONS, ELAPSED, QUERYTYPES };
+
+typedef struct {
+    const char *name;
+    GLuint queries[FRAMELAG][QUERYTYPES];
+    int issued[FRAMELAG];     /* Results pending for this frame slot */
+    int active;               /* Between statsbegin() and statsend() */
+    uint64_t sum[QUERYTYPES]; /* Since the last statsprint() */
+    unsigned long frames;
+} Pass;
+
+/* Function prototypes */
+static int collect(Pass *p, int slot);
+
+/* Variables */
+static const GLenum targets[QUERYTYPES] = {
+    GL_VERTICES_SUBMITTED,
+    GL_PRIMITIVES_SUBMITTED,
+    GL_VERTEX_SHADER_INVOCATIONS,
+    GL_CLIPPING_INPUT_PRIMITIVES,
+    GL_CLIPPING_OUTPUT_PRIMITIVES,
+    GL_FRAGMENT_SHADER_INVOCATIONS,
+    GL_COMPUTE_SHADER_INVOCATIONS,
+    GL_TIME_ELAPSED
+};
+static Pass passes[PASSMAX];
+static int passcount;
+static unsigned long frame, framecount;
+static double frametime;
+
+/* Function implementations */
+
+int
+statspass(const char *name)
+{
+    Pass *p;
+    int i;
+
+    for (i = 0; i < passcount; i++)
+	if (!strcmp(passes[i].name, name))
+	    return i;
+    if (passcount == PASSMAX)
+	return -1;
+
+    p = &passes[passcount];
+    memset(p, 0, sizeof(Pass));
+    p->name = name;
+    for (i = 0; i < FRAMELAG; i++)
+	glGenQueries(QUERYTYPES, p->queries[i]);
+
+    return passcount++;
+}
+
+void
+statsbegin(int pass)
+{
+    Pass *p;
+    int slot, i;
+
+    if (pass < 0)
+	return;
+
+    /* Skip rather than stall when the GPU is more than FRAMELAG behind */
+    p = &passes[pass];
+    slot = frame % FRAMELAG;
+    if (p->issued[slot] && !collect(p, slot))
+	return;
+
+    for (i = 0; i < QUERYTYPES; i++)
+	glBeginQuery(targets[i], p->queries[slot][i]);
+    p->active = 1;
+}
+
+void
+statsend(int pass)
+{
+    Pass *p;
+    int i;
+
+    if (pass < 0 || !passes[pass].active)
+	return;
+
+    p = &passes[pass];
+    for (i = 0; i < QUERYTYPES; i++)
+	glEndQuery(targets[i]);
+    p->issued[frame % FRAMELAG] = 1;
+    p->active = 0;
+}
+
+int
+collect(Pass *p, int slot)
+{
+    GLint available;
+    GLuint64 value;
+    int i;
+
+    /* All queries end together, the last one is the latest to land */
+    glGetQueryObjectiv(p->queries[slot][QUERYTYPES - 1],
+	    GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+	return 0;
+
+    for (i = 0; i < QUERYTYPES; i++) {
+	glGetQueryObjectui64v(p->queries[slot][i], GL_QUERY_RESULT, &value);
+	p->sum[i] += value;
+    }
+    p->frames++;
+    p->issued[slot] = 0;
+
+    return 1;
+}
+
+void
+statsframe(double seconds)
+{
+    Pass *p;
+    int slot;
+
+    for (p = passes; p < passes + passcount; p++)
+	for (slot = 0; slot < FRAMELAG; slot++)
+	    if (p->issued[slot])
+		collect(p, slot);
+
+    frametime += seconds;
+    framecount++;
+    frame++;
+}
+
+void
+statsprint(FILE *fp)
+{
+    Pass *p;
+    GLint viewport[4];
+    double pixels, n;
+    uint64_t *s;
+
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    pixels = (double) viewport[2] * viewport[3];
+
+    if (framecount)
+	fprintf(fp, "frame %.3f ms\n", frametime * 1000.0 / framecount);
+    for (p = passes; p < passes + passcount; p++) {
+	if (!p->frames)
+	    continue;
+	n = p->frames;
+	s = p->sum;
+	fprintf(fp, "  %-12s %8.3f ms %10.0f verts %10.0f prims "
+		"%5.2f vs/vert %6.1f%% clip out/in %6.2f fs/px",
+		p->name, s[ELAPSED] / n / 1e6, s[VERTICES] / n,
+		s[PRIMITIVES] / n,
+		s[VERTICES] ? (double) s[VSINVOCATIONS] / s[VERTICES] : 0.0,
+		s[CLIPIN] ? 100.0 * s[CLIPOUT] / s[CLIPIN] : 0.0,
+		pixels ? s[FSINVOCATIONS] / n / pixels : 0.0);
+	if (s[CSINVOCATIONS])
+	    fprintf(fp, " %10.0f cs", s[CSINVOCATIONS] / n);
+	fputc('\n', fp);
+    }
+    statsreset();
+}
+
+void
+statsreset(void)
+{
+    Pass *p;
+
+    for (p = passes; p < passes + passcount; p++) {
+	memset(p->sum, 0, sizeof(p->sum));
+	p->frames = 0;
+    }
+    frametime = 0.0;
+    framecount = 0;
+}
+
+void
+statsterm(void)
+{
+    int i;
+
+    for (i = 0; i < passcount; i++)
+	glDeleteQueries(FRAMELAG * QUERYTYPES, passes[i].queries[0]);
+    passcount = 0;
+}
@@ -0,0 +1,14 @@
+/* Per-pass pipeline statistics.
+ *
+ * Each pass is bracketed with pipeline statistics and GPU time queries.
+ * Results are read back a few frames later without stalling and averaged
+ * over the interval between statsprint() calls. Passes cannot nest. Pass
+ * names are kept by pointer and must be string literals. */
+
+int statspass(const char *name);
+void statsbegin(int pass);
+void statsend(int pass);
+void statsframe(double seconds);
+void statsprint(FILE *fp);
+void statsreset(void);
+void statsterm(void);
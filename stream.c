@@ -0,0 +1,540 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad.h"
+#include "scene.h"
+#include "vformat.h"
+#include "stream.h"
+#include "vram.h"
+
+/* Macros */
+#define CHUNKVERTICES 8192
+#define CHUNKINDICES  (8192 * 3)
+#define HASHSIZE      (CHUNKVERTICES * 2) /* Power of two */
+#define STAGINGSLOTS  8
+#define REQUESTMAX    64
+#define EMPTY         UINT32_MAX
+
+/* Types */
+enum { CHUNKIDLE, CHUNKLOADING, CHUNKREADY, CHUNKRESIDENT };
+enum { STAGINGFREE, STAGINGFILLING, STAGINGREADY, STAGINGCOPIED };
+
+typedef struct {
+    float sphere[4];            /* Object space, xyz centre, w radius */
+    unsigned int first, count;  /* Indices in the mesh */
+    unsigned int vertexcount;   /* Set by the loader */
+    unsigned int lastused, seen; /* Frames */
+    int state, slot;
+} Chunk;
+
+typedef struct {
+    int state;
+    unsigned int chunk;
+    GLsync fence;
+} Staging;
+
+typedef struct {
+    float priority;
+    unsigned int chunk;
+} Request;
+
+typedef struct {
+    float scale[4];
+    float offset[4];
+    float sphere[4];
+    uint32_t pad[4];
+} MeshRecord;           /* Mesh in vertex.glsl */
+
+typedef struct {
+    uint32_t keys[HASHSIZE];    /* Mesh vertex */
+    uint32_t values[HASHSIZE];  /* Chunk vertex */
+    unsigned int count;
+} VertexMap;
+
+/* Function prototypes */
+static void mapreset(VertexMap *map);
+static uint32_t mapvertex(VertexMap *map, uint32_t v);
+static int splitchunks(void);
+static void fillchunk(Chunk *c, unsigned char *dst, VertexMap *map,
+	float *scratch);
+static void *loadthread(void *arg);
+static int comparerequests(const void *a, const void *b);
+static int findslot(void);
+
+/* Variables */
+static const Mesh *source;
+static VertexFormat vformat;
+static Chunk *chunks;
+static Request *candidates;
+static unsigned int chunkcount, *requests, requestcount;
+static int *slots;              /* Chunk in each pool slot, -1 when free */
+static unsigned int slotcount;
+static Staging staging[STAGINGSLOTS];
+static unsigned char *stagingmap;
+static size_t vertexbytes, stagingstride;
+static GLuint vertexpool, indexpool, stagingbuffer, vao, objectbuffer,
+	meshbuffer;
+static GLsizei *counts;
+static const void **offsets;
+static GLint *bases;
+static GLsizei drawcount;
+static float fit[4];            /* xyz offset, w scale, as Object */
+static unsigned int frame;
+static StreamStats stats;
+static pthread_t loader;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static int running, quit;
+
+/* Function implementations */
+
+void
+mapreset(VertexMap *map)
+{
+    memset(map->keys, 0xff, sizeof(map->keys));
+    map->count = 0;
+}
+
+uint32_t
+mapvertex(VertexMap *map, uint32_t v)
+{
+    uint32_t h;
+
+    for (h = (v * 2654435761u) & (HASHSIZE - 1); map->keys[h] != EMPTY;
+	    h = (h + 1) & (HASHSIZE - 1))
+	if (map->keys[h] == v)
+	    return map->values[h];
+    map->keys[h] = v;
+
+    return map->values[h] = map->count++;
+}
+
+int
+splitchunks(void)
+{
+    VertexMap *map;
+    Chunk *c;
+    const float *p;
+    float lo[3], hi[3], d;
+    unsigned int i, j, k, v, triangles;
+
+    /* Runs of triangles in the optimised order, so chunks are compact */
+    triangles = source->indexcount / 3;
+    if (!(map = (VertexMap *) malloc(sizeof(VertexMap))) ||
+	    !(chunks = (Chunk *) calloc(triangles /
+		    ((CHUNKVERTICES - 2) / 3) + 1, sizeof(Chunk)))) {
+	free(map);
+	return 0;
+    }
+    mapreset(map);
+    for (i = 0, c = chunks; i < triangles; i++) {
+	if (map->count + 3 > CHUNKVERTICES ||
+		(i - c->first / 3) * 3 + 3 > CHUNKINDICES) {
+	    c++;
+	    c->first = i * 3;
+	    mapreset(map);
+	}
+	for (k = 0; k < 3; k++) {
+	    v = source->indices[i * 3 + k];
+	    p = source->positions + v * 3;
+	    if (!c->count && !k) {
+		memcpy(lo, p, sizeof(lo));
+		memcpy(hi, p, sizeof(hi));
+	    }
+	    for (j = 0; j < 3; j++) {
+		lo[j] = p[j] < lo[j] ? p[j] : lo[j];
+		hi[j] = p[j] > hi[j] ? p[j] : hi[j];
+	    }
+	    mapvertex(map, v);
+	}
+	c->count += 3;
+	for (j = 0, d = 0.0f; j < 3; j++) {
+	    c->sphere[j] = 0.5f * (lo[j] + hi[j]);
+	    d += (hi[j] - lo[j]) * (hi[j] - lo[j]);
+	}
+	c->sphere[3] = 0.5f * sqrtf(d);
+	c->slot = -1;
+    }
+    chunkcount = triangles ? (unsigned int) (c - chunks) + 1 : 0;
+    free(map);
+
+    return 1;
+}
+
+void
+fillchunk(Chunk *c, unsigned char *dst, VertexMap *map, float *scratch)
+{
+    Mesh m;
+    uint32_t *indices, v, local;
+    unsigned int i;
+
+    /* Chunk-local indices after the vertices, the vertices gathered and
+     * packed like a mesh of their own sharing the source's bounds. The
+     * scratch holds them and then their quantised positions. */
+    memset(&m, 0, sizeof(m));
+    m.positions = scratch;
+    m.normals = scratch + CHUNKVERTICES * 3;
+    m.uvs = scratch + CHUNKVERTICES * 6;
+    memcpy(m.min, source->min, sizeof(m.min));
+    memcpy(m.max, source->max, sizeof(m.max));
+    indices = (uint32_t *) (dst + vertexbytes);
+    mapreset(map);
+    for (i = 0; i < c->count; i++) {
+	v = source->indices[c->first + i];
+	local = mapvertex(map, v);
+	indices[i] = local;
+	if (local + 1 == map->count) {
+	    memcpy(m.positions + local * 3, source->positions + v * 3,
+		    3 * sizeof(float));
+	    memcpy(m.normals + local * 3, source->normals + v * 3,
+		    3 * sizeof(float));
+	    memcpy(m.uvs + local * 2, source->uvs + v * 2, 2 * sizeof(float));
+	}
+    }
+    m.vertexcount = c->vertexcount = map->count;
+
+    vformatpack(dst, &m, &vformat,
+	    (unsigned short *) (scratch + CHUNKVERTICES * 8));
+}
+
+void *
+loadthread(void *arg)
+{
+    VertexMap *map;
+    float *scratch;
+    unsigned int i, s, c = 0;
+
+    (void) arg;
+    map = (VertexMap *) malloc(sizeof(VertexMap));
+    scratch = (float *) malloc(CHUNKVERTICES * 8 * sizeof(float) +
+	    CHUNKVERTICES * VFORMATSCRATCH * sizeof(unsigned short));
+
+    /* Take the first idle request while a staging slot is free, reading
+     * the mapping may fault so it is done without the lock */
+    pthread_mutex_lock(&lock);
+    while (!quit && map && scratch) {
+	for (s = 0; s < STAGINGSLOTS && staging[s].state != STAGINGFREE; s++)
+	    ;
+	for (i = 0; i < requestcount; i++)
+	    if (chunks[c = requests[i]].state == CHUNKIDLE)
+		break;
+	if (s == STAGINGSLOTS || i == requestcount) {
+	    pthread_cond_wait(&wake, &lock);
+	    continue;
+	}
+	chunks[c].state = CHUNKLOADING;
+	staging[s].state = STAGINGFILLING;
+	staging[s].chunk = c;
+	pthread_mutex_unlock(&lock);
+
+	fillchunk(&chunks[c], stagingmap + s * stagingstride, map, scratch);
+
+	pthread_mutex_lock(&lock);
+	staging[s].state = STAGINGREADY;
+	chunks[c].state = CHUNKREADY;
+    }
+    pthread_mutex_unlock(&lock);
+    free(map);
+    free(scratch);
+
+    return NULL;
+}
+
+int
+streaminit(const Mesh *mesh, const VertexFormat *format, unsigned int count)
+{
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+	GL_MAP_COHERENT_BIT;
+    MeshRecord record;
+    Object object;
+    size_t slotbytes, avail;
+    float extent;
+    unsigned int i;
+
+    source = mesh;
+    vformat = *format;
+
+    /* Fixed size slots, vertices then indices, so nothing fragments. The
+     * pool shrinks to what is left of the GPU memory budget. */
+    vertexbytes = (size_t) CHUNKVERTICES * vformatstride(&vformat);
+    stagingstride = vertexbytes + CHUNKINDICES * sizeof(uint32_t);
+    slotbytes = stagingstride;
+    slotcount = count ? count : 1;
+    avail = vramavailable();
+    if (avail / slotbytes < slotcount + STAGINGSLOTS) {
+	slotcount = avail / slotbytes > STAGINGSLOTS ?
+	    (unsigned int) (avail / slotbytes) - STAGINGSLOTS : 1;
+	fprintf(stderr, "Streaming with %u of %u slots to fit the GPU memory "
+		"budget.\n", slotcount, count ? count : 1);
+    }
+    if (!splitchunks())
+	return 0;
+    stats.chunks = chunkcount;
+    slots = (int *) malloc(slotcount * sizeof(int));
+    candidates = (Request *) malloc((chunkcount ? chunkcount : 1) *
+	    sizeof(Request));
+    requests = (unsigned int *) malloc(REQUESTMAX * sizeof(unsigned int));
+    counts = (GLsizei *) malloc(slotcount * sizeof(GLsizei));
+    offsets = (const void **) malloc(slotcount * sizeof(void *));
+    bases = (GLint *) malloc(slotcount * sizeof(GLint));
+    if (!slots || !candidates || !requests || !counts || !offsets || !bases)
+	return 0;
+    for (i = 0; i < slotcount; i++)
+	slots[i] = -1;
+
+    glCreateBuffers(1, &vertexpool);
+    glNamedBufferStorage(vertexpool, vertexbytes * slotcount, NULL, 0);
+    vramtrack(GL_BUFFER, vertexpool, VRAMVERTEX, vertexbytes * slotcount,
+	    "stream");
+    glCreateBuffers(1, &indexpool);
+    glNamedBufferStorage(indexpool, (size_t) CHUNKINDICES * sizeof(uint32_t) *
+	    slotcount, NULL, 0);
+    vramtrack(GL_BUFFER, indexpool, VRAMINDEX, (size_t) CHUNKINDICES *
+	    sizeof(uint32_t) * slotcount, "stream");
+    glCreateBuffers(1, &stagingbuffer);
+    glNamedBufferStorage(stagingbuffer, stagingstride * STAGINGSLOTS, NULL,
+	    flags);
+    vramtrack(GL_BUFFER, stagingbuffer, VRAMSTAGING,
+	    stagingstride * STAGINGSLOTS, "stream");
+    if (!(stagingmap = (unsigned char *) glMapNamedBufferRange(stagingbuffer,
+		    0, stagingstride * STAGINGSLOTS, flags)))
+	return 0;
+    glCreateVertexArrays(1, &vao);
+    vformatsetup(vao, vertexpool, 0, &vformat);
+    glVertexArrayElementBuffer(vao, indexpool);
+
+    /* Fitted into the middle of the default view */
+    memset(&object, 0, sizeof(object));
+    for (i = 0, extent = 0.0f; i < 3; i++)
+	if (mesh->max[i] - mesh->min[i] > extent)
+	    extent = mesh->max[i] - mesh->min[i];
+    fit[3] = extent > 0.0f ? 1.8f / extent : 1.0f;
+    for (i = 0; i < 3; i++)
+	fit[i] = -0.5f * (mesh->min[i] + mesh->max[i]) * fit[3];
+    memcpy(object.transform, fit, sizeof(fit));
+    object.colour[0] = object.colour[1] = object.colour[2] = 0.8f;
+    object.colour[3] = 1.0f;
+    glCreateBuffers(1, &objectbuffer);
+    glNamedBufferStorage(objectbuffer, sizeof(object), &object, 0);
+    vramtrack(GL_BUFFER, objectbuffer, VRAMSTORAGE, sizeof(object),
+	    "stream");
+    memset(&record, 0, sizeof(record));
+    vformatbounds(mesh, vformat.position, record.scale, record.offset);
+    glCreateBuffers(1, &meshbuffer);
+    glNamedBufferStorage(meshbuffer, sizeof(record), &record, 0);
+    vramtrack(GL_BUFFER, meshbuffer, VRAMSTORAGE, sizeof(record), "stream");
+
+    quit = 0;
+    running = !pthread_create(&loader, NULL, loadthread, NULL);
+
+    return running;
+}
+
+int
+comparerequests(const void *a, const void *b)
+{
+    float pa = ((const Request *) a)->priority;
+    float pb = ((const Request *) b)->priority;
+
+    return (pa < pb) - (pa > pb);
+}
+
+int
+findslot(void)
+{
+    unsigned int i, oldest = 0;
+    int victim = -1;
+
+    /* A free slot, else the least recently used chunk not seen this frame */
+    for (i = 0; i < slotcount; i++) {
+	if (slots[i] < 0)
+	    return (int) i;
+	if (chunks[slots[i]].lastused != frame &&
+		(victim < 0 || chunks[slots[i]].lastused < oldest)) {
+	    victim = (int) i;
+	    oldest = chunks[slots[i]].lastused;
+	}
+    }
+    if (victim >= 0) {
+	chunks[slots[victim]].state = CHUNKIDLE;
+	chunks[slots[victim]].slot = -1;
+	slots[victim] = -1;
+	stats.resident--;
+    }
+
+    return victim;
+}
+
+void
+streamupdate(const float viewproj[16], float planes[6][4], size_t budget)
+{
+    const float *m = viewproj;
+    Chunk *c;
+    GLenum status;
+    float centre[3], radius, w;
+    size_t size, uploaded = 0;
+    unsigned int i, j, n = 0;
+    int s, slot;
+
+    if (!running)
+	return;
+    pthread_mutex_lock(&lock);
+    frame++;
+    drawcount = 0;
+    stats.visible = 0;
+
+    /* Staging slots come back once their copy has run, never waiting */
+    for (s = 0; s < STAGINGSLOTS; s++) {
+	if (staging[s].state != STAGINGCOPIED)
+	    continue;
+	status = glClientWaitSync(staging[s].fence, 0, 0);
+	if (status == GL_ALREADY_SIGNALED ||
+		status == GL_CONDITION_SATISFIED) {
+	    glDeleteSync(staging[s].fence);
+	    staging[s].fence = NULL;
+	    staging[s].state = STAGINGFREE;
+	}
+    }
+
+    /* Resident visible chunks are drawn, missing ones are asked for by
+     * their size on screen */
+    for (i = 0, c = chunks; i < chunkcount; i++, c++) {
+	for (j = 0; j < 3; j++)
+	    centre[j] = c->sphere[j] * fit[3] + fit[j];
+	radius = c->sphere[3] * fit[3];
+	for (j = 0; j < 6; j++)
+	    if (planes[j][0] * centre[0] + planes[j][1] * centre[1] +
+		    planes[j][2] * centre[2] + planes[j][3] < -radius)
+		break;
+	if (j < 6)
+	    continue;
+	c->seen = frame;
+	stats.visible++;
+	if (c->state == CHUNKRESIDENT) {
+	    c->lastused = frame;
+	} else if (c->state == CHUNKIDLE) {
+	    w = m[3] * centre[0] + m[7] * centre[1] + m[11] * centre[2] +
+		m[15];
+	    candidates[n].priority = radius / (w > 1e-3f ? w : 1e-3f);
+	    candidates[n++].chunk = i;
+	}
+    }
+
+    /* Ready chunks go into the pool within the budget, at least one a
+     * frame so a small budget still makes progress */
+    for (s = 0; s < STAGINGSLOTS; s++) {
+	if (staging[s].state != STAGINGREADY)
+	    continue;
+	c = &chunks[staging[s].chunk];
+	size = (size_t) c->vertexcount * vformatstride(&vformat) +
+	    c->count * sizeof(uint32_t);
+	if ((uploaded && uploaded + size > budget) || (slot = findslot()) < 0)
+	    break;
+	glCopyNamedBufferSubData(stagingbuffer, vertexpool, s * stagingstride,
+		slot * vertexbytes, c->vertexcount * vformatstride(&vformat));
+	glCopyNamedBufferSubData(stagingbuffer, indexpool, s * stagingstride +
+		vertexbytes, (GLintptr) slot * CHUNKINDICES *
+		sizeof(uint32_t), c->count * sizeof(uint32_t));
+	staging[s].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	staging[s].state = STAGINGCOPIED;
+	slots[slot] = (int) staging[s].chunk;
+	c->slot = slot;
+	c->state = CHUNKRESIDENT;
+	c->lastused = frame;
+	uploaded += size;
+	stats.uploaded += size;
+	stats.resident++;
+    }
+
+    for (i = 0; i < slotcount; i++) {
+	if (slots[i] < 0 || chunks[slots[i]].seen != frame)
+	    continue;
+	c = &chunks[slots[i]];
+	counts[drawcount] = (GLsizei) c->count;
+	offsets[drawcount] = (const void *) ((size_t) i * CHUNKINDICES *
+		sizeof(uint32_t));
+	bases[drawcount++] = (GLint) (i * CHUNKVERTICES);
+    }
+    stats.drawn = (unsigned int) drawcount;
+
+    qsort(candidates, n, sizeof(Request), comparerequests);
+    for (i = 0, requestcount = 0; i < n && i < REQUESTMAX; i++)
+	requests[requestcount++] = candidates[i].chunk;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+}
+
+void
+streamdraw(void)
+{
+    if (!drawcount)
+	return;
+    glBindVertexArray(vao);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, objectbuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, meshbuffer);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, GL_UNSIGNED_INT,
+	    offsets, drawcount, bases);
+}
+
+void
+streamstats(StreamStats *s)
+{
+    *s = stats;
+}
+
+void
+streamterm(void)
+{
+    int s;
+
+    if (running) {
+	pthread_mutex_lock(&lock);
+	quit = 1;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+	pthread_join(loader, NULL);
+	running = 0;
+    }
+    for (s = 0; s < STAGINGSLOTS; s++) {
+	if (staging[s].fence)
+	    glDeleteSync(staging[s].fence);
+	memset(&staging[s], 0, sizeof(Staging));
+    }
+    if (stagingmap)
+	glUnmapNamedBuffer(stagingbuffer);
+    vramuntrack(GL_BUFFER, vertexpool);
+    vramuntrack(GL_BUFFER, indexpool);
+    vramuntrack(GL_BUFFER, stagingbuffer);
+    vramuntrack(GL_BUFFER, objectbuffer);
+    vramuntrack(GL_BUFFER, meshbuffer);
+    glDeleteBuffers(1, &vertexpool);
+    glDeleteBuffers(1, &indexpool);
+    glDeleteBuffers(1, &stagingbuffer);
+    glDeleteBuffers(1, &objectbuffer);
+    glDeleteBuffers(1, &meshbuffer);
+    glDeleteVertexArrays(1, &vao);
+    vertexpool = indexpool = stagingbuffer = objectbuffer = meshbuffer = 0;
+    vao = 0;
+    stagingmap = NULL;
+    free(chunks);
+    free(candidates);
+    free(requests);
+    free(slots);
+    free(counts);
+    free(offsets);
+    free(bases);
+    chunks = NULL;
+    candidates = NULL;
+    requests = NULL;
+    slots = NULL;
+    counts = NULL;
+    offsets = NULL;
+    bases = NULL;
+    chunkcount = requestcount = slotcount = 0;
+    drawcount = 0;
+    memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,26 @@
+/* Out-of-core mesh streaming.
+ *
+ * A mapped mesh is cut into chunks of at most a few thousand vertices and
+ * triangles, each with a bounding sphere, and drawn from a fixed pool of
+ * GPU slots. Every streamupdate() culls the chunks against the frustum,
+ * keeps the visible resident ones in use and asks a loader thread for the
+ * missing ones, largest on screen first. The loader reads the chunk from
+ * the mapping, which may fault it in from disk, and packs it into a
+ * persistently mapped staging slot. streamupdate() then copies at most
+ * budget bytes of ready chunks into the pool, evicting the least recently
+ * used chunks that are not visible. streamdraw() draws whatever is resident
+ * through vertex.glsl, so a frame never waits on the disk.
+ * The mesh is fitted into the view. Requires scene.h and vformat.h. */
+
+typedef struct {
+    unsigned int chunks, resident, visible, drawn;
+    size_t uploaded;    /* Bytes copied into the pool, in total */
+} StreamStats;
+
+int streaminit(const Mesh *mesh, const VertexFormat *format,
+	unsigned int slots);
+void streamupdate(const float viewproj[16], float planes[6][4],
+	size_t budget);
+void streamdraw(void);
+void streamstats(StreamStats *stats);
+void streamterm(void);
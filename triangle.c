@@ -1,15 +1,90 @@
 #define GLAD_GL_IMPLEMENTATION
 #include "glad.h"
 #include <GLFW/glfw3.h>
+#include <assert.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "config.h"
+#include "arena.h"
+#include "buffer.h"
+#include "camera.h"
+#include "cmdlist.h"
+#include "hiz.h"
+#include "overdraw.h"
+#include "prof.h"
+#include "scene.h"
+#include "cluster.h"
+#include "cull.h"
+#include "import.h"
+#include "job.h"
+#include "mdi.h"
+#include "meshfile.h"
+#include "pull.h"
+#include "quant.h"
+#include "raster.h"
+#include "ring.h"
+#include "stats.h"
+#include "util.h"
+#include "vformat.h"
+#include "stream.h"
+#include "vram.h"
 
 /* Macros */
-#define COUNT(x)  (sizeof(x) / sizeof(x[0]))
-#define UNUSED(x) (void) (x)
+#define SPECMAX    4    /* Specialisation constants a shader may set */
+#define VARIANTMAX 32   /* Programs kept by the variant cache */
+#define LAYOUTANY  0xffffffffu /* Position format of each mesh's record */
+
+/* Types */
+/* Draw paths */
+enum {
+    PATHATTRIB, PATHPULL, PATHMDI, PATHCULL, PATHCLUSTER, PATHRING, PATHRANGE,
+    PATHUNIFORM, PATHCOUNT
+};
+
+/* Specialisation constant ids and values shared by the vertex shaders */
+enum { SPECOBJECT, SPECPOSITION };
+enum { OBJECTINSTANCE, OBJECTDRAW, OBJECTUNIFORM }; /* Where it is found */
+
+typedef struct {
+    GLuint ids[SPECMAX];
+    GLuint values[SPECMAX];
+    unsigned int count;
+} Specialisation;       /* Constants set on one shader stage */
+
+typedef struct {
+    const char *vertexfile, *fragmentfile;
+    Specialisation spec; /* Of the vertex stage */
+    GLuint program;
+} Variant;              /* A specialised program in the cache */
+
+typedef struct {
+    const char *vertexfile;
+    GLuint object;      /* OBJECTINSTANCE and so on */
+    int pulled;         /* Positions from the pulling buffer */
+} PathShader;
+
+typedef struct {
+    float viewproj[16];
+    float planes[6][4];
+    float viewport[4];  /* Framebuffer and depth pyramid size */
+    unsigned int objectcount, usehiz, hizlevels, pad;
+    float eye[4];       /* Camera position, w 1, or view direction, w 0 */
+    float lodrefine, lodcoarsen, pad1[2]; /* Pixels */
+} Frame;                /* std140 Frame block in the shaders */
+
+typedef struct {
+    GLuint program;
+    unsigned char *blocks;  /* Objects copied into the ring this frame */
+    GLintptr offset;        /* Of blocks in the ring */
+    size_t stride;
+    unsigned int fit;       /* Objects with a copy */
+    int failed;
+} Recorder;             /* Shared by the jobs recording draws */
+
+#include "config.h"
 
 /* Function prototypes */
 static void errorcallback(int err, const char *desc);
@@ -24,24 +99,79 @@ void APIENTRY gldebugoutput(GLenum source, GLenum type, unsigned int id,
 	const void *userparam);
 #endif /* !NDEBUG */
 static void createwindow(void);
+static void drawraster(void);
 static char *createshadercode(const char *filename, size_t *size);
-static void deleteshadercode(char **code);
+static GLuint createshaderbin(GLenum type, const char *code, size_t size,
+	const Specialisation *spec);
+static GLuint loadshader(GLenum type, const char *filename,
+	const Specialisation *spec);
+static GLuint linkprogram(GLuint prog);
+static GLuint createprogram(const char *vertexfile, const char *fragmentfile,
+	const Specialisation *spec);
+static GLuint createvariant(const char *vertexfile, const char *fragmentfile,
+	const Specialisation *spec);
+static GLuint createcompute(const char *computefile);
+static void specialise(int p, Specialisation *spec);
 static int loadshaders(void);
+static void loadscene(void);
+static void createtargets(int width, int height);
+static void deletetargets(void);
+static const BufferRange *packmesh(const Mesh *m);
+static void repackvertices(void);
+static void bindranges(void);
+static void pointranges(void);
+static void updateframe(void);
+static void recorddraws(void *arg, unsigned int first, unsigned int last);
+static void drawscene(GLuint program);
+static void drawstream(GLuint program);
 static void drawframe(void);
+static void usage(void);
+static int findpath(const char *name);
 
 /* Variables */
 static const unsigned int ignorelog[] = {
     131185 /* Buffer info */
 };
-static const float vertices[] = {
-    -0.5f, -0.5f, 0.0f,
-    0.5f, -0.5f, 0.0f,
-    0.0f,  0.5f, 0.0f
-};
-static const unsigned int verticecount = 3;
 static const char readonlybinary[] = "rb";
+static const float clearcolour[] = { 0.2f, 0.3f, 0.3f, 1.0f };
+static const char *const pathnames[] = {
+    "attrib", "pull", "mdi", "cull", "cluster", "ring", "range", "uniform"
+};
+static const PathShader pathshaders[] = {
+    { vertexspirv, OBJECTINSTANCE, 0 },     /* attrib */
+    { vertexpullspirv, OBJECTINSTANCE, 1 }, /* pull */
+    { vertexpullspirv, OBJECTDRAW, 1 },     /* mdi */
+    { vertexpullspirv, OBJECTDRAW, 1 },     /* cull */
+    { vertexpullspirv, OBJECTDRAW, 1 },     /* cluster */
+    { vertexspirv, OBJECTINSTANCE, 0 },     /* ring */
+    { vertexspirv, OBJECTINSTANCE, 0 },     /* range */
+    { vertexspirv, OBJECTUNIFORM, 0 }       /* uniform */
+};
 static GLFWwindow *window;
-static GLuint program, vbo, vao;
+static GLuint programs[PATHCOUNT], countprograms[PATHCOUNT], heatprogram;
+static Variant variants[VARIANTMAX]; /* Own the programs above */
+static unsigned int variantcount, variantuses;
+static GLuint cullprogram, clusterprogram, hizprogram;
+static GLuint scenefbo, scenecolour, scenedepth;
+static int fbwidth, fbheight;
+static GLuint *vaos;
+static const BufferRange **vertexranges, **indexranges;
+static const BufferRange *objectrange, *framerange;
+static VertexFormat attribformat; /* vertexformat, floats toggled by v */
+static int floatattribs, repack;
+static float viewproj[16];      /* This frame's, for sorting draws */
+static Arena framearena;        /* Emptied at the start of every frame */
+static Arena loadarena;         /* Scratch while loading, freed after */
+static Scene scene;
+static Camera camera = {
+    { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+    0.0f, 1.0f, 0.0f, 2.0f
+};
+static unsigned int objects = objectcount, layers = layercount;
+static const char *meshname = meshfile, *streamname, *rastername;
+static Mesh streammesh;
+static int path, showstats, overdraw, heatmap, bench;
+static int scenepass = -1, overdrawpass = -1, cullpass = -1, hizpass = -1;
 
 /* Function implementations */
 
@@ -56,24 +186,73 @@ errorcallback(int err, const char *desc)
 void
 init(void)
 {
+    PROFBEGIN("init");
     glfwSetErrorCallback(errorcallback);
 
     if (!glfwInit())
 	exit(EXIT_FAILURE);
+    PROFEND();
 }
 
 void
 term(int status, const char *fmt, ...)
 {
     va_list ap;
+    unsigned int i;
 
-    if (window)
-	glfwDestroyWindow(window);
+    profcollect(1);
+    if (tracefile[0] && !profwrite(tracefile))
+	fprintf(stderr, "Could not write trace %s.\n", tracefile);
+    cmdterm();
+    arenaterm(&framearena);
+    arenaterm(&loadarena);
+    jobterm();
+    if (showstats && window)
+	vramreport(stdout);
+    profterm();
+    statsterm();
+    if (overdraw && window)
+	overdrawterm();
+    if (scenefbo) {
+	deletetargets();
+	hizterm();
+    }
+    if (vaos) {
+	glDeleteVertexArrays(scene.meshcount, vaos);
+	for (i = 0; vertexranges && indexranges && i < scene.meshcount; i++) {
+	    buffree(vertexranges[i]);
+	    buffree(indexranges[i]);
+	}
+	buffree(objectrange);
+	buffree(framerange);
+	objectrange = framerange = NULL;
+	bufterm();
+	ringterm();
+	pullterm();
+	streamterm();
+	meshunload(&streammesh);
+	mditerm();
+	cullterm();
+	clusterterm();
+    }
+    free(vaos);
+    free(vertexranges);
+    free(indexranges);
+    scenefree(&scene);
+
+    rasterterm();
 
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
-    glDeleteProgram(program);
+    /* No GL to clean up after -c or a failed load */
+    if (window) {
+	for (i = 0; i < variantcount; i++)
+	    glDeleteProgram(variants[i].program);
+	glDeleteProgram(cullprogram);
+	glDeleteProgram(clusterprogram);
+	glDeleteProgram(hizprogram);
+	glfwDestroyWindow(window);
+    }
     glfwTerminate();
+    vramterm();
 
     if (fmt) {
 	va_start(ap, fmt);
@@ -92,6 +271,32 @@ keycallback(GLFWwindow *window, int key, int scancode, int action, int mods)
 
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+    if (action == GLFW_RELEASE)
+	return;
+    switch (key) {
+    case GLFW_KEY_LEFT:
+	camerapan(&camera, -panstep, 0.0f);
+	break;
+    case GLFW_KEY_RIGHT:
+	camerapan(&camera, panstep, 0.0f);
+	break;
+    case GLFW_KEY_DOWN:
+	camerapan(&camera, 0.0f, -panstep);
+	break;
+    case GLFW_KEY_UP:
+	camerapan(&camera, 0.0f, panstep);
+	break;
+    case GLFW_KEY_EQUAL:
+	camerazoom(&camera, zoomstep);
+	break;
+    case GLFW_KEY_MINUS:
+	camerazoom(&camera, 1.0f / zoomstep);
+	break;
+    case GLFW_KEY_V:
+	repack = 1;
+	break;
+    }
 }
 
 void
@@ -99,7 +304,16 @@ resizecallback(GLFWwindow* window, int width, int height)
 {
     UNUSED(window);
 
+    /* Minimised windows report a zero size, keep the old targets */
+    if (!width || !height)
+	return;
+
     glViewport(0, 0, width, height);
+    createtargets(width, height);
+    if (!hizinit(width, height))
+	term(EXIT_FAILURE, "Failed to create depth pyramid.\n");
+    if (overdraw)
+	overdrawresize(width, height);
 }
 
 #ifndef NDEBUG
@@ -138,6 +352,7 @@ createwindow(void)
 {
     int version, flags;
 
+    PROFBEGIN("createwindow");
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, openglmajor);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, openglminor);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -148,16 +363,22 @@ createwindow(void)
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
 #endif /* !NDEBUG */
     if (!(window = glfwCreateWindow(width, height, title, NULL, NULL)))
-	term(EXIT_FAILURE, NULL);
+	term(EXIT_FAILURE, "No OpenGL %u.%u window, -c draws on the CPU.\n",
+		openglmajor, openglminor);
 
     glfwMakeContextCurrent(window);
 
-    if (!(version = gladLoadGL(glfwGetProcAddress)))
-	term(EXIT_FAILURE, "Failed to load OpenGL.\n");
+    if (!(version = gladLoadGL(glfwGetProcAddress))) {
+	glfwDestroyWindow(window);
+	window = NULL;
+	term(EXIT_FAILURE, "Failed to load OpenGL, -c draws on the CPU.\n");
+    }
+    profgpuinit();
 
     glfwSetKeyCallback(window, keycallback);
     glfwSetFramebufferSizeCallback(window, resizecallback);
-    glfwSwapInterval(1);
+    /* Benchmarks measure the draw paths, not vsync */
+    glfwSwapInterval(bench ? 0 : 1);
 
 #ifndef NDEBUG
     glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
@@ -167,8 +388,51 @@ createwindow(void)
 	glDebugMessageCallback(gldebugoutput, NULL);
 	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL,
 		GL_TRUE);
+	/* Profiling zones push and pop debug groups every frame */
+	glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION,
+		GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 0, NULL, GL_FALSE);
+	glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION,
+		GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 0, NULL, GL_FALSE);
     }
 #endif /* !NDEBUG */
+    PROFEND();
+}
+
+void
+drawraster(void)
+{
+    RasterStats rs;
+    float viewproj[16], aspect;
+    unsigned int triangles;
+
+    /* The GL paths' view and scene, without a window */
+    loadscene();
+    if (!rasterinit(width, height))
+	term(EXIT_FAILURE, "Failed to create %ux%u image.\n", width, height);
+    aspect = camera.fovy > 0.0f ? (float) width / height : 1.0f;
+    cameramatrix(&camera, aspect, viewproj);
+    if (bench)
+	term(rasterbench(stdout, &scene, viewproj, rasterthreads) ?
+		EXIT_SUCCESS : EXIT_FAILURE, NULL);
+
+    PROFBEGIN("drawraster");
+    rasterclear(clearcolour);
+    if (!rasterdraw(&scene, viewproj, rasterthreads, &triangles))
+	term(EXIT_FAILURE, "Failed to draw on the CPU.\n");
+    if (showstats) {
+	rasterstats(&rs);
+	printf("%u triangles set up, %s kernel, %u threads, setup %.3f ms, "
+		"draw %.3f ms\n", triangles, rasterkernel(), rs.threads,
+		rs.setup * 1e3, rs.draw * 1e3);
+	printf("%u tiles, %.1f triangles a tile, %u in the fullest, "
+		"imbalance %.2f, %u steals\n", rs.tiles, (double) rs.binned /
+		rs.tiles, rs.fullest, rs.mean > 0.0 ? rs.busiest / rs.mean :
+		1.0, rs.steals);
+    }
+    PROFEND();
+    if (!rasterwrite(rastername))
+	term(EXIT_FAILURE, "Could not write image %s.\n", rastername);
+    term(EXIT_SUCCESS, NULL);
 }
 
 char *
@@ -184,7 +448,8 @@ createshadercode(const char *filename, size_t *size)
         term(EXIT_FAILURE, "Error on seeking file %s.\n", filename);
     *size = ftell(fp);
     rewind(fp);
-    code = (char *) malloc(*size * sizeof(char));
+    if (!(code = (char *) arenaalloc(&loadarena, *size * sizeof(char))))
+	term(EXIT_FAILURE, "Out of memory reading file %s.\n", filename);
     if (fread(code, sizeof(char), *size, fp) < *size)
         term(EXIT_FAILURE, "Error reading file %s.\n", filename);
 
@@ -194,14 +459,9 @@ createshadercode(const char *filename, size_t *size)
     return code;
 }
 
-void
-deleteshadercode(char **code)
-{
-    free(*code);
-}
-
 GLuint
-createshaderbin(GLenum type, const char *code, size_t size)
+createshaderbin(GLenum type, const char *code, size_t size,
+	const Specialisation *spec)
 {
     GLuint shader;
     GLint iscompiled, maxlength;
@@ -211,108 +471,775 @@ createshaderbin(GLenum type, const char *code, size_t size)
     /* Requires OpenGL 4.6 */
     glShaderBinary(1, &shader, GL_SHADER_BINARY_FORMAT_SPIR_V,
 	    (const void *) code, size);
-    glSpecializeShader(shader, (const GLchar*) shaderentry, 0, NULL,
-	    NULL);
+    if (spec)
+	glSpecializeShader(shader, (const GLchar*) shaderentry, spec->count,
+		spec->ids, spec->values);
+    else
+	glSpecializeShader(shader, (const GLchar*) shaderentry, 0, NULL,
+		NULL);
     glGetShaderiv(shader, GL_COMPILE_STATUS, &iscompiled);
     if (!iscompiled) {
 	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &maxlength);
-	if (maxlength) {
-	    log = (GLchar *) malloc(maxlength * sizeof(GLchar));
+	/* Freed with the caller's scope */
+	if (maxlength && (log = (GLchar *) arenaalloc(&loadarena, maxlength *
+			sizeof(GLchar)))) {
 	    glGetShaderInfoLog(shader, maxlength, &maxlength, &log[0]);
 	    fprintf(stderr, (char *) log);
-	    free(log);
-	    glDeleteShader(shader);
 	}
+	glDeleteShader(shader);
 	return 0;
     }
 
     return shader;
 }
 
-int
-loadshaders(void)
+GLuint
+loadshader(GLenum type, const char *filename, const Specialisation *spec)
+{
+    ArenaMark mark = arenamark(&loadarena);
+    size_t codesize;
+    char *code;
+    GLuint shader;
+
+    code = createshadercode(filename, &codesize);
+    shader = createshaderbin(type, code, codesize, spec);
+    arenarelease(&loadarena, mark);
+
+    return shader;
+}
+
+GLuint
+linkprogram(GLuint prog)
 {
-    size_t vertexcodesize, fragmentcodesize;
-    char *vertexcode, *fragmentcode;
-    GLuint vertexshader, fragmentshader;
+    ArenaMark mark = arenamark(&loadarena);
     GLint islinked, maxlength;
     GLchar *log;
-    
-    vertexcode = createshadercode(vertexspirv, &vertexcodesize);
-    fragmentcode = createshadercode(fragmentspirv, &fragmentcodesize);
-    vertexshader = createshaderbin(GL_VERTEX_SHADER, vertexcode,
-	    vertexcodesize);
-    fragmentshader = createshaderbin(GL_FRAGMENT_SHADER, fragmentcode,
-	    fragmentcodesize);
-    deleteshadercode(&vertexcode);
-    deleteshadercode(&fragmentcode);
-
-    if (!vertexshader || !fragmentshader)
+
+    glLinkProgram(prog);
+    glGetProgramiv(prog, GL_LINK_STATUS, (int *) &islinked);
+    if (!islinked) {
+	glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &maxlength);
+	if (maxlength && (log = (GLchar *) arenaalloc(&loadarena, maxlength *
+			sizeof(GLchar)))) {
+	    glGetProgramInfoLog(prog, maxlength, &maxlength, &log[0]);
+	    fprintf(stderr, (char *) log);
+	}
+	arenarelease(&loadarena, mark);
+	glDeleteProgram(prog);
+	return 0;
+    }
+
+    return prog;
+}
+
+GLuint
+createprogram(const char *vertexfile, const char *fragmentfile,
+	const Specialisation *spec)
+{
+    GLuint vertexshader, fragmentshader, prog;
+
+    vertexshader = loadshader(GL_VERTEX_SHADER, vertexfile, spec);
+    fragmentshader = loadshader(GL_FRAGMENT_SHADER, fragmentfile, NULL);
+    if (!vertexshader || !fragmentshader) {
+	glDeleteShader(vertexshader);
+	glDeleteShader(fragmentshader);
 	return 0;
+    }
 
-    program = glCreateProgram();
-    glAttachShader(program, vertexshader);
-    glAttachShader(program, fragmentshader);
-    glLinkProgram(program);
+    prog = glCreateProgram();
+    glAttachShader(prog, vertexshader);
+    glAttachShader(prog, fragmentshader);
     glDeleteShader(vertexshader);
     glDeleteShader(fragmentshader);
 
-    glGetProgramiv(program, GL_LINK_STATUS, (int *) &islinked);
-    if (!islinked) {
-	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxlength);
-	if (maxlength) {
-	    log = (GLchar *) malloc(maxlength * sizeof(GLchar));
-	    glGetProgramInfoLog(program, maxlength, &maxlength, &log[0]);
-	    fprintf(stderr, (char *) log);
-	    free(log);
-	}
-	glDeleteProgram(program);
+    return linkprogram(prog);
+}
+
+GLuint
+createvariant(const char *vertexfile, const char *fragmentfile,
+	const Specialisation *spec)
+{
+    Variant *v;
+    unsigned int i;
+
+    /* Paths sharing shaders and constants share a program. Files are
+     * compared by pointer, they all come from config.h. */
+    variantuses++;
+    for (i = 0; i < variantcount; i++) {
+	v = &variants[i];
+	if (v->vertexfile == vertexfile && v->fragmentfile == fragmentfile &&
+		!memcmp(&v->spec, spec, sizeof(*spec)))
+	    return v->program;
+    }
+    if (variantcount == VARIANTMAX) {
+	fputs("Too many shader variants.\n", stderr);
 	return 0;
     }
 
-    return 1;
+    v = &variants[variantcount];
+    if (!(v->program = createprogram(vertexfile, fragmentfile, spec)))
+	return 0;
+    v->vertexfile = vertexfile;
+    v->fragmentfile = fragmentfile;
+    v->spec = *spec;
+    variantcount++;
+
+    return v->program;
+}
+
+GLuint
+createcompute(const char *computefile)
+{
+    GLuint computeshader, prog;
+
+    if (!(computeshader = loadshader(GL_COMPUTE_SHADER, computefile, NULL)))
+	return 0;
+
+    prog = glCreateProgram();
+    glAttachShader(prog, computeshader);
+    glDeleteShader(computeshader);
+
+    return linkprogram(prog);
+}
+
+void
+specialise(int p, Specialisation *spec)
+{
+    const PathShader *ps = &pathshaders[p];
+
+    /* Zeroed whole so the cache can compare them with memcmp */
+    memset(spec, 0, sizeof(*spec));
+    spec->ids[spec->count] = SPECOBJECT;
+    spec->values[spec->count++] = ps->object;
+    if (ps->pulled) {
+	spec->ids[spec->count] = SPECPOSITION;
+	spec->values[spec->count++] = specialisepositions ?
+	    (GLuint) vertexformat.position : LAYOUTANY;
+    }
+}
+
+int
+loadshaders(void)
+{
+    Specialisation spec, none;
+    int i, ok = 1;
+
+    PROFBEGIN("loadshaders");
+    memset(&none, 0, sizeof(none));
+    for (i = 0; i < PATHCOUNT; i++) {
+	specialise(i, &spec);
+	programs[i] = createvariant(pathshaders[i].vertexfile, fragmentspirv,
+		&spec);
+	ok = ok && programs[i];
+    }
+    cullprogram = createcompute(cullspirv);
+    clusterprogram = createcompute(clusterspirv);
+    hizprogram = createcompute(hizspirv);
+    ok = ok && cullprogram && clusterprogram && hizprogram;
+    if (ok && overdraw) {
+	for (i = 0; i < PATHCOUNT; i++) {
+	    specialise(i, &spec);
+	    countprograms[i] = createvariant(pathshaders[i].vertexfile,
+		    overdrawspirv, &spec);
+	    ok = ok && countprograms[i];
+	}
+	heatprogram = createvariant(fullscreenspirv, heatmapspirv, &none);
+	ok = ok && heatprogram;
+    }
+    if (ok && showstats)
+	printf("%u programs linked for %u uses\n", variantcount,
+		variantuses);
+    PROFEND();
+
+    return ok;
+}
+
+void
+createtargets(int width, int height)
+{
+    deletetargets();
+    fbwidth = width;
+    fbheight = height;
+
+    /* The scene renders offscreen so its depth can be sampled */
+    glCreateRenderbuffers(1, &scenecolour);
+    glNamedRenderbufferStorage(scenecolour, GL_RGBA8, width, height);
+    vramtrack(GL_RENDERBUFFER, scenecolour, VRAMTARGET,
+	    (size_t) width * height * 4, "scene");
+    glCreateTextures(GL_TEXTURE_2D, 1, &scenedepth);
+    glTextureStorage2D(scenedepth, 1, GL_DEPTH_COMPONENT32F, width, height);
+    vramtrack(GL_TEXTURE, scenedepth, VRAMTARGET,
+	    (size_t) width * height * sizeof(float), "scene");
+    glTextureParameteri(scenedepth, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(scenedepth, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glCreateFramebuffers(1, &scenefbo);
+    glNamedFramebufferRenderbuffer(scenefbo, GL_COLOR_ATTACHMENT0,
+	    GL_RENDERBUFFER, scenecolour);
+    glNamedFramebufferTexture(scenefbo, GL_DEPTH_ATTACHMENT, scenedepth, 0);
+    if (glCheckNamedFramebufferStatus(scenefbo, GL_FRAMEBUFFER) !=
+	    GL_FRAMEBUFFER_COMPLETE)
+	term(EXIT_FAILURE, "Failed to create scene framebuffer.\n");
+}
+
+void
+deletetargets(void)
+{
+    glDeleteFramebuffers(1, &scenefbo);
+    vramuntrack(GL_RENDERBUFFER, scenecolour);
+    vramuntrack(GL_TEXTURE, scenedepth);
+    glDeleteRenderbuffers(1, &scenecolour);
+    glDeleteTextures(1, &scenedepth);
+    scenefbo = scenecolour = scenedepth = 0;
+}
+
+void
+loadscene(void)
+{
+    Mesh mesh;
+    double acmr[2], atvr[2];
+
+    PROFBEGIN("loadscene");
+    /* The indices and vertices are uploaded straight from the mapping, an
+     * OBJ or PLY file is imported and optimised here instead */
+    if (!meshload(&mesh, meshname) && (!importmesh(&mesh, meshname,
+		    importthreads) || !scenemesh(&mesh)))
+	term(EXIT_FAILURE, "Could not load mesh %s.\n", meshname);
+    if (!scenecreate(&scene, &mesh, meshcount, polygonrings, objects, layers))
+	term(EXIT_FAILURE, "Failed to create scene.\n");
+    if (meshoptimise) {
+	if (!sceneoptimise(&scene, acmr, atvr))
+	    term(EXIT_FAILURE, "Failed to optimise meshes.\n");
+	if (showstats)
+	    printf("vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		    acmr[0], acmr[1], atvr[0], atvr[1]);
+    }
+    if (!scenelods(&scene))
+	term(EXIT_FAILURE, "Failed to simplify meshes.\n");
+    if (!scenemeshlets(&scene))
+	term(EXIT_FAILURE, "Failed to build meshlets.\n");
+    PROFEND();
 }
 
 void
 loadvertices(void)
 {
-    int count = COUNT(vertices) / verticecount;
+    const Mesh *m;
+    BufferStats bs;
+    unsigned int i, stride;
+    size_t size;
+
+    PROFBEGIN("loadvertices");
+    loadscene();
+
+    /* Attribute path, packed vertices, indices and a VAO per mesh, the
+     * vertices and indices sharing a few large buffers */
+    vaos = (GLuint *) calloc(scene.meshcount, sizeof(GLuint));
+    vertexranges = (const BufferRange **) calloc(scene.meshcount,
+	    sizeof(BufferRange *));
+    indexranges = (const BufferRange **) calloc(scene.meshcount,
+	    sizeof(BufferRange *));
+    if (!vaos || !vertexranges || !indexranges || !bufinit(buffersize))
+	term(EXIT_FAILURE, "Failed to allocate vertex arrays.\n");
+    glCreateVertexArrays(scene.meshcount, vaos);
+    attribformat = vertexformat;
+    stride = vformatstride(&attribformat);
+    for (i = 0, size = 0; i < scene.meshcount; i++) {
+	m = &scene.meshes[i];
+	vertexranges[i] = packmesh(m);
+	indexranges[i] = bufalloc(m->indexcount * sizeof(unsigned int),
+		m->indices);
+	if (!vertexranges[i] || !indexranges[i])
+	    term(EXIT_FAILURE, "Out of buffer space for mesh %u.\n", i);
+	size += (size_t) m->vertexcount * stride;
+    }
+    if (showstats)
+	printf("vertices %u bytes each, %.1f MB in all, %s conversion\n",
+		stride, size / 1e6, quantkernel());
+
+    /* Shared by every path, indexed by gl_BaseInstance + gl_InstanceID */
+    if (!(objectrange = bufalloc(scene.objectcount * sizeof(Object),
+		    scene.objects)) ||
+	    !(framerange = bufalloc(sizeof(Frame), NULL)))
+	term(EXIT_FAILURE, "Out of buffer space for objects.\n");
+    pointranges();
+
+    /* Ring and range paths, a copy of each object for the overdraw and
+     * scene passes at up to the largest binding alignment */
+    size = 2 * (size_t) scene.objectcount * 256;
+    if (!ringinit(size < ringsize ? size : ringsize))
+	term(EXIT_FAILURE, "Failed to map the per-draw ring.\n");
+    if (showstats) {
+	bufstats(&bs);
+	printf("buffers %u, %.1f of %.1f MB in %u ranges, %.0f%% of free "
+		"space fragmented\n", bs.buffers, bs.used / 1e6,
+		bs.capacity / 1e6, bs.ranges, bs.fragmentation * 100.0);
+    }
 
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);  
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, verticecount, GL_FLOAT, GL_FALSE,
-	    count * sizeof(float), (void *) 0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0); 
+    if (!pullinit(&scene, vertexformat.position))
+	term(EXIT_FAILURE, "Failed to pack vertices.\n");
+    if (!mdiinit(&scene) || !cullinit(&scene) ||
+	    !clusterinit(&scene))
+	term(EXIT_FAILURE, "Failed to map indirect buffers.\n");
+    PROFEND();
+}
+
+const BufferRange *
+packmesh(const Mesh *m)
+{
+    ArenaMark mark = arenamark(&loadarena);
+    const BufferRange *range;
+    unsigned short *quantised;
+    unsigned char *packed, *end;
+    size_t count = m->vertexcount ? m->vertexcount : 1;
+
+    if (!(packed = (unsigned char *) arenaalloc(&loadarena, count *
+			vformatstride(&attribformat))) ||
+	    !(quantised = (unsigned short *) arenaalloc(&loadarena, count *
+			VFORMATSCRATCH * sizeof(unsigned short))))
+	term(EXIT_FAILURE, "Failed to pack vertices.\n");
+    end = vformatpack(packed, m, &attribformat, quantised);
+    range = bufalloc(end - packed, packed);
+    arenarelease(&loadarena, mark);
+
+    return range;
 }
 
 void
-drawframe(void)
+repackvertices(void)
 {
-    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+    size_t moved;
+    unsigned int i;
 
+    /* Normals and texture coordinates as floats or as configured, the
+     * positions are shared with the pulling buffer and stay as they are */
+    floatattribs = !floatattribs;
+    attribformat.normal = floatattribs ? FORMATFLOAT : vertexformat.normal;
+    attribformat.uv = floatattribs ? FORMATFLOAT : vertexformat.uv;
+
+    /* Each mesh's old range is freed as its new one is made. The gaps
+     * left are closed before the vertex arrays are pointed again. */
+    if (!arenainit(&loadarena, loadarenasize))
+	term(EXIT_FAILURE, "Out of memory repacking vertices.\n");
+    for (i = 0; i < scene.meshcount; i++) {
+	buffree(vertexranges[i]);
+	if (!(vertexranges[i] = packmesh(&scene.meshes[i])))
+	    term(EXIT_FAILURE, "Out of buffer space for mesh %u.\n", i);
+    }
+    arenaterm(&loadarena);
+    moved = bufdefrag();
+    pointranges();
+    if (showstats)
+	printf("vertices %u bytes each, %.1f MB moved closing the gaps\n",
+		vformatstride(&attribformat), moved / 1e6);
+}
+
+void
+bindranges(void)
+{
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, objectrange->buffer,
+	    objectrange->offset, objectrange->size);
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, framerange->buffer,
+	    framerange->offset, framerange->size);
+}
+
+void
+pointranges(void)
+{
+    unsigned int i;
+
+    /* Again after every bufdefrag(), which moves ranges */
+    for (i = 0; i < scene.meshcount; i++) {
+	vformatsetup(vaos[i], vertexranges[i]->buffer,
+		vertexranges[i]->offset, &attribformat);
+	glVertexArrayElementBuffer(vaos[i], indexranges[i]->buffer);
+    }
+    bindranges();
+}
+
+void
+updateframe(void)
+{
+    Frame f;
+    int hizwidth, hizheight;
+    float aspect;
+
+    /* A 2D camera stretches the scene over the window like the original
+     * triangle, a perspective one keeps the aspect ratio */
+    aspect = camera.fovy > 0.0f && fbheight ? (float) fbwidth / fbheight : 1.0f;
+
+    memset(&f, 0, sizeof(f));
+    cameramatrix(&camera, aspect, f.viewproj);
+    cameraplanes(f.viewproj, f.planes);
+    cameraeye(&camera, f.eye);
+    hizsize(&hizwidth, &hizheight);
+    f.viewport[0] = fbwidth;
+    f.viewport[1] = fbheight;
+    f.viewport[2] = hizwidth;
+    f.viewport[3] = hizheight;
+    f.objectcount = scene.objectcount;
+    /* The pyramid is last frame's depth, good enough while the camera
+     * moves a little between frames */
+    f.usehiz = (path == PATHCULL || path == PATHCLUSTER) && hizready();
+    f.hizlevels = hizlevels();
+    f.lodrefine = lodthreshold;
+    f.lodcoarsen = lodthreshold * (1.0f - lodhysteresis);
+    glNamedBufferSubData(framerange->buffer, framerange->offset, sizeof(f),
+	    &f);
+    memcpy(viewproj, f.viewproj, sizeof(viewproj));
+
+    if (streamname)
+	streamupdate(f.viewproj, f.planes, streambudget);
+}
+
+void
+recorddraws(void *arg, unsigned int first, unsigned int last)
+{
+    Recorder *r = (Recorder *) arg;
+    CommandList *list = cmdlist();
+    DrawCommand c;
+    const Object *o;
+    const float *t;
+    unsigned int i;
+    float depth;
+
+    memset(&c, 0, sizeof(c));
+    c.program = r->program;
+    c.instancecount = 1;
+    for (i = first; i < last; i++) {
+	o = &scene.objects[i];
+	/* Clip w of the object's origin, the distance in front of the eye */
+	t = o->transform;
+	depth = viewproj[3] * t[0] + viewproj[7] * t[1] +
+	    viewproj[11] * t[2] + viewproj[15];
+	c.key = cmdkey(0, c.program, 0, vaos[o->mesh], depth);
+	c.seq = i;
+	c.vao = vaos[o->mesh];
+	c.count = scene.meshes[o->mesh].indexcount;
+	c.first = indexranges[o->mesh]->offset / sizeof(GLuint);
+	c.baseinstance = i;
+	if (i < r->fit)
+	    memcpy(r->blocks + i * r->stride, o, sizeof(Object));
+	if (path == PATHRANGE && i < r->fit) {
+	    /* Its own block, bound at instance 0 */
+	    c.buffer = ringbuffer();
+	    c.offset = r->offset + i * r->stride;
+	    c.size = sizeof(Object);
+	    c.baseinstance = 0;
+	} else if (path == PATHRANGE) {
+	    /* Out of room, the whole objects buffer */
+	    c.buffer = objectrange->buffer;
+	    c.offset = objectrange->offset;
+	    c.size = objectrange->size;
+	} else if (path == PATHUNIFORM) {
+	    c.uniforms = (const unsigned int *) o;
+	    c.uniformcount = sizeof(Object) / (4 * sizeof(unsigned int));
+	}
+	if (!cmdpush(list, &c)) {
+	    __atomic_store_n(&r->failed, 1, __ATOMIC_RELAXED);
+	    return;
+	}
+    }
+}
+
+void
+drawscene(GLuint program)
+{
+    Recorder r;
+
+    /* The attribute path dequantises with the pulling mesh records */
+    pullbind();
+    switch (path) {
+    case PATHPULL:
+	pulldraw(&scene);
+	return;
+    case PATHMDI:
+	mdidraw();
+	return;
+    case PATHCULL:
+	culldraw(scene.objectcount);
+	return;
+    case PATHCLUSTER:
+	clusterdraw();
+	return;
+    }
+
+    /* The ring paths copy every object each frame, as moving objects would
+     * need. The ring path indexes its copies by instance, so they all have
+     * to fit or it reads the objects buffer as the attribute path does. */
+    memset(&r, 0, sizeof(r));
+    r.program = program;
+    if (path == PATHRING || path == PATHRANGE) {
+	r.stride = path == PATHRANGE ? ringalign(sizeof(Object)) :
+	    sizeof(Object);
+	r.fit = ringroom() / r.stride < scene.objectcount ?
+	    (unsigned int) (ringroom() / r.stride) : scene.objectcount;
+	if (path == PATHRING && r.fit < scene.objectcount)
+	    r.fit = 0;
+	if (r.fit && !(r.blocks = (unsigned char *) ringalloc(r.fit *
+			r.stride, &r.offset)))
+	    r.fit = 0;
+	if (path == PATHRING && r.fit)
+	    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, ringbuffer(),
+		    r.offset, r.fit * sizeof(Object));
+    }
+
+    /* Recorded in parallel, sorted by state then near to far and drawn in
+     * one go */
+    cmdreset();
+    jobfor(scene.objectcount, recordgrain, recorddraws, &r);
+    if (r.failed)
+	term(EXIT_FAILURE, "Out of memory recording draws.\n");
+    /* Every object records a draw, so none back is only fine for none */
+    if (!cmdsubmit(&framearena) && scene.objectcount)
+	term(EXIT_FAILURE, "Out of memory sorting draws.\n");
+    if (path == PATHRING || path == PATHRANGE)
+	bindranges();
+}
+
+void
+drawstream(GLuint program)
+{
     glUseProgram(program);
-    glBindVertexArray(vao);
-    glDrawArrays(GL_TRIANGLES, 0, verticecount);
+    streamdraw();
+    /* The scene's buffers are expected by the next pass and frame */
+    bindranges();
+    pullbind();
+}
+
+void
+drawframe(void)
+{
+    PROFBEGIN("drawframe");
+    if (!arenareset(&framearena))
+	term(EXIT_FAILURE, "Out of memory for the frame.\n");
+    vramframe();
+    updateframe();
+    if (path == PATHCULL) {
+	statsbegin(cullpass);
+	glBindTextureUnit(0, hiztexture());
+	cullrun(cullprogram, scene.objectcount);
+	statsend(cullpass);
+    } else if (path == PATHCLUSTER) {
+	statsbegin(cullpass);
+	glBindTextureUnit(0, hiztexture());
+	clusterrun(clusterprogram, scene.objectcount);
+	statsend(cullpass);
+    } else if (path == PATHMDI) {
+	/* Built once and drawn by both passes with -o */
+	mdirun(&scene);
+    }
 
+    if (overdraw) {
+	overdrawbegin();
+	glUseProgram(countprograms[path]);
+	statsbegin(overdrawpass);
+	drawscene(countprograms[path]);
+	if (streamname)
+	    drawstream(countprograms[PATHATTRIB]);
+	statsend(overdrawpass);
+	overdrawend();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, scenefbo);
+    glClearColor(clearcolour[0], clearcolour[1], clearcolour[2],
+	    clearcolour[3]);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (heatmap) {
+	overdrawshow(heatprogram);
+    } else {
+	glUseProgram(programs[path]);
+	statsbegin(scenepass);
+	drawscene(programs[path]);
+	if (streamname)
+	    drawstream(programs[PATHATTRIB]);
+	statsend(scenepass);
+    }
+
+    /* Next frame's occlusion culling tests against this frame's depth */
+    if ((path == PATHCULL || path == PATHCLUSTER) && !heatmap) {
+	statsbegin(hizpass);
+	hizbuild(hizprogram, scenedepth);
+	statsend(hizpass);
+    }
+
+    glBlitNamedFramebuffer(scenefbo, 0, 0, 0, fbwidth, fbheight, 0, 0,
+	    fbwidth, fbheight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glfwSwapBuffers(window);
+    ringframe();
+    PROFEND();
+}
+
+void
+usage(void)
+{
+    fputs("usage: triangle [-bohqs] [-c image] [-l layers] [-m mesh] "
+	    "[-n objects]\n"
+	    "        [-r attrib|pull|mdi|cull|cluster|ring|range|uniform] "
+	    "[-S mesh]\n", stderr);
+    exit(EXIT_FAILURE);
 }
 
 int
-main(void)
+findpath(const char *name)
 {
+    int i;
+
+    for (i = 0; i < PATHCOUNT; i++)
+	if (!strcmp(name, pathnames[i]))
+	    return i;
+    usage();
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    StreamStats ss;
+    CommandStats cs;
+    double last, now, printed, average, covered, max;
+    unsigned int frames = 0;
+    int i;
+#ifdef ALLOCCOUNT
+    unsigned int drawn = 0;
+    unsigned long heap;
+#endif /* ALLOCCOUNT */
+
+    for (i = 1; i < argc; i++) {
+	if (!strcmp(argv[i], "-s"))
+	    showstats = 1;
+	else if (!strcmp(argv[i], "-o"))
+	    overdraw = 1;
+	else if (!strcmp(argv[i], "-h"))
+	    overdraw = heatmap = 1;
+	else if (!strcmp(argv[i], "-b"))
+	    bench = 1;
+	else if (!strcmp(argv[i], "-q"))
+	    /* CPU only, before there is a window */
+	    exit(quantbench(stdout, quantvertices) ? EXIT_SUCCESS :
+		    EXIT_FAILURE);
+	else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+	    objects = strtoul(argv[++i], NULL, 10);
+	else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+	    layers = strtoul(argv[++i], NULL, 10);
+	else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+	    meshname = argv[++i];
+	else if (!strcmp(argv[i], "-S") && i + 1 < argc)
+	    streamname = argv[++i];
+	else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+	    rastername = argv[++i];
+	else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+	    path = findpath(argv[++i]);
+	else
+	    usage();
+    }
+    if (!objects || !layers)
+	usage();
+    /* Benchmarks run every path in turn */
+    if (bench)
+	path = 0;
+
+    profinit();
+    if (!jobinit(framethreads))
+	term(EXIT_FAILURE, "Failed to start job threads.\n");
+    if (!cmdinit())
+	term(EXIT_FAILURE, "Failed to create command lists.\n");
+    if (!arenainit(&framearena, framearenasize) ||
+	    !arenainit(&loadarena, loadarenasize))
+	term(EXIT_FAILURE, "Failed to create arenas.\n");
+    vraminit(vrambudget);
+    /* CPU only, GLFW is not even initialised */
+    if (rastername)
+	drawraster();
     init();
     createwindow();
     if (!loadshaders())
 	term(EXIT_FAILURE, "Failed to load shaders.\n");
     loadvertices();
+    glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+    createtargets(fbwidth, fbheight);
+    if (!hizinit(fbwidth, fbheight))
+	term(EXIT_FAILURE, "Failed to create depth pyramid.\n");
+    glEnable(GL_DEPTH_TEST);
+    scenepass = statspass("scene");
+    cullpass = statspass("cull");
+    hizpass = statspass("hiz");
+    if (overdraw) {
+	if (!overdrawinit(fbwidth, fbheight))
+	    term(EXIT_FAILURE, "Failed to create overdraw buffer.\n");
+	overdrawpass = statspass("overdraw");
+    }
+    /* Last, so the streaming pool sizes itself to what the budget leaves */
+    if (streamname && (!meshload(&streammesh, streamname) ||
+		!streaminit(&streammesh, &vertexformat, streamslots)))
+	term(EXIT_FAILURE, "Could not stream mesh %s.\n", streamname);
+    arenaterm(&loadarena);
 
+    last = printed = glfwGetTime();
     while (!glfwWindowShouldClose(window)) {
+	/* Between frames, it allocates */
+	if (repack) {
+	    repack = 0;
+	    repackvertices();
+	}
+#ifdef ALLOCCOUNT
+	heap = heapallocs();
+#endif /* ALLOCCOUNT */
 	drawframe();
+	profcollect(0);
+#ifdef ALLOCCOUNT
+	/* Once warmed up a frame never touches the heap */
+	if (drawn < allocwarmup)
+	    drawn++;
+	else if (heapallocs() != heap)
+	    term(EXIT_FAILURE, "Frame allocated from the heap.\n");
+#endif /* ALLOCCOUNT */
+	now = glfwGetTime();
+	statsframe(now - last);
+	last = now;
+	if (showstats && now - printed >= statsinterval) {
+	    statsprint(stdout);
+	    if (path == PATHCULL)
+		printf("%u of %u objects visible, %u triangles\n",
+			cullvisible(), scene.objectcount, culltriangles());
+	    else if (path == PATHCLUSTER)
+		printf("%u of %u meshlets visible\n", clustervisible(),
+			clustercount());
+	    else if (path == PATHATTRIB || path >= PATHRING) {
+		cmdstats(&cs);
+		printf("%u draws, %u program, %u vertex array, %u texture and "
+			"%u range binds, %u uniform updates\n", cs.draws,
+			cs.programs, cs.vaos, cs.textures, cs.ranges,
+			cs.uniforms);
+	    }
+	    if (streamname) {
+		streamstats(&ss);
+		printf("stream %u of %u chunks visible, %u resident, %u drawn, "
+			"%.1f MB uploaded\n", ss.visible, ss.chunks,
+			ss.resident, ss.drawn, ss.uploaded / 1e6);
+	    }
+	    if (overdraw) {
+		if (overdrawresult(&average, &covered, &max))
+		    printf("overdraw %.2f per pixel, %.2f per covered pixel, "
+			    "%.0f max\n", average, covered, max);
+		overdrawread();
+	    }
+	    printed = now;
+	}
+	if (bench && ++frames == benchwarmup) {
+	    statsreset();
+	} else if (bench && frames == benchwarmup + benchframes) {
+	    printf("%s path, %u objects, %u meshes\n", pathnames[path],
+		    scene.objectcount, scene.meshcount);
+	    statsprint(stdout);
+	    frames = 0;
+	    if (path + 1 < PATHCOUNT)
+		path++;
+	    else
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+	}
 	glfwPollEvents();
     }
 
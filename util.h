@@ -0,0 +1,3 @@
+/* Macros */
+#define COUNT(x)  (sizeof(x) / sizeof(x[0]))
+#define UNUSED(x) (void) (x)
@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "glad.h"
+#include "quant.h"
+#include "scene.h"
+#include "vformat.h"
+
+/* Function prototypes */
+static unsigned int positionsize(int format);
+static unsigned int normalsize(int format);
+static unsigned int uvsize(int format);
+
+/* Function implementations */
+
+unsigned int
+positionsize(int format)
+{
+    /* Three 16-bit values padded to keep attributes 4-byte aligned */
+    return format == FORMATHALF || format == FORMATSNORM16 ? 8 : 12;
+}
+
+unsigned int
+normalsize(int format)
+{
+    return format == FORMATPACKED ? 4 : 12;
+}
+
+unsigned int
+uvsize(int format)
+{
+    return format == FORMATHALF || format == FORMATUNORM16 ? 4 : 8;
+}
+
+unsigned int
+vformatstride(const VertexFormat *format)
+{
+    return positionsize(format->position) + normalsize(format->normal) +
+	uvsize(format->uv);
+}
+
+void
+vformatbounds(const Mesh *mesh, int position, float *scale, float *offset)
+{
+    unsigned int j;
+
+    /* snorm16 covers the bounding box, half and float are stored as is */
+    for (j = 0; j < 3; j++) {
+	scale[j] = 1.0f;
+	offset[j] = 0.0f;
+	if (position == FORMATSNORM16) {
+	    scale[j] = 0.5f * (mesh->max[j] - mesh->min[j]);
+	    offset[j] = 0.5f * (mesh->min[j] + mesh->max[j]);
+	    if (scale[j] <= 0.0f)
+		scale[j] = 1.0f;
+	}
+    }
+}
+
+unsigned char *
+vformatpack(unsigned char *dst, const Mesh *mesh, const VertexFormat *format,
+	unsigned short *scratch)
+{
+    const float *n, *t;
+    float scale[3], offset[3];
+    unsigned short *quantised = NULL, h[2];
+    uint32_t w;
+    unsigned int i;
+
+    /* Positions go through the bulk kernels first, then are interleaved */
+    vformatbounds(mesh, format->position, scale, offset);
+    if (format->position == FORMATHALF || format->position == FORMATSNORM16) {
+	quantised = scratch;
+	if (format->position == FORMATHALF)
+	    quanthalf(quantised, mesh->positions, mesh->vertexcount);
+	else
+	    quantsnorm16((short *) quantised, mesh->positions,
+		    mesh->vertexcount, scale, offset);
+    }
+
+    for (i = 0; i < mesh->vertexcount; i++) {
+	n = mesh->normals + i * 3;
+	t = mesh->uvs + i * 2;
+
+	if (quantised)
+	    memcpy(dst, quantised + i * 4, 8);
+	else
+	    memcpy(dst, mesh->positions + i * 3, 12);
+	dst += positionsize(format->position);
+
+	if (format->normal == FORMATPACKED) {
+	    w = packsnorm10(n);
+	    memcpy(dst, &w, 4);
+	} else {
+	    memcpy(dst, n, 12);
+	}
+	dst += normalsize(format->normal);
+
+	switch (format->uv) {
+	case FORMATHALF:
+	    h[0] = floattohalf(t[0]);
+	    h[1] = floattohalf(t[1]);
+	    memcpy(dst, h, 4);
+	    break;
+	case FORMATUNORM16:
+	    h[0] = floattounorm16(t[0]);
+	    h[1] = floattounorm16(t[1]);
+	    memcpy(dst, h, 4);
+	    break;
+	default:
+	    memcpy(dst, t, 8);
+	}
+	dst += uvsize(format->uv);
+    }
+
+    return dst;
+}
+
+void
+vformatsetup(GLuint vao, GLuint vbo, GLintptr base,
+	const VertexFormat *format)
+{
+    GLuint offset = 0, i;
+
+    glVertexArrayVertexBuffer(vao, 0, vbo, base, vformatstride(format));
+
+    switch (format->position) {
+    case FORMATHALF:
+	glVertexArrayAttribFormat(vao, 0, 3, GL_HALF_FLOAT, GL_FALSE, offset);
+	break;
+    case FORMATSNORM16:
+	glVertexArrayAttribFormat(vao, 0, 3, GL_SHORT, GL_TRUE, offset);
+	break;
+    default:
+	glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, offset);
+    }
+    offset += positionsize(format->position);
+
+    if (format->normal == FORMATPACKED)
+	glVertexArrayAttribFormat(vao, 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+		offset);
+    else
+	glVertexArrayAttribFormat(vao, 1, 3, GL_FLOAT, GL_FALSE, offset);
+    offset += normalsize(format->normal);
+
+    switch (format->uv) {
+    case FORMATHALF:
+	glVertexArrayAttribFormat(vao, 2, 2, GL_HALF_FLOAT, GL_FALSE, offset);
+	break;
+    case FORMATUNORM16:
+	glVertexArrayAttribFormat(vao, 2, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+		offset);
+	break;
+    default:
+	glVertexArrayAttribFormat(vao, 2, 2, GL_FLOAT, GL_FALSE, offset);
+    }
+
+    for (i = 0; i < 3; i++) {
+	glEnableVertexArrayAttrib(vao, i);
+	glVertexArrayAttribBinding(vao, i, 0);
+    }
+}
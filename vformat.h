@@ -0,0 +1,31 @@
+/* Vertex formats.
+ *
+ * Positions, normals and texture coordinates can each be stored at full or
+ * reduced precision and are interleaved, vformatstride() bytes a vertex.
+ * Quantised positions cover the mesh bounding box and are restored in the
+ * shader with the scale and offset from vformatbounds(). Texture coordinates
+ * in unorm16 are clamped to [0, 1]. vformatpack() returns the end of what
+ * it wrote. It quantises positions into scratch first, which needs room
+ * for VFORMATSCRATCH unsigned shorts a vertex and may be NULL for float
+ * positions, so packing never allocates. vformatsetup() points a VAO's
+ * attributes 0 to 2 at packed vertices from base in a buffer. Requires
+ * scene.h. */
+
+#define VFORMATSCRATCH 4
+
+/* The position formats match the layouts in the pulling shaders */
+enum { FORMATFLOAT, FORMATHALF, FORMATSNORM16, FORMATPACKED, FORMATUNORM16 };
+
+typedef struct {
+    int position;       /* FORMATFLOAT, FORMATHALF or FORMATSNORM16 */
+    int normal;         /* FORMATFLOAT or FORMATPACKED, 2_10_10_10 */
+    int uv;             /* FORMATFLOAT, FORMATHALF or FORMATUNORM16 */
+} VertexFormat;
+
+unsigned int vformatstride(const VertexFormat *format);
+void vformatbounds(const Mesh *mesh, int position, float *scale,
+	float *offset);
+unsigned char *vformatpack(unsigned char *dst, const Mesh *mesh,
+	const VertexFormat *format, unsigned short *scratch);
+void vformatsetup(GLuint vao, GLuint vbo, GLintptr base,
+	const VertexFormat *format);
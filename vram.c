@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad.h"
+#include "vram.h"
+
+/* Macros */
+#define MB(n) ((double) (n) / 1e6)
+
+/* Types */
+typedef struct {
+    GLenum type;
+    GLuint name;
+    int usage;
+    size_t size;
+    const char *owner;
+    unsigned long frame;    /* Made in */
+} Entry;
+
+/* Variables */
+static const char *const usagenames[] = {
+    "vertex", "index", "storage", "indirect", "staging", "pooled",
+    "texture", "target"
+};
+static Entry *entries;
+static unsigned int count, capacity;
+static size_t totals[VRAMUSAGES], peaks[VRAMUSAGES], total, peak, budget;
+static unsigned long frame, late; /* late counts entries after frame 0 */
+static int over;
+
+/* Function implementations */
+
+int
+vraminit(size_t size)
+{
+    vramterm();
+    budget = size;
+
+    return 1;
+}
+
+void
+vramtrack(GLenum type, GLuint name, int usage, size_t size,
+	const char *owner)
+{
+    Entry *grown;
+
+    if (count == capacity) {
+	if (!(grown = (Entry *) realloc(entries, (capacity ? capacity * 2 :
+			    64) * sizeof(Entry)))) {
+	    fprintf(stderr, "Out of memory tracking %s's GPU memory.\n",
+		    owner);
+	    return;
+	}
+	entries = grown;
+	capacity = capacity ? capacity * 2 : 64;
+    }
+    entries[count].type = type;
+    entries[count].name = name;
+    entries[count].usage = usage;
+    entries[count].size = size;
+    entries[count].owner = owner;
+    entries[count].frame = frame;
+    count++;
+    if (frame)
+	late++;
+
+    totals[usage] += size;
+    if (totals[usage] > peaks[usage])
+	peaks[usage] = totals[usage];
+    total += size;
+    if (total > peak)
+	peak = total;
+
+    /* Once per crossing, not for every allocation past it */
+    if (budget && total > budget && !over)
+	fprintf(stderr, "GPU memory %.1f MB is over the %.1f MB budget, "
+		"%s asked for %.1f MB.\n", MB(total), MB(budget), owner,
+		MB(size));
+    over = budget && total > budget;
+}
+
+void
+vramuntrack(GLenum type, GLuint name)
+{
+    unsigned int i;
+
+    if (!name)
+	return;
+    for (i = 0; i < count; i++) {
+	if (entries[i].type != type || entries[i].name != name)
+	    continue;
+	totals[entries[i].usage] -= entries[i].size;
+	total -= entries[i].size;
+	entries[i] = entries[--count];
+	over = budget && total > budget;
+	return;
+    }
+}
+
+void
+vramframe(void)
+{
+    frame++;
+}
+
+size_t
+vramavailable(void)
+{
+    if (!budget)
+	return (size_t) -1;
+
+    return total < budget ? budget - total : 0;
+}
+
+void
+vramreport(FILE *fp)
+{
+    size_t size;
+    unsigned int i, j, objects, made;
+
+    fprintf(fp, "GPU memory %.1f MB, peak %.1f MB", MB(total), MB(peak));
+    if (budget)
+	fprintf(fp, " of a %.1f MB budget", MB(budget));
+    fprintf(fp, ", %u objects, %lu made after the first frame\n", count,
+	    late);
+    for (i = 0; i < VRAMUSAGES; i++)
+	if (peaks[i])
+	    fprintf(fp, "  %-8s %8.1f MB, peak %8.1f MB\n", usagenames[i],
+		    MB(totals[i]), MB(peaks[i]));
+
+    /* Then per owner, summed on the spot as there are only a few */
+    for (i = 0; i < count; i++) {
+	for (j = 0; j < i; j++)
+	    if (!strcmp(entries[j].owner, entries[i].owner))
+		break;
+	if (j < i)
+	    continue;
+	for (size = 0, objects = made = 0; j < count; j++) {
+	    if (strcmp(entries[j].owner, entries[i].owner))
+		continue;
+	    size += entries[j].size;
+	    objects++;
+	    made += entries[j].frame > 0;
+	}
+	fprintf(fp, "  %-8s %8.1f MB in %u objects, %u after the first "
+		"frame\n", entries[i].owner, MB(size), objects, made);
+    }
+}
+
+void
+vramterm(void)
+{
+    unsigned int i;
+
+    free(entries);
+    entries = NULL;
+    count = capacity = 0;
+    for (i = 0; i < VRAMUSAGES; i++)
+	totals[i] = peaks[i] = 0;
+    total = peak = budget = 0;
+    frame = late = 0;
+    over = 0;
+}
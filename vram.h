@@ -0,0 +1,26 @@
+/* GPU memory accounting.
+ *
+ * Every buffer, texture and render buffer is entered with vramtrack() as
+ * it is given storage and left with vramuntrack() before it is deleted,
+ * under its GL type and name. Each entry keeps its size, what it is used
+ * for, an owner tag and the frame it was made in, counted by vramframe().
+ * Owner tags are kept by pointer and must be string literals. Going over
+ * the budget given to vraminit(), 0 for none, prints a warning.
+ * vramavailable() gives what is left of the budget, so a cache can size
+ * itself to fit. vramreport() prints the totals and high-water marks per
+ * usage, then what each owner holds and how much of it was made after the
+ * first frame. Requires stdio.h. */
+
+enum {
+    VRAMVERTEX, VRAMINDEX, VRAMSTORAGE, VRAMINDIRECT, VRAMSTAGING,
+    VRAMPOOL, VRAMTEXTURE, VRAMTARGET, VRAMUSAGES
+};
+
+int vraminit(size_t budget);
+void vramtrack(GLenum type, GLuint name, int usage, size_t size,
+	const char *owner);
+void vramuntrack(GLenum type, GLuint name);
+void vramframe(void);
+size_t vramavailable(void);
+void vramreport(FILE *fp);
+void vramterm(void);